@@ -0,0 +1,431 @@
+#include "apwatch.h"
+
+static const uint8_t IE_SSID = 0;
+static const uint8_t IE_COUNTRY = 7;
+static const uint8_t IE_HT_CAP = 45;
+static const uint8_t IE_RSN = 48;
+static const uint8_t IE_VHT_CAP = 191;
+static const uint8_t IE_VENDOR = 221;
+static const uint8_t OUI_IEEE[3] = {0x00, 0x0F, 0xAC};
+static const uint8_t OUI_MICROSOFT[3] = {0x00, 0x50, 0xF2};
+static const uint8_t MS_TYPE_WPA = 1;
+static const uint8_t MS_TYPE_WPS = 4;
+
+// AKM suite types
+static const uint8_t AKM_8021X = 1;
+static const uint8_t AKM_PSK = 2;
+static const uint8_t AKM_FT_8021X = 3;
+static const uint8_t AKM_FT_PSK = 4;
+static const uint8_t AKM_8021X_SHA256 = 5;
+static const uint8_t AKM_PSK_SHA256 = 6;
+static const uint8_t AKM_SAE = 8;
+static const uint8_t AKM_FT_SAE = 9;
+static const uint8_t AKM_SUITE_B = 11;
+static const uint8_t AKM_SUITE_B_192 = 12;
+static const uint8_t AKM_OWE = 18;
+static const uint8_t AKM_SAE_EXT = 24;
+// Cipher suite types
+static const uint8_t CIPHER_WEP40 = 1;
+static const uint8_t CIPHER_TKIP = 2;
+static const uint8_t CIPHER_CCMP = 4;
+static const uint8_t CIPHER_WEP104 = 5;
+static const uint8_t CIPHER_GCMP = 8;
+static const uint8_t CIPHER_GCMP256 = 9;
+static const uint8_t CIPHER_CCMP256 = 10;
+
+static const uint16_t CAP_PRIVACY = 0x0010;
+static const uint16_t HT_CAP_SMPS = 0x000C;     // follows the power state
+static const uint16_t RSN_CAP_MFP = 0x00C0;     // MFP required/capable
+
+struct SsidEntry {
+    uint32_t hash;       // 0 = free way
+    uint8_t len;
+    ApSsidInfo info;
+    uint32_t bssidSeen[AP_SSID_BSSIDS];
+    uint32_t secFp;      // established by the first beacon, 0 until then
+    uint32_t radioFp;    // likewise
+};
+
+struct BssidEntry {
+    uint8_t bssid[6];
+    bool used;
+    int8_t rssi;
+    uint8_t channel;
+    uint8_t ssidCount;   // distinct SSIDs, saturating
+    uint32_t ssidHashes[AP_BSSID_SSIDS];
+    bool cloned;         // beacons with two fingerprints already reported
+    uint32_t secFp;      // from its beacons, 0 until one is seen
+    uint32_t radioFp;
+    uint32_t beacons;
+    uint32_t probeResps;
+    uint32_t lastSeen;
+};
+
+static SsidEntry ssids[AP_SSID_SETS][AP_SSID_WAYS];
+static BssidEntry bssids[AP_BSSID_SETS][AP_BSSID_WAYS];
+static portMUX_TYPE apMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t ssidsEvicted = 0, bssidsEvicted = 0;
+
+static inline uint32_t IRAM_ATTR ssidHash(const char *s, uint8_t len) {
+    uint32_t h = 2166136261u;
+    for (uint8_t i = 0; i < len; i++) h = (h ^ (uint8_t)s[i]) * 16777619u;
+    return h ? h : 1;
+}
+
+static inline uint32_t IRAM_ATTR fnv32(uint32_t h, const void *data, size_t n) {
+    const uint8_t *p = (const uint8_t *)data;
+    for (size_t i = 0; i < n; i++) h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+static inline uint16_t IRAM_ATTR rd16(const uint8_t *p) {
+    return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+static inline uint32_t IRAM_ATTR rd32(const uint8_t *p) {
+    return (uint32_t)rd16(p) | ((uint32_t)rd16(p + 2) << 16);
+}
+
+// Suite type for the IEEE and Microsoft OUIs, 0 for anything vendor specific
+static inline uint8_t IRAM_ATTR suiteType(const uint8_t *s) {
+    if (!memcmp(s, OUI_IEEE, 3) || !memcmp(s, OUI_MICROSOFT, 3)) return s[3];
+    return 0;
+}
+
+// RSN IE body, or a WPA vendor IE body past its OUI and type. Both are
+// version, group suite, pairwise list, AKM list; RSN then has caps.
+static void IRAM_ATTR parseSuites(const uint8_t *p, size_t len, bool rsn, ApProfile &ap) {
+    const uint8_t *end = p + len;
+    ap.security |= rsn ? AP_SEC_RSN : AP_SEC_WPA;
+    p += 2;
+    if (end - p < 4) return;
+    if (!ap.groupCipher) ap.groupCipher = suiteType(p);
+    p += 4;
+    for (int list = 0; list < 2; list++) {
+        if (end - p < 2) return;
+        uint16_t n = rd16(p);
+        p += 2;
+        for (uint16_t i = 0; i < n && end - p >= 4; i++, p += 4) {
+            uint8_t t = suiteType(p);
+            if (list == 0) ap.ciphers |= t < 16 ? 1u << t : 1u;
+            else ap.akms |= t < 32 ? 1u << t : 1u;
+        }
+    }
+    if (rsn && end - p >= 2) ap.rsnCaps = rd16(p);
+}
+
+bool IRAM_ATTR apParse(const uint8_t *body, size_t len, ApProfile &ap) {
+    memset(&ap, 0, sizeof(ap));
+    if (len < 12) return false;
+    ap.beaconInterval = rd16(body + 8);
+    ap.capability = rd16(body + 10);
+
+    const uint8_t *p = body + 12;
+    const uint8_t *end = body + len;
+    bool haveSsid = false, haveCountry = false, haveRsn = false, haveWpa = false;
+    uint32_t vendors = 2166136261u;
+    while (end - p >= 2) {
+        uint8_t id = p[0];
+        uint8_t l = p[1];
+        const uint8_t *ie = p + 2;
+        // A truncated trailing element is dropped, not half-read
+        if ((size_t)(end - ie) < l) break;
+        p = ie + l;
+
+        switch (id) {
+        case IE_SSID:
+            if (!haveSsid && l <= 32) {
+                // Hidden networks send zeros or an empty SSID
+                bool blank = true;
+                for (uint8_t i = 0; i < l && blank; i++) blank = !ie[i];
+                if (!blank) {
+                    ap.ssid = ie;
+                    ap.ssidLen = l;
+                }
+            }
+            haveSsid = true;
+            break;
+        case IE_COUNTRY:
+            if (!haveCountry && l >= 2) {
+                ap.country[0] = (char)ie[0];
+                ap.country[1] = (char)ie[1];
+            }
+            haveCountry = true;
+            break;
+        case IE_HT_CAP:
+            if (!ap.ht && l >= 2) {
+                ap.ht = true;
+                ap.htCaps = rd16(ie);
+            }
+            break;
+        case IE_VHT_CAP:
+            if (!ap.vht && l >= 4) {
+                ap.vht = true;
+                ap.vhtCaps = rd32(ie);
+            }
+            break;
+        case IE_RSN:
+            if (!haveRsn && l >= 2) parseSuites(ie, l, true, ap);
+            haveRsn = true;
+            break;
+        case IE_VENDOR:
+            if (l < 4) break;
+            if (!memcmp(ie, OUI_MICROSOFT, 3) && ie[3] == MS_TYPE_WPA) {
+                if (!haveWpa && l >= 6) parseSuites(ie + 4, l - 4, false, ap);
+                haveWpa = true;
+                break;
+            }
+            // WPS comes and goes with the push button
+            if (!memcmp(ie, OUI_MICROSOFT, 3) && ie[3] == MS_TYPE_WPS) break;
+            vendors = fnv32(vendors, ie, 4);
+            if (ap.vendorCount < 255) ap.vendorCount++;
+            break;
+        default:
+            break;
+        }
+    }
+    if (!ap.security && (ap.capability & CAP_PRIVACY)) ap.security = AP_SEC_WEP;
+    ap.vendorHash = vendors;
+
+    uint32_t h = fnv32(2166136261u, &ap.security, 1);
+    h = fnv32(h, &ap.groupCipher, 1);
+    h = fnv32(h, &ap.ciphers, 2);
+    h = fnv32(h, &ap.akms, 4);
+    uint16_t mfp = ap.rsnCaps & RSN_CAP_MFP;
+    h = fnv32(h, &mfp, 2);
+    ap.secFp = h ? h : 1;
+
+    uint16_t ht = ap.htCaps & ~HT_CAP_SMPS;
+    h = fnv32(2166136261u, &ap.ht, 1);
+    h = fnv32(h, &ht, 2);
+    h = fnv32(h, &ap.vht, 1);
+    h = fnv32(h, &ap.vhtCaps, 4);
+    h = fnv32(h, ap.country, 2);
+    h = fnv32(h, &ap.vendorHash, 4);
+    h = fnv32(h, &ap.beaconInterval, 2);
+    ap.radioFp = h ? h : 1;
+    return true;
+}
+
+static inline size_t IRAM_ATTR bssidSet(const uint8_t *m) {
+    // The low octets vary most between radios
+    return (size_t)(m[5] ^ (m[4] << 1) ^ (m[3] << 2)) & (AP_BSSID_SETS - 1);
+}
+
+static BssidEntry *IRAM_ATTR findBssid(const uint8_t *bssid) {
+    BssidEntry *set = bssids[bssidSet(bssid)];
+    for (size_t w = 0; w < AP_BSSID_WAYS; w++) {
+        if (set[w].used && !memcmp(set[w].bssid, bssid, 6)) return &set[w];
+    }
+    // Free way, else the stalest
+    BssidEntry *e = nullptr;
+    for (size_t w = 0; w < AP_BSSID_WAYS; w++) {
+        if (!set[w].used) {
+            e = &set[w];
+            break;
+        }
+        if (!e || (int32_t)(set[w].lastSeen - e->lastSeen) < 0) e = &set[w];
+    }
+    if (e->used) bssidsEvicted++;
+    memset(e, 0, sizeof(*e));
+    memcpy(e->bssid, bssid, 6);
+    e->used = true;
+    return e;
+}
+
+static SsidEntry *IRAM_ATTR findSsid(const char *ssid, uint8_t len) {
+    uint32_t h = ssidHash(ssid, len);
+    SsidEntry *set = ssids[h & (AP_SSID_SETS - 1)];
+    for (size_t w = 0; w < AP_SSID_WAYS; w++) {
+        if (set[w].hash == h && set[w].len == len && !memcmp(set[w].info.ssid, ssid, len)) return &set[w];
+    }
+    SsidEntry *e = nullptr;
+    for (size_t w = 0; w < AP_SSID_WAYS; w++) {
+        if (!set[w].hash) {
+            e = &set[w];
+            break;
+        }
+        if (!e || (int32_t)(set[w].info.lastSeen - e->info.lastSeen) < 0) e = &set[w];
+    }
+    if (e->hash) ssidsEvicted++;
+    memset(e, 0, sizeof(*e));
+    e->hash = h;
+    e->len = len;
+    memcpy(e->info.ssid, ssid, len);
+    return e;
+}
+
+void apReset() {
+    portENTER_CRITICAL(&apMux);
+    memset(ssids, 0, sizeof(ssids));
+    memset(bssids, 0, sizeof(bssids));
+    ssidsEvicted = bssidsEvicted = 0;
+    portEXIT_CRITICAL(&apMux);
+}
+
+uint8_t IRAM_ATTR apObserve(const uint8_t bssid[6], const ApProfile &ap, bool probeResp, int8_t rssi,
+                            uint8_t channel, uint32_t nowMs) {
+    const char *ssid = (const char *)ap.ssid;
+    uint8_t ssidLen = ap.ssid ? ap.ssidLen : 0;
+    bool isOpen = !ap.security;
+    uint8_t verdict = 0;
+    portENTER_CRITICAL(&apMux);
+
+    BssidEntry *b = findBssid(bssid);
+    b->lastSeen = nowMs;
+    b->rssi = rssi;
+    b->channel = channel;
+    if (probeResp) b->probeResps++;
+    else b->beacons++;
+
+    // A second set of beacons under the same BSSID is a clone of it
+    bool firstBeacon = false;
+    if (!probeResp) {
+        firstBeacon = !b->secFp;
+        if (!firstBeacon && !b->cloned && (b->secFp != ap.secFp || b->radioFp != ap.radioFp)) {
+            b->cloned = true;
+            verdict |= AP_NEW_TWIN;
+        }
+        b->secFp = ap.secFp;
+        b->radioFp = ap.radioFp;
+    }
+
+    if (ssidLen) {
+        uint32_t h = ssidHash(ssid, ssidLen);
+        size_t held = b->ssidCount < AP_BSSID_SSIDS ? b->ssidCount : AP_BSSID_SSIDS;
+        bool known = false;
+        for (size_t i = 0; i < held && !known; i++) known = b->ssidHashes[i] == h;
+        if (!known) {
+            b->ssidHashes[b->ssidCount % AP_BSSID_SSIDS] = h;
+            if (b->ssidCount < 0xFF) b->ssidCount++;
+        }
+        if (b->ssidCount >= AP_KARMA_SSIDS) verdict |= AP_KARMA;
+
+        SsidEntry *s = findSsid(ssid, ssidLen);
+        ApSsidInfo &info = s->info;
+        info.lastSeen = nowMs;
+
+        bool diverged = false;
+        if (!probeResp) {
+            if (!s->secFp) {
+                s->secFp = ap.secFp;
+                info.security = ap.security;
+                info.ciphers = ap.ciphers;
+                info.akms = ap.akms;
+            } else if (s->secFp != ap.secFp) {
+                diverged = true;
+            }
+            if (!s->radioFp) s->radioFp = ap.radioFp;
+            else if (s->radioFp != ap.radioFp) diverged = true;
+        }
+
+        int slot = -1;
+        for (size_t i = 0; i < info.held; i++) {
+            if (!memcmp(info.bssids[i], bssid, 6)) {
+                slot = (int)i;
+                break;
+            }
+        }
+        // Judged when a BSSID first joins the SSID or first beacons for it
+        bool judge = slot < 0 ? info.bssidCount > 0 : firstBeacon;
+        if (judge) {
+            bool spoof = isOpen && info.secured;
+            if (diverged || spoof) {
+                verdict |= AP_NEW_TWIN;
+                if (info.divergent < 0xFF) info.divergent++;
+            }
+            if (spoof) verdict |= AP_OPEN_SPOOF;
+        }
+        if (slot < 0) {
+            if (info.bssidCount < 0xFF) info.bssidCount++;
+            if (info.held < AP_SSID_BSSIDS) {
+                slot = info.held++;
+            } else {
+                slot = 0;
+                for (size_t i = 1; i < AP_SSID_BSSIDS; i++) {
+                    if ((int32_t)(s->bssidSeen[i] - s->bssidSeen[slot]) < 0) slot = (int)i;
+                }
+            }
+            memcpy(info.bssids[slot], bssid, 6);
+        }
+        s->bssidSeen[slot] = nowMs;
+        if (!isOpen) info.secured = true;
+    }
+
+    portEXIT_CRITICAL(&apMux);
+    return verdict;
+}
+
+size_t apSsidCount() {
+    size_t n = 0;
+    portENTER_CRITICAL(&apMux);
+    for (size_t s = 0; s < AP_SSID_SETS; s++) {
+        for (size_t w = 0; w < AP_SSID_WAYS; w++) n += ssids[s][w].hash != 0;
+    }
+    portEXIT_CRITICAL(&apMux);
+    return n;
+}
+
+size_t getApSharedSsids(ApSsidInfo *out, size_t maxCount) {
+    size_t n = 0;
+    portENTER_CRITICAL(&apMux);
+    for (size_t s = 0; s < AP_SSID_SETS; s++) {
+        for (size_t w = 0; w < AP_SSID_WAYS && n < maxCount; w++) {
+            if (ssids[s][w].hash && ssids[s][w].info.bssidCount > 1) out[n++] = ssids[s][w].info;
+        }
+    }
+    portEXIT_CRITICAL(&apMux);
+    return n;
+}
+
+String apSecurityLabel(uint8_t security, uint16_t ciphers, uint32_t akms) {
+    if (!security) return "OPEN";
+    if (security == AP_SEC_WEP) return "WEP";
+    String s = security & AP_SEC_RSN ? (security & AP_SEC_WPA ? "WPA+RSN" : "RSN") : "WPA";
+
+    struct Name {
+        uint32_t mask;
+        const char *name;
+    };
+    static const Name akmNames[] = {
+        {(1u << AKM_PSK) | (1u << AKM_FT_PSK) | (1u << AKM_PSK_SHA256), "PSK"},
+        {(1u << AKM_SAE) | (1u << AKM_FT_SAE) | (1u << AKM_SAE_EXT), "SAE"},
+        {(1u << AKM_8021X) | (1u << AKM_FT_8021X) | (1u << AKM_8021X_SHA256) | (1u << AKM_SUITE_B) |
+             (1u << AKM_SUITE_B_192), "EAP"},
+        {1u << AKM_OWE, "OWE"},
+        {1u, "VENDOR"},
+    };
+    static const Name cipherNames[] = {
+        {1u << CIPHER_TKIP, "TKIP"},
+        {(1u << CIPHER_CCMP) | (1u << CIPHER_CCMP256), "CCMP"},
+        {(1u << CIPHER_GCMP) | (1u << CIPHER_GCMP256), "GCMP"},
+        {(1u << CIPHER_WEP40) | (1u << CIPHER_WEP104), "WEP"},
+    };
+    char sep = ' ';
+    for (const Name &n : akmNames) {
+        if (!(akms & n.mask)) continue;
+        s += sep;
+        s += n.name;
+        sep = '+';
+    }
+    sep = ' ';
+    for (const Name &n : cipherNames) {
+        if (!(ciphers & n.mask)) continue;
+        s += sep;
+        s += n.name;
+        sep = '+';
+    }
+    return s;
+}
+
+String getApStatus() {
+    size_t used = 0;
+    portENTER_CRITICAL(&apMux);
+    for (size_t s = 0; s < AP_BSSID_SETS; s++) {
+        for (size_t w = 0; w < AP_BSSID_WAYS; w++) used += bssids[s][w].used;
+    }
+    portEXIT_CRITICAL(&apMux);
+    return "AP table: " + String((unsigned)apSsidCount()) + "/" + String((unsigned)(AP_SSID_SETS * AP_SSID_WAYS)) +
+           " SSIDs, " + String((unsigned)used) + "/" + String((unsigned)(AP_BSSID_SETS * AP_BSSID_WAYS)) +
+           " BSSIDs, " + String(ssidsEvicted) + "/" + String(bssidsEvicted) + " evicted\n";
+}
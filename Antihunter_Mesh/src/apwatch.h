@@ -0,0 +1,92 @@
+#pragma once
+#include <Arduino.h>
+
+// Access point tables for evil-twin detection. SSIDs are interned in a
+// set-associative table keyed by their FNV-1a hash; each holds a small
+// fixed set of the BSSIDs advertising it. Every BSSID also has a stats
+// record (SSIDs it has answered with, beacon and probe response counts).
+// Both tables evict the stalest way of a full set, so a beacon costs one
+// bounded lookup in each and memory stays fixed however many networks
+// are in range.
+//
+// Each beacon is also reduced to a fingerprint by one bounds-checked walk
+// over its IEs that only points into the frame. The security half covers
+// the privacy bit, RSN/WPA group and pairwise ciphers, AKMs and MFP; the
+// radio half covers HT/VHT caps, vendor IE OUIs, country and the beacon
+// interval. An SSID keeps the security and radio fingerprints it was first
+// seen with, so the many APs of one deployment
+// (same controller, same config) agree and a twin is a BSSID that does
+// not. Probe responses carry a different IE set and are not compared.
+
+static const size_t AP_SSID_SETS = 32;
+static const size_t AP_SSID_WAYS = 4;
+static const size_t AP_SSID_BSSIDS = 4;     // BSSIDs kept per SSID
+static const size_t AP_BSSID_SETS = 64;
+static const size_t AP_BSSID_WAYS = 4;
+static const size_t AP_BSSID_SSIDS = 4;     // SSID hashes kept per BSSID
+// A BSSID answering with this many different SSIDs is a karma responder
+static const uint8_t AP_KARMA_SSIDS = 3;
+
+// apObserve verdict bits
+static const uint8_t AP_NEW_TWIN = 0x01;     // BSSID whose fingerprint differs from the SSID's
+static const uint8_t AP_OPEN_SPOOF = 0x02;   // open BSSID for an SSID seen secured
+static const uint8_t AP_KARMA = 0x04;
+
+// ApProfile.security bits; 0 is an open network
+static const uint8_t AP_SEC_WEP = 0x01;      // privacy bit without WPA/RSN
+static const uint8_t AP_SEC_WPA = 0x02;
+static const uint8_t AP_SEC_RSN = 0x04;
+
+// What one beacon or probe response says about its AP. Cipher and AKM
+// fields are bitmasks of the 802.11 suite types (1 << type) from the RSN
+// and WPA IEs together; bit 0 stands for vendor suites.
+struct ApProfile {
+    const uint8_t *ssid;     // into the frame, not terminated
+    uint8_t ssidLen;
+    uint8_t security;        // AP_SEC_*
+    uint8_t groupCipher;     // suite type, 0 if none
+    uint16_t ciphers;        // pairwise
+    uint32_t akms;
+    uint16_t rsnCaps;
+    uint16_t capability;
+    uint16_t beaconInterval;
+    uint16_t htCaps;
+    uint32_t vhtCaps;
+    bool ht;
+    bool vht;
+    char country[3];
+    uint8_t vendorCount;
+    uint32_t vendorHash;     // vendor IE OUIs and types, in order
+    uint32_t secFp;          // never 0
+    uint32_t radioFp;
+};
+
+struct ApSsidInfo {
+    char ssid[33];
+    uint8_t held;        // BSSIDs in bssids[]
+    uint8_t bssidCount;  // distinct BSSIDs seen, saturating
+    uint8_t divergent;   // BSSIDs flagged for a differing fingerprint
+    bool secured;
+    uint8_t security;    // established profile, see ApProfile
+    uint16_t ciphers;
+    uint32_t akms;
+    uint8_t bssids[AP_SSID_BSSIDS][6];
+    uint32_t lastSeen;
+};
+
+void apReset();
+// Walks a beacon or probe response body (the fixed fields after the
+// 24-byte header, then the IEs; len excludes the FCS). Only the first of
+// each IE counts and a truncated trailing IE is ignored.
+// Returns false when the fixed fields are missing. No allocation.
+bool apParse(const uint8_t *body, size_t len, ApProfile &ap);
+// Records a parsed beacon or probe response; ap.ssidLen is 0 for hidden
+// networks. Returns AP_* bits. RX-callback safe, no allocation.
+uint8_t apObserve(const uint8_t bssid[6], const ApProfile &ap, bool probeResp, int8_t rssi, uint8_t channel,
+                  uint32_t nowMs);
+// "RSN PSK+SAE CCMP" style summary, "OPEN" or "WEP"
+String apSecurityLabel(uint8_t security, uint16_t ciphers, uint32_t akms);
+size_t apSsidCount();
+// SSIDs served by more than one BSSID
+size_t getApSharedSsids(ApSsidInfo *out, size_t maxCount);
+String getApStatus();
@@ -0,0 +1,246 @@
+#include "blematch.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+const char BLE_TRACKER_PRESETS[] =
+    "# Apple Find My accessories (AirTag) away from their owner\n"
+    "FindMy mfg 004C 1219\n"
+    "Tile uuid16 FEED\n"
+    "Tile uuid16 FEEC\n"
+    "SmartTag uuid16 FD5A\n"
+    "Chipolo uuid16 FE33\n"
+    "# Google Find My Device network, Eddystone frame 0x40/0x41\n"
+    "GoogleFMDN uuid16 FEAA 40/FE\n";
+
+static const char *KIND_NAMES[BLE_KIND_COUNT] = {"", "mfg", "uuid16", "uuid128", "name"};
+
+// Hex digits into bytes, skipping "-" and ":"; false on anything else or
+// an odd digit count
+static bool parseHexBytes(const char *s, size_t len, uint8_t *out, size_t cap, size_t &n) {
+    n = 0;
+    int hi = -1;
+    for (size_t i = 0; i < len; i++) {
+        char c = s[i];
+        if (c == '-' || c == ':') continue;
+        if (!isxdigit((unsigned char)c)) return false;
+        int v = isdigit((unsigned char)c) ? c - '0' : toupper((unsigned char)c) - 'A' + 10;
+        if (hi < 0) {
+            hi = v;
+        } else {
+            if (n == cap) return false;
+            out[n++] = (uint8_t)(hi << 4 | v);
+            hi = -1;
+        }
+    }
+    return hi < 0;
+}
+
+// "<data>[/<mask>]"
+static bool parseData(const char *s, size_t len, BleAdRule &r) {
+    const char *slash = (const char *)memchr(s, '/', len);
+    size_t dlen = slash ? (size_t)(slash - s) : len;
+    size_t n, m;
+    if (!parseHexBytes(s, dlen, r.data, BLE_DATA_MAX, n) || !n) return false;
+    if (slash) {
+        if (!parseHexBytes(slash + 1, len - dlen - 1, r.mask, BLE_DATA_MAX, m) || m != n) return false;
+    } else {
+        memset(r.mask, 0xFF, n);
+    }
+    for (size_t i = 0; i < n; i++) r.data[i] &= r.mask[i];
+    r.dataLen = (uint8_t)n;
+    return true;
+}
+
+// Next whitespace-separated token in [p, end)
+static bool nextToken(const char *&p, const char *end, const char *&tok, size_t &tlen) {
+    while (p < end && isspace((unsigned char)*p)) p++;
+    tok = p;
+    while (p < end && !isspace((unsigned char)*p)) p++;
+    tlen = (size_t)(p - tok);
+    return tlen > 0;
+}
+
+static bool parseRule(const char *p, const char *end, BleAdRule &r, const char *&label, size_t &labelLen) {
+    const char *tok;
+    size_t tlen;
+    memset(&r, 0, sizeof(r));
+    if (!nextToken(p, end, label, labelLen) || labelLen >= BLE_LABEL_MAX) return false;
+    if (!nextToken(p, end, tok, tlen)) return false;
+    for (uint8_t k = BLE_KIND_MFG; k < BLE_KIND_COUNT; k++) {
+        if (strlen(KIND_NAMES[k]) == tlen && !strncmp(tok, KIND_NAMES[k], tlen)) r.kind = k;
+    }
+    if (r.kind == BLE_KIND_NONE) return false;
+
+    if (r.kind == BLE_KIND_NAME) {
+        // Rest of the line, inner spaces kept
+        while (p < end && isspace((unsigned char)*p)) p++;
+        while (end > p && isspace((unsigned char)end[-1])) end--;
+        size_t n = (size_t)(end - p);
+        if (!n || n > BLE_KEY_MAX) return false;
+        memcpy(r.key, p, n);
+        r.keyLen = (uint8_t)n;
+        return true;
+    }
+
+    uint8_t be[BLE_KEY_MAX];
+    size_t n;
+    size_t want = r.kind == BLE_KIND_UUID128 ? 16 : 2;
+    if (!nextToken(p, end, tok, tlen) || !parseHexBytes(tok, tlen, be, sizeof(be), n) || n != want) return false;
+    // Printed big-endian, carried little-endian on air
+    for (size_t i = 0; i < n; i++) r.key[i] = be[n - 1 - i];
+    r.keyLen = (uint8_t)n;
+    if (nextToken(p, end, tok, tlen) && !parseData(tok, tlen, r)) return false;
+    return !nextToken(p, end, tok, tlen);
+}
+
+size_t bleCompile(BleMatchTable &t, const char *spec, size_t len, uint32_t *rejected) {
+    memset(&t, 0, sizeof(t));
+    uint32_t bad = 0;
+    const char *end = spec + len;
+    for (const char *line = spec; line < end;) {
+        const char *eol = (const char *)memchr(line, '\n', (size_t)(end - line));
+        if (!eol) eol = end;
+        const char *stop = (const char *)memchr(line, '#', (size_t)(eol - line));
+        if (!stop) stop = eol;
+        const char *p = line;
+        while (p < stop && isspace((unsigned char)*p)) p++;
+        line = eol + 1;
+        if (p == stop) continue;
+
+        BleAdRule r;
+        const char *label;
+        size_t labelLen;
+        if (!parseRule(p, stop, r, label, labelLen) || t.ruleCount == BLE_MAX_RULES) {
+            bad++;
+            continue;
+        }
+        size_t pat = 0;
+        while (pat < t.patternCount &&
+               (strlen(t.labels[pat]) != labelLen || strncmp(t.labels[pat], label, labelLen))) {
+            pat++;
+        }
+        if (pat == t.patternCount) {
+            if (pat == BLE_MAX_PATTERNS) {
+                bad++;
+                continue;
+            }
+            memcpy(t.labels[pat], label, labelLen);
+            t.labels[pat][labelLen] = '\0';
+            t.patternCount++;
+        }
+        r.pattern = (uint8_t)pat;
+
+        // Insertion keeps rules grouped by kind in spec order
+        size_t at = t.ruleCount;
+        while (at > 0 && t.rules[at - 1].kind > r.kind) {
+            t.rules[at] = t.rules[at - 1];
+            at--;
+        }
+        t.rules[at] = r;
+        t.ruleCount++;
+    }
+
+    size_t i = 0;
+    for (uint8_t k = 0; k <= BLE_KIND_COUNT; k++) {
+        while (i < t.ruleCount && t.rules[i].kind < k) i++;
+        t.kindStart[k] = (uint8_t)i;
+    }
+    if (rejected) *rejected = bad;
+    return t.ruleCount;
+}
+
+// Tries every rule of one kind against one key occurrence. listEntry is
+// set for UUIDs taken from a service list, which carry no data.
+static void matchKind(const BleMatchTable &t, uint8_t kind, const uint8_t *key, size_t keyAvail,
+                      const uint8_t *data, size_t dataLen, bool listEntry, uint32_t &hits) {
+    for (uint8_t i = t.kindStart[kind]; i < t.kindStart[kind + 1]; i++) {
+        const BleAdRule &r = t.rules[i];
+        if (hits & (1u << r.pattern)) continue;
+        if (r.keyLen > keyAvail || memcmp(key, r.key, r.keyLen)) continue;
+        if (r.dataLen) {
+            if (listEntry || dataLen < r.dataLen) continue;
+            uint8_t j = 0;
+            while (j < r.dataLen && (data[j] & r.mask[j]) == r.data[j]) j++;
+            if (j < r.dataLen) continue;
+        }
+        hits |= 1u << r.pattern;
+    }
+}
+
+uint32_t bleMatch(const BleMatchTable &t, const uint8_t *adv, size_t len) {
+    uint32_t hits = 0;
+    if (!t.ruleCount || !adv) return 0;
+    const uint8_t *p = adv;
+    const uint8_t *end = adv + len;
+    while (end - p >= 2) {
+        uint8_t l = p[0];
+        // A zero length marks the end of significant data
+        if (!l || (size_t)(end - p) < (size_t)l + 1) break;
+        uint8_t type = p[1];
+        const uint8_t *body = p + 2;
+        size_t n = l - 1;
+        p += l + 1;
+
+        switch (type) {
+        case 0xFF:
+            if (n >= 2) matchKind(t, BLE_KIND_MFG, body, 2, body + 2, n - 2, false, hits);
+            break;
+        case 0x02:
+        case 0x03:
+            for (size_t i = 0; i + 2 <= n; i += 2) matchKind(t, BLE_KIND_UUID16, body + i, 2, nullptr, 0, true, hits);
+            break;
+        case 0x16:
+            if (n >= 2) matchKind(t, BLE_KIND_UUID16, body, 2, body + 2, n - 2, false, hits);
+            break;
+        case 0x06:
+        case 0x07:
+            for (size_t i = 0; i + 16 <= n; i += 16) matchKind(t, BLE_KIND_UUID128, body + i, 16, nullptr, 0, true, hits);
+            break;
+        case 0x21:
+            if (n >= 16) matchKind(t, BLE_KIND_UUID128, body, 16, body + 16, n - 16, false, hits);
+            break;
+        case 0x08:
+        case 0x09:
+            matchKind(t, BLE_KIND_NAME, body, n, nullptr, 0, false, hits);
+            break;
+        default:
+            break;
+        }
+    }
+    return hits;
+}
+
+size_t bleFormat(const BleMatchTable &t, char *out, size_t cap) {
+    size_t used = 0;
+    if (cap) out[0] = '\0';
+    for (uint8_t i = 0; i < t.ruleCount; i++) {
+        const BleAdRule &r = t.rules[i];
+        char line[96];
+        int n = snprintf(line, sizeof(line), "%s %s ", t.labels[r.pattern], KIND_NAMES[r.kind]);
+        if (r.kind == BLE_KIND_NAME) {
+            n += snprintf(line + n, sizeof(line) - n, "%.*s", (int)r.keyLen, (const char *)r.key);
+        } else {
+            for (int k = r.keyLen - 1; k >= 0; k--) {
+                n += snprintf(line + n, sizeof(line) - n, "%02X", r.key[k]);
+                if (r.keyLen == 16 && (k == 12 || k == 10 || k == 8 || k == 6)) line[n++] = '-';
+            }
+            if (r.dataLen) {
+                line[n++] = ' ';
+                for (uint8_t k = 0; k < r.dataLen; k++) n += snprintf(line + n, sizeof(line) - n, "%02X", r.data[k]);
+                bool full = true;
+                for (uint8_t k = 0; k < r.dataLen; k++) full = full && r.mask[k] == 0xFF;
+                if (!full) {
+                    line[n++] = '/';
+                    for (uint8_t k = 0; k < r.dataLen; k++) n += snprintf(line + n, sizeof(line) - n, "%02X", r.mask[k]);
+                }
+            }
+        }
+        line[n++] = '\n';
+        if (used + n + 1 > cap) break;
+        memcpy(out + used, line, n);
+        used += n;
+        out[used] = '\0';
+    }
+    return used;
+}
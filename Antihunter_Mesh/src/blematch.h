@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// BLE advertisement payload matcher. Patterns look at the AD structures
+// rather than the advertiser address, so trackers that rotate random
+// addresses are still recognised. A text spec compiles into a fixed-size
+// decision table: AD type -> rule kind -> a short run of rules, each with
+// a key and an optional data prefix/mask. Matching walks the payload once
+// and never allocates, so it is safe inside the advert callback. Plain C++
+// so the same table can be benchmarked on the host against recorded
+// adverts (tools/blebench.cpp).
+//
+// Spec, one rule per line, "#" starts a comment:
+//   <label> mfg <company id> [<data prefix>[/<mask>]]
+//   <label> uuid16 <uuid> [<service data prefix>[/<mask>]]
+//   <label> uuid128 <uuid> [<service data prefix>[/<mask>]]
+//   <label> name <name prefix>
+// Ids and UUIDs are written as usually printed (big-endian), data bytes
+// in payload order. Rules sharing a label are OR-ed into one pattern.
+
+static const size_t BLE_MAX_PATTERNS = 32;
+static const size_t BLE_MAX_RULES = 48;
+static const size_t BLE_LABEL_MAX = 16;
+static const size_t BLE_KEY_MAX = 16;
+static const size_t BLE_DATA_MAX = 8;
+
+enum BleRuleKind : uint8_t {
+    BLE_KIND_NONE,
+    BLE_KIND_MFG,
+    BLE_KIND_UUID16,
+    BLE_KIND_UUID128,
+    BLE_KIND_NAME,
+    BLE_KIND_COUNT
+};
+
+struct BleAdRule {
+    uint8_t kind;
+    uint8_t pattern;     // bit index in the match result
+    uint8_t keyLen;
+    uint8_t dataLen;     // 0: key alone matches
+    uint8_t key[BLE_KEY_MAX];        // payload byte order
+    uint8_t data[BLE_DATA_MAX];      // pre-masked
+    uint8_t mask[BLE_DATA_MAX];
+};
+
+struct BleMatchTable {
+    uint8_t ruleCount;
+    uint8_t patternCount;
+    uint8_t kindStart[BLE_KIND_COUNT + 1];   // rules sorted by kind
+    BleAdRule rules[BLE_MAX_RULES];
+    char labels[BLE_MAX_PATTERNS][BLE_LABEL_MAX];
+};
+
+// Tracker families whose adverts carry a stable signature
+extern const char BLE_TRACKER_PRESETS[];
+
+// Replaces t with the compiled spec. Returns the number of rules kept;
+// lines that do not parse, or do not fit, are counted in *rejected.
+size_t bleCompile(BleMatchTable &t, const char *spec, size_t len, uint32_t *rejected);
+// Bit i set when pattern i matched; 0 for an empty table
+uint32_t bleMatch(const BleMatchTable &t, const uint8_t *adv, size_t len);
+// Writes the table back as spec text; returns the length (snprintf rules)
+size_t bleFormat(const BleMatchTable &t, char *out, size_t cap);
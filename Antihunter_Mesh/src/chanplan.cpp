@@ -0,0 +1,248 @@
+#include "chanplan.h"
+#include "meshlink.h"
+#include "meshproto.h"
+#include "network.h"
+#include <algorithm>
+
+static const uint32_t PRESENCE_INTERVAL = 20000;
+static const uint32_t PEER_TIMEOUT = 60000;
+static const size_t MAX_PEERS = 16;
+static const size_t MAX_CHANNELS = 14;
+
+static uint32_t nodeId = 0;
+static MeshPeer peers[MAX_PEERS];
+static size_t peerCount = 0;
+static uint16_t baseMask = 0;
+static bool planActive = false;
+static uint32_t lastPresence = 0;
+static SemaphoreHandle_t planLock = nullptr;
+
+// Read by the hop timer, guarded separately so it never waits on planLock
+static uint8_t assigned[MAX_CHANNELS];
+static size_t assignedCount = 0;
+static portMUX_TYPE assignedMux = portMUX_INITIALIZER_UNLOCKED;
+
+uint16_t channelMask(const uint8_t *chans, size_t count) {
+    uint16_t mask = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (chans[i] >= 1 && chans[i] <= MAX_CHANNELS) mask |= (uint16_t)(1u << (chans[i] - 1));
+    }
+    return mask;
+}
+
+// Channels of the mask are dealt round-robin by rank. With more members than
+// channels, each member gets one channel and the surplus doubles up.
+size_t partitionChannels(uint16_t mask, size_t rank, size_t members, uint8_t *out) {
+    uint8_t all[MAX_CHANNELS];
+    size_t n = 0;
+    for (uint8_t ch = 1; ch <= MAX_CHANNELS; ch++) {
+        if (mask & (1u << (ch - 1))) all[n++] = ch;
+    }
+    if (n == 0) return 0;
+    if (members <= 1) {
+        memcpy(out, all, n);
+        return n;
+    }
+    if (members >= n) {
+        out[0] = all[rank % n];
+        return 1;
+    }
+    size_t count = 0;
+    for (size_t i = rank; i < n; i += members) out[count++] = all[i];
+    return count;
+}
+
+static void publishAssignment(const uint8_t *chans, size_t count) {
+    portENTER_CRITICAL(&assignedMux);
+    memcpy(assigned, chans, count);
+    assignedCount = count;
+    portEXIT_CRITICAL(&assignedMux);
+}
+
+// Caller holds planLock
+static void recomputePlan() {
+    uint8_t chans[MAX_CHANNELS];
+    size_t count;
+
+    if (!planActive) {
+        publishAssignment(chans, 0);
+        return;
+    }
+
+    uint32_t members[MAX_PEERS + 1];
+    size_t memberCount = 0;
+    members[memberCount++] = nodeId;
+    for (size_t i = 0; i < peerCount; i++) {
+        if (peers[i].chanMask == baseMask) members[memberCount++] = peers[i].nodeId;
+    }
+    std::sort(members, members + memberCount);
+    size_t rank = std::find(members, members + memberCount, nodeId) - members;
+
+    count = partitionChannels(baseMask, rank, memberCount, chans);
+    publishAssignment(chans, count);
+
+    String list;
+    for (size_t i = 0; i < count; i++) list += String((int)chans[i]) + " ";
+    Serial.printf("[MESH] Channel plan: rank %u of %u -> %s\n",
+                  (unsigned)rank, (unsigned)memberCount, list.c_str());
+}
+
+// A zero mask says goodbye: peers drop this node at once instead of
+// waiting out PEER_TIMEOUT with channels nobody hops any more
+static void sendPresence(uint16_t mask) {
+    static uint16_t helloSeq = 0;
+
+    if (meshBinaryFormat) {
+        uint8_t frame[32];
+        MeshHeader hdr = {};
+        hdr.type = MESH_MSG_HELLO;
+        hdr.nodeId = nodeId;
+        hdr.seq = helloSeq++;
+        hdr.time = millis() / 1000;
+        MeshFrameWriter w;
+        w.begin(frame, sizeof(frame), hdr);
+        w.addHello(mask);
+        size_t len = w.finish();
+        if (meshLink().availableForWrite() >= (int)len) {
+            meshLink().write(frame, len);
+        }
+    } else {
+        char msg[40];
+        if (mask) {
+            snprintf(msg, sizeof(msg), "AH:HELLO %08lX %04X", (unsigned long)nodeId, (unsigned)mask);
+        } else {
+            snprintf(msg, sizeof(msg), "AH:BYE %08lX", (unsigned long)nodeId);
+        }
+        if (meshLink().availableForWrite() >= (int)strlen(msg) + 2) {
+            meshLink().println(msg);
+        }
+    }
+    lastPresence = millis();
+}
+
+void initChannelPlan() {
+    nodeId = (uint32_t)(ESP.getEfuseMac() >> 16);
+    planLock = xSemaphoreCreateMutex();
+    Serial.printf("[MESH] Node id %08lX\n", (unsigned long)nodeId);
+}
+
+void channelPlanBegin(const std::vector<uint8_t> &chans) {
+    xSemaphoreTake(planLock, portMAX_DELAY);
+    baseMask = channelMask(chans.data(), chans.size());
+    planActive = true;
+    recomputePlan();
+    sendPresence(baseMask);
+    xSemaphoreGive(planLock);
+}
+
+void channelPlanEnd() {
+    xSemaphoreTake(planLock, portMAX_DELAY);
+    bool wasActive = planActive;
+    planActive = false;
+    recomputePlan();
+    if (wasActive) sendPresence(0);
+    xSemaphoreGive(planLock);
+}
+
+void channelPlanTick() {
+    if (!planLock) return;
+    xSemaphoreTake(planLock, portMAX_DELAY);
+    uint32_t now = millis();
+
+    bool changed = false;
+    for (size_t i = 0; i < peerCount;) {
+        if (now - peers[i].lastHeard > PEER_TIMEOUT) {
+            Serial.printf("[MESH] Peer %08lX timed out\n", (unsigned long)peers[i].nodeId);
+            peers[i] = peers[--peerCount];
+            changed = true;
+        } else {
+            i++;
+        }
+    }
+    if (changed) recomputePlan();
+
+    if (planActive && now - lastPresence >= PRESENCE_INTERVAL) {
+        sendPresence(baseMask);
+    }
+    xSemaphoreGive(planLock);
+}
+
+bool channelPlanHandleLine(const char *line) {
+    // Meshtastic may prefix relayed text with the sender name, so search
+    unsigned long id = 0;
+    unsigned mask = 0;
+    if (const char *p = strstr(line, "AH:BYE ")) {
+        if (sscanf(p + 7, "%lx", &id) != 1) return false;
+        channelPlanHandleHello(id, 0);
+        return true;
+    }
+    const char *p = strstr(line, "AH:HELLO ");
+    if (!p) return false;
+    if (sscanf(p + 9, "%lx %x", &id, &mask) != 2) return false;
+    channelPlanHandleHello(id, mask);
+    return true;
+}
+
+void channelPlanHandleHello(uint32_t id, uint16_t mask) {
+    if (id == nodeId || !planLock) return;
+
+    xSemaphoreTake(planLock, portMAX_DELAY);
+    bool changed = false;
+    size_t i = 0;
+    while (i < peerCount && peers[i].nodeId != id) i++;
+
+    if (mask == 0) {
+        if (i < peerCount) {
+            Serial.printf("[MESH] Peer %08lX left\n", (unsigned long)id);
+            peers[i] = peers[--peerCount];
+            changed = true;
+        }
+    } else if (i == peerCount) {
+        if (peerCount < MAX_PEERS) {
+            peers[peerCount++] = {id, mask, (uint32_t)millis()};
+            Serial.printf("[MESH] Peer %08lX joined (mask %04X)\n", (unsigned long)id, (unsigned)mask);
+            changed = true;
+        }
+    } else {
+        changed = peers[i].chanMask != mask;
+        peers[i].chanMask = mask;
+        peers[i].lastHeard = millis();
+    }
+
+    if (changed) recomputePlan();
+    xSemaphoreGive(planLock);
+}
+
+size_t getAssignedChannels(uint8_t *out, size_t maxCount) {
+    portENTER_CRITICAL(&assignedMux);
+    size_t n = std::min(assignedCount, maxCount);
+    memcpy(out, assigned, n);
+    portEXIT_CRITICAL(&assignedMux);
+    return n;
+}
+
+uint32_t meshNodeId() {
+    return nodeId;
+}
+
+String getChannelPlanStatus() {
+    char id[9];
+    snprintf(id, sizeof(id), "%08lX", (unsigned long)nodeId);
+    String s = "Mesh node: " + String(id) + "\n";
+
+    if (planLock) xSemaphoreTake(planLock, portMAX_DELAY);
+    s += "Mesh peers: " + String((unsigned)peerCount) + "\n";
+    for (size_t i = 0; i < peerCount; i++) {
+        snprintf(id, sizeof(id), "%08lX", (unsigned long)peers[i].nodeId);
+        s += "  " + String(id) + " heard " + String((unsigned)((millis() - peers[i].lastHeard) / 1000)) + "s ago\n";
+    }
+    if (planLock) xSemaphoreGive(planLock);
+
+    uint8_t chans[MAX_CHANNELS];
+    size_t n = getAssignedChannels(chans, MAX_CHANNELS);
+    s += "Assigned channels: ";
+    if (n == 0) s += "(not partitioning)";
+    for (size_t i = 0; i < n; i++) s += String((int)chans[i]) + " ";
+    s += "\n";
+    return s;
+}
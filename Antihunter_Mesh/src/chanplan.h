@@ -0,0 +1,27 @@
+#pragma once
+#include <Arduino.h>
+#include <vector>
+
+// Mesh channel partitioning. While a list scan runs, each node announces
+// its node id and configured channel set over the mesh; nodes that share a
+// channel set split it between them so the group hops disjoint channels.
+// A node leaving the plan says goodbye (AH:BYE, or a binary hello with an
+// empty mask) so the rest re-split at once.
+struct MeshPeer {
+    uint32_t nodeId;
+    uint16_t chanMask;
+    uint32_t lastHeard;
+};
+
+uint16_t channelMask(const uint8_t *chans, size_t count);
+size_t partitionChannels(uint16_t mask, size_t rank, size_t members, uint8_t *out);
+
+void initChannelPlan();
+void channelPlanBegin(const std::vector<uint8_t> &chans);
+void channelPlanEnd();
+void channelPlanTick();
+bool channelPlanHandleLine(const char *line);
+void channelPlanHandleHello(uint32_t id, uint16_t mask);
+size_t getAssignedChannels(uint8_t *out, size_t maxCount);
+uint32_t meshNodeId();
+String getChannelPlanStatus();
@@ -0,0 +1,201 @@
+#include "deauthwatch.h"
+#include "esp_timer.h"
+
+extern String macFmt6(const uint8_t *m);
+
+static const uint8_t FLOW_FREE = 0;
+static const uint8_t FLOW_WATCH = 1;    // frames seen, below the episode rate
+static const uint8_t FLOW_EPISODE = 2;
+
+struct DeauthFlow {
+    DeauthEpisode ep;
+    uint16_t slots[DEAUTH_SLOTS];
+    uint32_t slotHead;   // absolute index of the newest bucket
+    uint32_t window;     // frames across the buckets
+    uint8_t state;
+    bool announced;      // start reported by deauthPoll
+};
+
+static DeauthFlow flows[DEAUTH_SETS][DEAUTH_WAYS];
+static portMUX_TYPE deauthMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t framesRecorded = 0, episodesOpened = 0, flowsEvicted = 0, flowsDropped = 0;
+
+static inline size_t IRAM_ATTR setFor(const uint8_t *src, const uint8_t *dest, const uint8_t *bssid) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < 6; i++) h = (h ^ src[i]) * 16777619u;
+    for (int i = 0; i < 6; i++) h = (h ^ dest[i]) * 16777619u;
+    for (int i = 0; i < 6; i++) h = (h ^ bssid[i]) * 16777619u;
+    return (h ^ (h >> 16)) & (DEAUTH_SETS - 1);
+}
+
+// Rolls the window forward to slot, emptying the buckets it passes.
+// deauthPoll reads the clock before taking the lock, so a frame can move
+// the head past slot in between; the window never rolls back.
+static inline void IRAM_ATTR advance(DeauthFlow &f, uint32_t slot) {
+    if ((int32_t)(slot - f.slotHead) <= 0) return;
+    uint32_t gap = slot - f.slotHead;
+    if (gap >= DEAUTH_SLOTS) {
+        memset(f.slots, 0, sizeof(f.slots));
+        f.window = 0;
+    } else {
+        for (uint32_t k = 1; k <= gap; k++) {
+            uint16_t &b = f.slots[(f.slotHead + k) % DEAUTH_SLOTS];
+            f.window -= b;
+            b = 0;
+        }
+    }
+    f.slotHead = slot;
+}
+
+static inline uint16_t windowRate(uint32_t window) {
+    uint32_t r = window * 1000 / (DEAUTH_SLOTS * DEAUTH_SLOT_MS);
+    return r > 0xFFFF ? 0xFFFF : (uint16_t)r;
+}
+
+void deauthReset() {
+    portENTER_CRITICAL(&deauthMux);
+    memset(flows, 0, sizeof(flows));
+    framesRecorded = episodesOpened = flowsEvicted = flowsDropped = 0;
+    portEXIT_CRITICAL(&deauthMux);
+}
+
+void IRAM_ATTR deauthRecord(const uint8_t src[6], const uint8_t dest[6], const uint8_t bssid[6], uint16_t reason,
+                            bool disassoc, int8_t rssi, uint8_t channel, uint32_t nowMs) {
+    int64_t nowUs = esp_timer_get_time();
+    uint32_t slot = nowMs / DEAUTH_SLOT_MS;
+    portENTER_CRITICAL(&deauthMux);
+    framesRecorded++;
+    DeauthFlow *set = flows[setFor(src, dest, bssid)];
+    DeauthFlow *f = nullptr;
+    for (size_t w = 0; w < DEAUTH_WAYS; w++) {
+        DeauthFlow &c = set[w];
+        if (c.state != FLOW_FREE && !memcmp(c.ep.srcMac, src, 6) && !memcmp(c.ep.destMac, dest, 6) &&
+            !memcmp(c.ep.bssid, bssid, 6)) {
+            f = &c;
+            break;
+        }
+    }
+    if (!f) {
+        // Free way, else the stalest flow below the episode rate
+        for (size_t w = 0; w < DEAUTH_WAYS; w++) {
+            DeauthFlow &c = set[w];
+            if (c.state == FLOW_FREE) {
+                f = &c;
+                break;
+            }
+            if (c.state == FLOW_WATCH && (!f || (int32_t)(c.ep.lastMs - f->ep.lastMs) < 0)) f = &c;
+        }
+        if (!f) {
+            flowsDropped++;
+            portEXIT_CRITICAL(&deauthMux);
+            return;
+        }
+        if (f->state != FLOW_FREE) flowsEvicted++;
+        memset(f, 0, sizeof(*f));
+        memcpy(f->ep.srcMac, src, 6);
+        memcpy(f->ep.destMac, dest, 6);
+        memcpy(f->ep.bssid, bssid, 6);
+        f->ep.broadcast = (dest[0] & dest[1] & dest[2] & dest[3] & dest[4] & dest[5]) == 0xFF;
+        f->ep.startMs = nowMs;
+        f->ep.tsUs = nowUs;
+        f->slotHead = slot;
+        f->state = FLOW_WATCH;
+    }
+
+    advance(*f, slot);
+    uint16_t &bucket = f->slots[slot % DEAUTH_SLOTS];
+    if (bucket < 0xFFFF) {
+        bucket++;
+        f->window++;
+    }
+    DeauthEpisode &ep = f->ep;
+    ep.frames++;
+    if (disassoc) ep.disassocFrames++;
+    ep.reasons |= reason < 31 ? 1u << reason : 1u << 31;
+    ep.rssi = rssi;
+    ep.channel = channel;
+    ep.lastMs = nowMs;
+    uint16_t rate = windowRate(f->window);
+    if (rate > ep.peakRate) ep.peakRate = rate;
+    if (f->state == FLOW_WATCH && f->window >= DEAUTH_EPISODE_FRAMES) {
+        f->state = FLOW_EPISODE;
+        episodesOpened++;
+    }
+    portEXIT_CRITICAL(&deauthMux);
+}
+
+size_t deauthPoll(uint32_t nowMs, DeauthEpisode *out, size_t maxCount) {
+    size_t n = 0;
+    uint32_t slot = nowMs / DEAUTH_SLOT_MS;
+    portENTER_CRITICAL(&deauthMux);
+    for (size_t s = 0; s < DEAUTH_SETS; s++) {
+        for (size_t w = 0; w < DEAUTH_WAYS; w++) {
+            DeauthFlow &f = flows[s][w];
+            if (f.state == FLOW_FREE) continue;
+            advance(f, slot);
+            if (f.state == FLOW_EPISODE && !f.announced) {
+                if (n == maxCount) continue;
+                out[n] = f.ep;
+                out[n++].active = true;
+                f.announced = true;
+            }
+            if ((int32_t)(nowMs - f.ep.lastMs) <= (int32_t)DEAUTH_EPISODE_IDLE_MS) continue;
+            if (f.state == FLOW_EPISODE) {
+                // Kept until there is room to report the end
+                if (n == maxCount) continue;
+                out[n] = f.ep;
+                out[n++].active = false;
+            }
+            f.state = FLOW_FREE;
+        }
+    }
+    portEXIT_CRITICAL(&deauthMux);
+    return n;
+}
+
+size_t getDeauthEpisodes(DeauthEpisode *out, size_t maxCount) {
+    size_t n = 0;
+    portENTER_CRITICAL(&deauthMux);
+    for (size_t s = 0; s < DEAUTH_SETS; s++) {
+        for (size_t w = 0; w < DEAUTH_WAYS && n < maxCount; w++) {
+            if (flows[s][w].state != FLOW_EPISODE) continue;
+            out[n] = flows[s][w].ep;
+            out[n++].active = true;
+        }
+    }
+    portEXIT_CRITICAL(&deauthMux);
+    return n;
+}
+
+String deauthReasons(uint32_t mask) {
+    String s;
+    for (int i = 0; i < 32; i++) {
+        if (!(mask & (1u << i))) continue;
+        if (s.length()) s += ",";
+        s += i == 31 ? String(">=31") : String(i);
+    }
+    return s.length() ? s : String("-");
+}
+
+String deauthEpisodeLine(const DeauthEpisode &e) {
+    const char *kind = !e.disassocFrames ? "DEAUTH" : e.disassocFrames == e.frames ? "DISASSOC" : "DEAUTH+DISASSOC";
+    return String(kind) + (e.broadcast ? " BROADCAST " : " TARGETED ") + macFmt6(e.srcMac) + " -> " +
+           macFmt6(e.destMac) + " BSSID:" + macFmt6(e.bssid) + " frames=" + String(e.frames) + " peak=" +
+           String(e.peakRate) + "/s dur=" + String((e.lastMs - e.startMs) / 1000) + "s reasons=" +
+           deauthReasons(e.reasons) + " RSSI:" + String(e.rssi) + "dBm CH:" + String(e.channel);
+}
+
+String getDeauthStatus() {
+    size_t tracked = 0, open = 0;
+    portENTER_CRITICAL(&deauthMux);
+    for (size_t s = 0; s < DEAUTH_SETS; s++) {
+        for (size_t w = 0; w < DEAUTH_WAYS; w++) {
+            if (flows[s][w].state != FLOW_FREE) tracked++;
+            if (flows[s][w].state == FLOW_EPISODE) open++;
+        }
+    }
+    portEXIT_CRITICAL(&deauthMux);
+    return "Deauth: " + String((unsigned)tracked) + " flows, " + String((unsigned)open) + " episodes open, " +
+           String(episodesOpened) + " total, " + String(framesRecorded) + " frames, " + String(flowsEvicted) +
+           " evicted, " + String(flowsDropped) + " dropped\n";
+}
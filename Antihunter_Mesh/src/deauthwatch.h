@@ -0,0 +1,50 @@
+#pragma once
+#include <Arduino.h>
+
+// Deauth/disassoc attack episodes. A flood sends thousands of frames a
+// second, so the RX callback only folds each frame into a per-flow record
+// keyed by (source, BSSID, target) with a sliding window of frame counts.
+// A flow whose window crosses DEAUTH_EPISODE_FRAMES opens an episode; the
+// consumer polls for new and finished episodes and reports each once when
+// it starts and once when it has been quiet for DEAUTH_EPISODE_IDLE_MS.
+// The table is bounded and set-associative; when a set is full of open
+// episodes further new flows are counted as dropped rather than evicting
+// an attack in progress.
+
+static const size_t DEAUTH_SETS = 16;
+static const size_t DEAUTH_WAYS = 4;
+static const size_t DEAUTH_SLOTS = 8;           // sliding window buckets
+static const uint32_t DEAUTH_SLOT_MS = 250;     // window = 2 s
+static const uint32_t DEAUTH_EPISODE_FRAMES = 8; // in one window, i.e. 4/s
+static const uint32_t DEAUTH_EPISODE_IDLE_MS = 5000;
+
+struct DeauthEpisode {
+    uint8_t srcMac[6];
+    uint8_t destMac[6];
+    uint8_t bssid[6];
+    int8_t rssi;           // latest
+    uint8_t channel;
+    bool broadcast;        // sent to ff:ff:ff:ff:ff:ff rather than one client
+    bool active;           // false once the episode has ended
+    uint32_t frames;
+    uint32_t disassocFrames;
+    uint32_t reasons;      // bit per reason code, bit 31 for codes >= 31
+    uint16_t peakRate;     // frames/s over the window
+    uint32_t startMs;      // millis
+    uint32_t lastMs;
+    int64_t tsUs;          // esp_timer time at start, see timesync.h
+};
+
+void deauthReset();
+// Folds one frame in. RX-callback safe, constant time.
+void deauthRecord(const uint8_t src[6], const uint8_t dest[6], const uint8_t bssid[6], uint16_t reason,
+                  bool disassoc, int8_t rssi, uint8_t channel, uint32_t nowMs);
+// Episodes that opened (active set) or ended since the last poll
+size_t deauthPoll(uint32_t nowMs, DeauthEpisode *out, size_t maxCount);
+// Open episodes, for reports
+size_t getDeauthEpisodes(DeauthEpisode *out, size_t maxCount);
+// "7,3" style list of the reason codes in a mask
+String deauthReasons(uint32_t mask);
+// "DEAUTH BROADCAST src -> dest BSSID:.. frames=.. peak=../s ..."
+String deauthEpisodeLine(const DeauthEpisode &e);
+String getDeauthStatus();
@@ -0,0 +1,397 @@
+#include "devhistory.h"
+#include "hardware.h"
+#include "timesync.h"
+#include <SD.h>
+#include <algorithm>
+#include <vector>
+
+extern String macFmt6(const uint8_t *m);
+
+static const char *HISTORY_PATH = "/history.db";
+static const char *HISTORY_TMP = "/history.tmp";
+static const char *HISTORY_BAK = "/history.bak";
+static const uint32_t HISTORY_MAGIC = 0x31534948; // "HIS1"
+static const uint32_t HISTORY_MIN_SLOTS = 2048;
+// 1.5 MB on the card; past this new devices are dropped, not inserted
+static const uint32_t HISTORY_MAX_SLOTS = 65536;
+// An insert never takes the table past 7/10 full, which keeps probes
+// short. Between scans it grows early, from 6/10, so a scan seldom has
+// to grow it on the hit path.
+static const uint32_t HISTORY_LOAD_NUM = 7;
+static const uint32_t HISTORY_EARLY_NUM = 6;
+static const uint32_t HISTORY_LOAD_DEN = 10;
+static const size_t HISTORY_CACHE = 64;
+static const size_t PROBE_BATCH = 8;
+static const uint32_t HISTORY_FLUSH_MS = 30000;
+
+static const uint8_t HIST_USED = 0x01;
+static const uint8_t HIST_BLE = 0x02;
+static const uint8_t HIST_WIFI = 0x04;
+
+struct HistoryHeader {
+    uint32_t magic;
+    uint32_t slots;
+    uint32_t used;
+    uint32_t session;
+};
+
+static_assert(sizeof(DeviceHistory) == 24, "DeviceHistory is an on-card format");
+
+struct CacheLine {
+    DeviceHistory rec;
+    uint32_t slot;
+    bool valid;
+    bool dirty;
+};
+
+static HistoryHeader header = {};
+static bool headerDirty = false;
+static File dbFile;
+static CacheLine cache[HISTORY_CACHE];
+static uint32_t lastFlush = 0;
+static uint32_t cacheHits = 0, cacheMisses = 0;
+static uint32_t droppedInserts = 0;
+// Set when a grow fails, so inserts stop retrying it until the next session
+static bool growBlocked = false;
+static SemaphoreHandle_t historyLock = nullptr;
+static bool historyReady = false;
+
+static uint32_t macHash(const uint8_t mac[6]) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < 6; i++) h = (h ^ mac[i]) * 16777619u;
+    return h ^ (h >> 15);
+}
+
+static uint32_t slotOffset(uint32_t slot) {
+    return sizeof(HistoryHeader) + slot * sizeof(DeviceHistory);
+}
+
+static bool writeSlot(File &f, uint32_t slot, const DeviceHistory &rec) {
+    return f.seek(slotOffset(slot)) && f.write((const uint8_t *)&rec, sizeof(rec)) == sizeof(rec);
+}
+
+static void writeHeader(File &f, const HistoryHeader &h) {
+    f.seek(0);
+    f.write((const uint8_t *)&h, sizeof(h));
+}
+
+// Linear probe in batches of PROBE_BATCH slots, which usually share a
+// sector. Returns the matching slot, or the first free one with found=false.
+static bool probe(File &f, uint32_t slots, const uint8_t mac[6], DeviceHistory &rec, uint32_t &slot, bool &found) {
+    DeviceHistory buf[PROBE_BATCH];
+    uint32_t s = macHash(mac) & (slots - 1);
+    uint32_t seen = 0;
+    while (seen < slots) {
+        uint32_t n = std::min<uint32_t>(PROBE_BATCH, slots - s);
+        if (!f.seek(slotOffset(s)) || f.read((uint8_t *)buf, n * sizeof(DeviceHistory)) != n * sizeof(DeviceHistory))
+            return false;
+        for (uint32_t i = 0; i < n; i++) {
+            if (!(buf[i].flags & HIST_USED)) {
+                slot = s + i;
+                found = false;
+                memset(&rec, 0, sizeof(rec));
+                return true;
+            }
+            if (memcmp(buf[i].mac, mac, 6) == 0) {
+                slot = s + i;
+                found = true;
+                rec = buf[i];
+                return true;
+            }
+        }
+        seen += n;
+        s = (s + n) & (slots - 1);
+    }
+    return false;
+}
+
+static bool createTable(const char *path, uint32_t slots, uint32_t session) {
+    File f = SD.open(path, FILE_WRITE);
+    if (!f) return false;
+    HistoryHeader h = {HISTORY_MAGIC, slots, 0, session};
+    f.write((const uint8_t *)&h, sizeof(h));
+    uint8_t zero[512] = {};
+    size_t left = (size_t)slots * sizeof(DeviceHistory);
+    while (left) {
+        size_t n = std::min(left, sizeof(zero));
+        if (f.write(zero, n) != n) {
+            f.close();
+            return false;
+        }
+        left -= n;
+    }
+    f.close();
+    return true;
+}
+
+static bool openTable() {
+    dbFile = SD.open(HISTORY_PATH, "r+");
+    if (!dbFile) return false;
+    if (dbFile.read((uint8_t *)&header, sizeof(header)) != sizeof(header) || header.magic != HISTORY_MAGIC ||
+        header.slots < HISTORY_MIN_SLOTS || (header.slots & (header.slots - 1)) ||
+        dbFile.size() < slotOffset(header.slots)) {
+        dbFile.close();
+        return false;
+    }
+    return true;
+}
+
+// Caller holds historyLock
+static void writeBack(CacheLine &c) {
+    if (c.valid && c.dirty && writeSlot(dbFile, c.slot, c.rec)) c.dirty = false;
+}
+
+static void flushLocked() {
+    for (size_t i = 0; i < HISTORY_CACHE; i++) writeBack(cache[i]);
+    if (headerDirty) {
+        writeHeader(dbFile, header);
+        headerDirty = false;
+    }
+    dbFile.flush();
+    lastFlush = millis();
+}
+
+// Rehashes into a table twice the size, one pass over the card. Returns
+// false when the table kept its old size.
+static bool growLocked() {
+    flushLocked();
+    uint32_t slots = header.slots * 2;
+    Serial.printf("[HIST] Growing table to %u slots\n", (unsigned)slots);
+    if (!createTable(HISTORY_TMP, slots, header.session)) return false;
+    File next = SD.open(HISTORY_TMP, "r+");
+    if (!next) return false;
+
+    uint32_t used = 0;
+    DeviceHistory buf[PROBE_BATCH];
+    for (uint32_t s = 0; s < header.slots; s += PROBE_BATCH) {
+        dbFile.seek(slotOffset(s));
+        dbFile.read((uint8_t *)buf, sizeof(buf));
+        for (size_t i = 0; i < PROBE_BATCH; i++) {
+            if (!(buf[i].flags & HIST_USED)) continue;
+            DeviceHistory tmp;
+            uint32_t slot;
+            bool found;
+            if (probe(next, slots, buf[i].mac, tmp, slot, found) && !found) {
+                writeSlot(next, slot, buf[i]);
+                used++;
+            }
+        }
+    }
+    HistoryHeader h = {HISTORY_MAGIC, slots, used, header.session};
+    writeHeader(next, h);
+    next.close();
+    dbFile.close();
+
+    // The old table stays on the card until the new one has its name, so
+    // a reset at any point leaves one complete table for initDeviceHistory
+    SD.remove(HISTORY_BAK);
+    if (!SD.rename(HISTORY_PATH, HISTORY_BAK)) {
+        SD.remove(HISTORY_TMP);
+    } else if (!SD.rename(HISTORY_TMP, HISTORY_PATH)) {
+        SD.rename(HISTORY_BAK, HISTORY_PATH);
+        SD.remove(HISTORY_TMP);
+    } else {
+        SD.remove(HISTORY_BAK);
+    }
+    memset(cache, 0, sizeof(cache));
+    if (!openTable()) {
+        historyReady = false;
+        Serial.println("[HIST] Reopen after grow failed");
+        return false;
+    }
+    return header.slots == slots;
+}
+
+static bool pastLoad(uint32_t used, uint32_t num) {
+    return used * HISTORY_LOAD_DEN > header.slots * num;
+}
+
+void initDeviceHistory() {
+    if (!historyLock) historyLock = xSemaphoreCreateMutex();
+    if (!sdAvailable) return;
+    // A grow interrupted after the old table was set aside
+    if (!SD.exists(HISTORY_PATH) && SD.exists(HISTORY_BAK)) {
+        Serial.println("[HIST] Restoring table from backup");
+        SD.rename(HISTORY_BAK, HISTORY_PATH);
+    }
+    SD.remove(HISTORY_TMP);
+    SD.remove(HISTORY_BAK);
+    if (!openTable()) {
+        Serial.println("[HIST] Creating device history table");
+        SD.remove(HISTORY_PATH);
+        if (!createTable(HISTORY_PATH, HISTORY_MIN_SLOTS, 0) || !openTable()) {
+            Serial.println("[HIST] Could not create history table");
+            return;
+        }
+    }
+    historyReady = true;
+    Serial.printf("[HIST] %u known devices, %u sessions\n", (unsigned)header.used, (unsigned)header.session);
+}
+
+void historyBeginSession() {
+    if (!historyReady) return;
+    if (xSemaphoreTake(historyLock, pdMS_TO_TICKS(1000)) != pdTRUE) return;
+    growBlocked = false;
+    if (header.slots < HISTORY_MAX_SLOTS && pastLoad(header.used, HISTORY_EARLY_NUM)) growLocked();
+    if (historyReady) {
+        header.session++;
+        headerDirty = true;
+        flushLocked();
+    }
+    xSemaphoreGive(historyLock);
+}
+
+// Caller holds historyLock. Direct-mapped: a MAC can only live in one
+// cache line, so a hit is a single compare.
+static CacheLine *cacheFetch(const uint8_t mac[6], bool create) {
+    CacheLine &c = cache[macHash(mac) % HISTORY_CACHE];
+    if (c.valid && memcmp(c.rec.mac, mac, 6) == 0) {
+        cacheHits++;
+        return &c;
+    }
+    cacheMisses++;
+
+    DeviceHistory rec;
+    uint32_t slot;
+    bool found;
+    if (!probe(dbFile, header.slots, mac, rec, slot, found)) return nullptr;
+    if (!found) {
+        if (!create) return nullptr;
+        if (pastLoad(header.used + 1, HISTORY_LOAD_NUM)) {
+            if (header.slots >= HISTORY_MAX_SLOTS || growBlocked || !growLocked()) {
+                growBlocked = historyReady;
+                if (droppedInserts++ == 0) Serial.println("[HIST] Table full, new devices are not recorded");
+                return nullptr;
+            }
+            // The grow rehashed every slot and cleared the cache
+            if (!probe(dbFile, header.slots, mac, rec, slot, found)) return nullptr;
+        }
+        // Reserve the slot now so a later probe for another MAC skips it
+        memcpy(rec.mac, mac, 6);
+        rec.flags = HIST_USED;
+        rec.bestRssi = -128;
+        if (!writeSlot(dbFile, slot, rec)) return nullptr;
+        header.used++;
+        headerDirty = true;
+    }
+    writeBack(c);
+    c.rec = rec;
+    c.slot = slot;
+    c.valid = true;
+    c.dirty = false;
+    return &c;
+}
+
+bool historyRecord(const Hit &h, DeviceHistory &out) {
+    if (!historyReady) return false;
+    if (xSemaphoreTake(historyLock, pdMS_TO_TICKS(50)) != pdTRUE) return false;
+
+    CacheLine *c = cacheFetch(h.mac, true);
+    if (c) {
+        DeviceHistory &r = c->rec;
+        UtcStamp t = utcAt(h.tsUs);
+        if (t.valid) {
+            if (!r.firstSeen) r.firstSeen = t.sec;
+            if (t.sec > r.lastSeen) r.lastSeen = t.sec;
+        }
+        r.sightings++;
+        if (h.rssi > r.bestRssi) r.bestRssi = h.rssi;
+        r.flags |= h.isBLE ? HIST_BLE : HIST_WIFI;
+        if (r.lastSession != (uint16_t)header.session) {
+            r.lastSession = (uint16_t)header.session;
+            r.sessions++;
+        }
+        c->dirty = true;
+        out = r;
+    }
+    if (millis() - lastFlush > HISTORY_FLUSH_MS) flushLocked();
+    xSemaphoreGive(historyLock);
+    return c != nullptr;
+}
+
+bool historyLookup(const uint8_t mac[6], DeviceHistory &out) {
+    if (!historyReady) return false;
+    if (xSemaphoreTake(historyLock, pdMS_TO_TICKS(200)) != pdTRUE) return false;
+    CacheLine *c = cacheFetch(mac, false);
+    if (c) out = c->rec;
+    xSemaphoreGive(historyLock);
+    return c != nullptr;
+}
+
+void historyFlush() {
+    if (!historyReady) return;
+    if (xSemaphoreTake(historyLock, pdMS_TO_TICKS(1000)) != pdTRUE) return;
+    flushLocked();
+    xSemaphoreGive(historyLock);
+}
+
+static String formatSeen(uint32_t t) {
+    if (!t) return "unknown";
+    UtcStamp s = {true, t, 0, 0};
+    String f = formatUtc(s);
+    int cut = f.indexOf('.');
+    return cut > 0 ? f.substring(0, cut) + "Z" : f;
+}
+
+static String formatEntry(const DeviceHistory &r) {
+    String s = macFmt6(r.mac);
+    s += String(" ") + ((r.flags & HIST_BLE) && (r.flags & HIST_WIFI) ? "WiFi+BLE" : (r.flags & HIST_BLE) ? "BLE" : "WiFi");
+    s += " sessions=" + String(r.sessions);
+    s += " sightings=" + String(r.sightings);
+    s += " best=" + String((int)r.bestRssi) + "dBm";
+    s += " first=" + formatSeen(r.firstSeen);
+    s += " last=" + formatSeen(r.lastSeen) + "\n";
+    return s;
+}
+
+String getDeviceHistory(const uint8_t mac[6]) {
+    DeviceHistory r;
+    if (!historyReady) return "Device history unavailable (no SD card)\n";
+    if (!historyLookup(mac, r)) return macFmt6(mac) + " never seen\n";
+    return formatEntry(r);
+}
+
+// One sequential pass over the table, keeping the most-recurring entries
+String getRecurringDevices(uint16_t minSessions, size_t limit) {
+    if (!historyReady) return "Device history unavailable (no SD card)\n";
+    if (limit < 1) limit = 1;
+    if (limit > 100) limit = 100;
+    std::vector<DeviceHistory> top;
+    top.reserve(limit + 1);
+    auto bySessions = [](const DeviceHistory &a, const DeviceHistory &b) {
+        return a.sessions != b.sessions ? a.sessions > b.sessions : a.sightings > b.sightings;
+    };
+
+    if (xSemaphoreTake(historyLock, pdMS_TO_TICKS(2000)) != pdTRUE) return "Device history busy\n";
+    flushLocked();
+    DeviceHistory buf[PROBE_BATCH];
+    for (uint32_t s = 0; s < header.slots; s += PROBE_BATCH) {
+        dbFile.seek(slotOffset(s));
+        if (dbFile.read((uint8_t *)buf, sizeof(buf)) != sizeof(buf)) break;
+        for (size_t i = 0; i < PROBE_BATCH; i++) {
+            if (!(buf[i].flags & HIST_USED) || buf[i].sessions < minSessions) continue;
+            top.push_back(buf[i]);
+            std::push_heap(top.begin(), top.end(), bySessions);
+            if (top.size() > limit) {
+                std::pop_heap(top.begin(), top.end(), bySessions);
+                top.pop_back();
+            }
+        }
+    }
+    uint32_t known = header.used, session = header.session;
+    xSemaphoreGive(historyLock);
+
+    std::sort(top.begin(), top.end(), bySessions);
+    String s = "Devices seen in " + String(minSessions) + "+ sessions (" + String(known) + " known, " +
+               String(session) + " sessions):\n";
+    for (const auto &r : top) s += formatEntry(r);
+    if (top.empty()) s += "none\n";
+    return s;
+}
+
+String getHistoryStatus() {
+    if (!historyReady) return "History: unavailable\n";
+    return "History: " + String(header.used) + " devices in " + String(header.slots) + " slots, session " +
+           String(header.session) + ", cache " + String(cacheHits) + "/" + String(cacheHits + cacheMisses) + " hits" +
+           (droppedInserts ? ", " + String(droppedInserts) + " inserts dropped (table full)" : String("")) + "\n";
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <Arduino.h>
+#include "scanner.h"
+
+// Persistent per-device history across scans and reboots. /history.db is
+// an open-addressed hash table of fixed-size records keyed by MAC, so a
+// lookup reads one or two sectors no matter how many devices are known.
+// Hot entries stay in a small RAM cache and are written back in batches.
+// The table doubles before an insert would take it past 70% load, up to
+// a fixed cap; at the cap new devices are counted as dropped.
+
+struct DeviceHistory {
+    uint8_t mac[6];
+    uint8_t flags;
+    int8_t bestRssi;
+    uint32_t firstSeen;     // Unix seconds, 0 if never seen with UTC
+    uint32_t lastSeen;
+    uint32_t sightings;
+    uint16_t sessions;      // distinct scans the device appeared in
+    uint16_t lastSession;
+};
+
+void initDeviceHistory();
+// Starts a new scan session; sightings after this count towards it
+void historyBeginSession();
+// Records a hit and returns the updated entry
+bool historyRecord(const Hit &h, DeviceHistory &out);
+bool historyLookup(const uint8_t mac[6], DeviceHistory &out);
+void historyFlush();
+String getDeviceHistory(const uint8_t mac[6]);
+String getRecurringDevices(uint16_t minSessions, size_t limit);
+String getHistoryStatus();
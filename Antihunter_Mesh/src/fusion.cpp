@@ -0,0 +1,176 @@
+#include "fusion.h"
+#include <string.h>
+
+FusionTable::FusionTable() {
+    window = FUSION_WINDOW_S;
+    clear();
+}
+
+void FusionTable::clear() {
+    memset(rows, 0, sizeof(rows));
+    for (size_t i = 0; i < BUCKETS; i++) head[i] = NIL;
+    for (size_t i = 0; i < FUSION_CAPACITY; i++) next[i] = (int16_t)(i + 1 < FUSION_CAPACITY ? i + 1 : NIL);
+    freeList = 0;
+    used = 0;
+    memset(nodes, 0, sizeof(nodes));
+    nodeTotal = 0;
+    mergedTotal = 0;
+    evictedTotal = 0;
+}
+
+size_t FusionTable::bucketOf(const uint8_t mac[6]) {
+    // The NIC-specific half varies most; the OUI is often shared
+    uint32_t h = 2166136261u;
+    for (int i = 5; i >= 0; i--) h = (h ^ mac[i]) * 16777619u;
+    return h % BUCKETS;
+}
+
+int16_t FusionTable::lookup(const uint8_t mac[6]) const {
+    for (int16_t i = head[bucketOf(mac)]; i != NIL; i = next[i]) {
+        if (memcmp(rows[i].mac, mac, 6) == 0) return i;
+    }
+    return NIL;
+}
+
+void FusionTable::release(int16_t idx) {
+    int16_t *link = &head[bucketOf(rows[idx].mac)];
+    while (*link != NIL && *link != idx) link = &next[*link];
+    if (*link == idx) *link = next[idx];
+
+    rows[idx].used = false;
+    next[idx] = freeList;
+    freeList = idx;
+    used--;
+}
+
+int16_t FusionTable::allocate(const uint8_t mac[6], uint32_t now) {
+    if (freeList == NIL) {
+        // Full: drop the row that has been quiet the longest
+        int16_t oldest = 0;
+        for (size_t i = 1; i < FUSION_CAPACITY; i++) {
+            if (now - rows[i].lastSeen > now - rows[oldest].lastSeen) oldest = (int16_t)i;
+        }
+        release(oldest);
+        evictedTotal++;
+    }
+
+    int16_t idx = freeList;
+    freeList = next[idx];
+    memset(&rows[idx], 0, sizeof(FusionEntry));
+    memcpy(rows[idx].mac, mac, 6);
+    rows[idx].used = true;
+    rows[idx].firstSeen = now;
+
+    size_t b = bucketOf(mac);
+    next[idx] = head[b];
+    head[b] = idx;
+    used++;
+    return idx;
+}
+
+int FusionTable::nodeIndex(uint32_t nodeId, uint32_t now) {
+    for (size_t i = 0; i < nodeTotal; i++) {
+        if (nodes[i].nodeId == nodeId) return (int)i;
+    }
+    if (nodeTotal >= FUSION_MAX_NODES) return -1;
+    FusionNode &n = nodes[nodeTotal];
+    memset(&n, 0, sizeof(n));
+    n.nodeId = nodeId;
+    n.lastHeard = now;
+    return (int)nodeTotal++;
+}
+
+int FusionTable::noteNode(uint32_t nodeId, uint32_t now, bool hasFix, int32_t latE7, int32_t lonE7) {
+    int idx = nodeIndex(nodeId, now);
+    if (idx < 0) return -1;
+    FusionNode &n = nodes[idx];
+    n.lastHeard = now;
+    n.frames++;
+    if (hasFix) {
+        n.hasFix = true;
+        n.latE7 = latE7;
+        n.lonE7 = lonE7;
+    }
+    return idx;
+}
+
+bool FusionTable::ingest(uint32_t nodeId, uint32_t seenAt, const uint8_t mac[6], int8_t rssi,
+                         uint16_t count, bool isBLE, uint8_t ch, const char *name) {
+    int nidx = nodeIndex(nodeId, seenAt);
+    if (nidx < 0) return false;
+
+    int16_t idx = lookup(mac);
+    if (idx != NIL && (int32_t)(seenAt - rows[idx].lastSeen) > (int32_t)window) {
+        // Same MAC after a quiet window is a new encounter
+        release(idx);
+        idx = NIL;
+    }
+    if (idx == NIL) {
+        idx = allocate(mac, seenAt);
+    } else {
+        mergedTotal++;
+    }
+
+    FusionEntry &e = rows[idx];
+    if ((int32_t)(seenAt - e.lastSeen) > 0 || e.total == 0) e.lastSeen = seenAt;
+    if ((int32_t)(e.firstSeen - seenAt) > 0) e.firstSeen = seenAt;
+    e.total += count ? count : 1;
+    e.isBLE = isBLE;
+    if (ch) e.ch = ch;
+    if (name && name[0]) {
+        strncpy(e.name, name, sizeof(e.name) - 1);
+        e.name[sizeof(e.name) - 1] = 0;
+    }
+
+    FusionReport *r = nullptr;
+    for (uint8_t i = 0; i < e.reports; i++) {
+        if (e.slot[i].node == nidx) {
+            r = &e.slot[i];
+            break;
+        }
+    }
+    if (!r) {
+        if (e.reports < FUSION_SLOTS) {
+            r = &e.slot[e.reports++];
+        } else {
+            r = &e.slot[0];
+            for (uint8_t i = 1; i < FUSION_SLOTS; i++) {
+                if ((int32_t)(r->lastSeen - e.slot[i].lastSeen) > 0) r = &e.slot[i];
+            }
+        }
+        memset(r, 0, sizeof(*r));
+        r->node = (uint8_t)nidx;
+        r->rssiMax = -128;
+    }
+
+    if ((int32_t)(seenAt - r->lastSeen) >= 0 || r->count == 0) {
+        r->rssi = rssi;
+        r->lastSeen = seenAt;
+    }
+    if (rssi > r->rssiMax) r->rssiMax = rssi;
+    uint32_t c = (uint32_t)r->count + (count ? count : 1);
+    r->count = c > 0xFFFF ? 0xFFFF : (uint16_t)c;
+    return true;
+}
+
+void FusionTable::expire(uint32_t now) {
+    for (size_t i = 0; i < FUSION_CAPACITY; i++) {
+        FusionEntry &e = rows[i];
+        if (!e.used) continue;
+        if ((int32_t)(now - e.lastSeen) > (int32_t)window) {
+            release((int16_t)i);
+            continue;
+        }
+
+        uint8_t keep = 0;
+        for (uint8_t s = 0; s < e.reports; s++) {
+            if ((int32_t)(now - e.slot[s].lastSeen) <= (int32_t)window) e.slot[keep++] = e.slot[s];
+        }
+        e.reports = keep;
+    }
+}
+
+const FusionEntry *FusionTable::find(const uint8_t mac[6]) const {
+    int16_t idx = lookup(mac);
+    return idx == NIL ? nullptr : &rows[idx];
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Multi-node sighting fusion. Sightings of the same MAC from any number of
+// nodes collapse into one row that keeps the latest RSSI, count and time
+// per reporting node. A row lives until no node has reported it for the
+// fusion window. Plain C++ so the gateway and the host decoder share it.
+// Times are seconds on the caller's clock.
+
+static const size_t FUSION_CAPACITY = 256;
+static const size_t FUSION_SLOTS = 6;        // reporting nodes kept per row
+static const size_t FUSION_MAX_NODES = 32;
+static const uint32_t FUSION_WINDOW_S = 120;
+
+struct FusionNode {
+    uint32_t nodeId;
+    uint32_t lastHeard;
+    int32_t latE7;
+    int32_t lonE7;
+    bool hasFix;
+    uint32_t frames;
+};
+
+struct FusionReport {
+    uint8_t node;        // index into the node table
+    int8_t rssi;
+    int8_t rssiMax;
+    uint16_t count;
+    uint32_t lastSeen;
+};
+
+struct FusionEntry {
+    uint8_t mac[6];
+    bool used;
+    bool isBLE;
+    uint8_t ch;
+    uint8_t reports;
+    char name[16];
+    uint32_t firstSeen;
+    uint32_t lastSeen;
+    uint32_t total;
+    FusionReport slot[FUSION_SLOTS];
+};
+
+class FusionTable {
+public:
+    FusionTable();
+    void clear();
+    void setWindow(uint32_t secs) { window = secs; }
+
+    // Records a frame from nodeId, with its position when known. Returns
+    // the node index, or -1 when the node table is full.
+    int noteNode(uint32_t nodeId, uint32_t now, bool hasFix, int32_t latE7, int32_t lonE7);
+    bool ingest(uint32_t nodeId, uint32_t seenAt, const uint8_t mac[6], int8_t rssi,
+                uint16_t count, bool isBLE, uint8_t ch, const char *name);
+    void expire(uint32_t now);
+
+    const FusionEntry *find(const uint8_t mac[6]) const;
+    const FusionEntry &entry(size_t i) const { return rows[i]; }
+    const FusionNode &node(uint8_t i) const { return nodes[i]; }
+    size_t capacity() const { return FUSION_CAPACITY; }
+    size_t size() const { return used; }
+    size_t nodeCount() const { return nodeTotal; }
+    uint32_t merged() const { return mergedTotal; }
+    uint32_t evicted() const { return evictedTotal; }
+
+private:
+    static const size_t BUCKETS = 64;
+    static const int16_t NIL = -1;
+
+    static size_t bucketOf(const uint8_t mac[6]);
+    int16_t lookup(const uint8_t mac[6]) const;
+    int16_t allocate(const uint8_t mac[6], uint32_t now);
+    void release(int16_t idx);
+    int nodeIndex(uint32_t nodeId, uint32_t now);
+
+    FusionEntry rows[FUSION_CAPACITY];
+    int16_t head[BUCKETS];
+    int16_t next[FUSION_CAPACITY];
+    int16_t freeList;
+    size_t used;
+    FusionNode nodes[FUSION_MAX_NODES];
+    size_t nodeTotal;
+    uint32_t window;
+    uint32_t mergedTotal;
+    uint32_t evictedTotal;
+};
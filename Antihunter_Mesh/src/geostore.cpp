@@ -0,0 +1,486 @@
+#include "geostore.h"
+#include "timesync.h"
+#include <SD.h>
+#include <math.h>
+#include <algorithm>
+#include <strings.h>
+
+extern String macFmt6(const uint8_t *m);
+
+static const char *GEO_DIR = "/geo";
+static const char *GEO_INDEX = "/geo/cells.idx";
+static const uint32_t GEO_INDEX_MAGIC = 0x314F4547; // "GEO1"
+
+// Geohash-5: 13 longitude bits interleaved with 12 latitude bits
+static const int GEO_LON_BITS = 13;
+static const int GEO_LAT_BITS = 12;
+static const size_t GEO_MAX_CELLS = 96;
+static const size_t GEO_BLOOM_BYTES = 128;
+static const size_t GEO_PENDING = 64;
+static const size_t GEO_FLUSH_AT = 32;
+static const uint32_t GEO_FLUSH_MS = 10000;
+// The cell index is rewritten at most this often while scanning
+static const uint32_t GEO_INDEX_MS = 60000;
+static const size_t GEO_MAX_RESULTS = 128;
+static const size_t GEO_READ_RECORDS = 25;
+static const double METERS_PER_DEG = 111320.0;
+
+static const uint8_t GEO_REC_BLE = 0x01;
+static const uint8_t GEO_REC_UTC = 0x02;   // time is Unix seconds, else uptime
+
+struct GeoRecord {
+    uint8_t mac[6];
+    int8_t rssi;
+    uint8_t flags;
+    uint32_t time;
+    int32_t latE7;
+    int32_t lonE7;
+};
+static_assert(sizeof(GeoRecord) == 20, "GeoRecord is an on-card format");
+
+struct GeoCell {
+    uint32_t id;
+    uint32_t records;
+    uint32_t firstTime;
+    uint32_t lastTime;
+    uint8_t bloom[GEO_BLOOM_BYTES];
+};
+
+static GeoCell cells[GEO_MAX_CELLS];
+static size_t cellCount = 0;
+static bool indexDirty = false;
+static uint32_t lastIndexWrite = 0;
+
+static GeoRecord pending[GEO_PENDING];
+static uint32_t pendingCell[GEO_PENDING];
+static size_t pendingCount = 0;
+static uint32_t oldestPending = 0;
+static uint32_t droppedRecords = 0;
+
+static SemaphoreHandle_t geoLock = nullptr;
+static bool geoReady = false;
+
+static const char GEOHASH_BASE32[] = "0123456789bcdefghjkmnpqrstuvwxyz";
+
+static uint32_t latIndex(double lat) {
+    double v = (lat + 90.0) / 180.0 * (1 << GEO_LAT_BITS);
+    if (v < 0) v = 0;
+    if (v >= (1 << GEO_LAT_BITS)) v = (1 << GEO_LAT_BITS) - 1;
+    return (uint32_t)v;
+}
+
+static uint32_t lonIndex(double lon) {
+    double v = (lon + 180.0) / 360.0 * (1 << GEO_LON_BITS);
+    if (v < 0) v = 0;
+    if (v >= (1 << GEO_LON_BITS)) v = (1 << GEO_LON_BITS) - 1;
+    return (uint32_t)v;
+}
+
+// Geohash bit order: longitude first, alternating, most significant first
+static uint32_t cellId(uint32_t latIdx, uint32_t lonIdx) {
+    uint32_t id = 0;
+    int lo = GEO_LON_BITS - 1, la = GEO_LAT_BITS - 1;
+    for (int b = 0; b < GEO_LON_BITS + GEO_LAT_BITS; b++) {
+        id <<= 1;
+        if ((b & 1) == 0) id |= (lonIdx >> lo--) & 1;
+        else id |= (latIdx >> la--) & 1;
+    }
+    return id;
+}
+
+static String cellName(uint32_t id) {
+    char name[6];
+    for (int i = 4; i >= 0; i--) {
+        name[i] = GEOHASH_BASE32[id & 31];
+        id >>= 5;
+    }
+    name[5] = 0;
+    return String(name);
+}
+
+static String cellPath(uint32_t id) {
+    return String(GEO_DIR) + "/" + cellName(id) + ".bin";
+}
+
+// "u4pru.bin" -> cell id; false for anything that is not a cell file
+static bool parseCellName(const char *name, uint32_t &id) {
+    const char *slash = strrchr(name, '/');
+    if (slash) name = slash + 1;
+    if (strlen(name) != 9 || strcasecmp(name + 5, ".bin") != 0) return false;
+    id = 0;
+    for (int i = 0; i < 5; i++) {
+        const char *p = strchr(GEOHASH_BASE32, tolower((unsigned char)name[i]));
+        if (!p || !*p) return false;
+        id = (id << 5) | (uint32_t)(p - GEOHASH_BASE32);
+    }
+    return true;
+}
+
+static void bloomBits(const uint8_t mac[6], uint32_t bits[3]) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < 6; i++) h = (h ^ mac[i]) * 16777619u;
+    uint32_t h2 = (h >> 16) | (h << 16);
+    h2 = h2 * 0x9E3779B1u;
+    for (int k = 0; k < 3; k++) bits[k] = (h + k * h2) % (GEO_BLOOM_BYTES * 8);
+}
+
+static void bloomAdd(GeoCell &c, const uint8_t mac[6]) {
+    uint32_t bits[3];
+    bloomBits(mac, bits);
+    for (int k = 0; k < 3; k++) c.bloom[bits[k] >> 3] |= 1 << (bits[k] & 7);
+}
+
+static bool bloomMaybe(const GeoCell &c, const uint8_t mac[6]) {
+    uint32_t bits[3];
+    bloomBits(mac, bits);
+    for (int k = 0; k < 3; k++) {
+        if (!(c.bloom[bits[k] >> 3] & (1 << (bits[k] & 7)))) return false;
+    }
+    return true;
+}
+
+static GeoCell *findCell(uint32_t id) {
+    for (size_t i = 0; i < cellCount; i++) {
+        if (cells[i].id == id) return &cells[i];
+    }
+    return nullptr;
+}
+
+// Cells past GEO_MAX_CELLS are still stored; they just have no filter and
+// are always scanned by MAC queries
+static GeoCell *addCell(uint32_t id) {
+    if (cellCount >= GEO_MAX_CELLS) return nullptr;
+    GeoCell &c = cells[cellCount++];
+    memset(&c, 0, sizeof(c));
+    c.id = id;
+    return &c;
+}
+
+static void noteRecord(GeoCell &c, const GeoRecord &r) {
+    bloomAdd(c, r.mac);
+    if (!c.records || r.time < c.firstTime) c.firstTime = r.time;
+    if (r.time > c.lastTime) c.lastTime = r.time;
+    c.records++;
+}
+
+// Rebuilds one cell's entry from its file
+static void scanCellFile(File &f, GeoCell &c) {
+    uint32_t id = c.id;
+    memset(&c, 0, sizeof(c));
+    c.id = id;
+    GeoRecord buf[GEO_READ_RECORDS];
+    size_t n;
+    while ((n = f.read((uint8_t *)buf, sizeof(buf)) / sizeof(GeoRecord)) > 0) {
+        for (size_t i = 0; i < n; i++) noteRecord(c, buf[i]);
+    }
+}
+
+static void writeIndex() {
+    File f = SD.open(GEO_INDEX, FILE_WRITE);
+    if (!f) return;
+    uint32_t hdr[2] = {GEO_INDEX_MAGIC, (uint32_t)cellCount};
+    f.write((const uint8_t *)hdr, sizeof(hdr));
+    f.write((const uint8_t *)cells, cellCount * sizeof(GeoCell));
+    f.close();
+    indexDirty = false;
+    lastIndexWrite = millis();
+}
+
+static void loadIndex() {
+    cellCount = 0;
+    File f = SD.open(GEO_INDEX, FILE_READ);
+    if (f) {
+        uint32_t hdr[2] = {0, 0};
+        if (f.read((uint8_t *)hdr, sizeof(hdr)) == sizeof(hdr) && hdr[0] == GEO_INDEX_MAGIC &&
+            hdr[1] <= GEO_MAX_CELLS &&
+            f.read((uint8_t *)cells, hdr[1] * sizeof(GeoCell)) == hdr[1] * sizeof(GeoCell)) {
+            cellCount = hdr[1];
+        }
+        f.close();
+    }
+
+    // Any cell whose file grew or shrank since the index was written (power
+    // loss mid-scan, card edited on a PC) is rescanned
+    File dir = SD.open(GEO_DIR);
+    if (!dir) return;
+    uint32_t rescanned = 0;
+    for (File e = dir.openNextFile(); e; e = dir.openNextFile()) {
+        uint32_t id;
+        if (!e.isDirectory() && parseCellName(e.name(), id)) {
+            GeoCell *c = findCell(id);
+            if (!c) c = addCell(id);
+            if (c && c->records != e.size() / sizeof(GeoRecord)) {
+                scanCellFile(e, *c);
+                rescanned++;
+            }
+        }
+        e.close();
+    }
+    dir.close();
+    if (rescanned) {
+        Serial.printf("[GEO] Rebuilt index for %u cells\n", (unsigned)rescanned);
+        writeIndex();
+    }
+}
+
+void initGeoStore() {
+    if (!geoLock) geoLock = xSemaphoreCreateMutex();
+    if (!sdAvailable) return;
+    if (!SD.exists(GEO_DIR)) SD.mkdir(GEO_DIR);
+    loadIndex();
+    geoReady = true;
+    Serial.printf("[GEO] Sighting store ready, %u cells\n", (unsigned)cellCount);
+}
+
+// Caller holds geoLock. Groups pending records by cell so each cell file
+// is opened once per batch.
+static void flushPending() {
+    bool done[GEO_PENDING] = {};
+    for (size_t i = 0; i < pendingCount; i++) {
+        if (done[i]) continue;
+        uint32_t id = pendingCell[i];
+        File f = SD.open(cellPath(id), FILE_APPEND);
+        GeoCell *c = findCell(id);
+        if (!c) c = addCell(id);
+        for (size_t j = i; j < pendingCount; j++) {
+            if (done[j] || pendingCell[j] != id) continue;
+            done[j] = true;
+            if (!f) {
+                droppedRecords++;
+                continue;
+            }
+            f.write((const uint8_t *)&pending[j], sizeof(GeoRecord));
+            if (c) noteRecord(*c, pending[j]);
+        }
+        if (f) f.close();
+    }
+    pendingCount = 0;
+    indexDirty = true;
+}
+
+void geoStoreRecord(const Hit &h, const GpsFix &fix) {
+    if (!geoReady || !fix.valid) return;
+    if (xSemaphoreTake(geoLock, pdMS_TO_TICKS(50)) != pdTRUE) {
+        droppedRecords++;
+        return;
+    }
+
+    GeoRecord &r = pending[pendingCount];
+    memcpy(r.mac, h.mac, 6);
+    r.rssi = h.rssi;
+    r.flags = h.isBLE ? GEO_REC_BLE : 0;
+    UtcStamp t = utcAt(h.tsUs);
+    if (t.valid) {
+        r.flags |= GEO_REC_UTC;
+        r.time = t.sec;
+    } else {
+        r.time = (uint32_t)(h.tsUs / 1000000);
+    }
+    r.latE7 = (int32_t)lround(fix.lat * 1e7);
+    r.lonE7 = (int32_t)lround(fix.lon * 1e7);
+    pendingCell[pendingCount] = cellId(latIndex(fix.lat), lonIndex(fix.lon));
+    if (pendingCount++ == 0) oldestPending = millis();
+
+    if (pendingCount >= GEO_FLUSH_AT || millis() - oldestPending > GEO_FLUSH_MS) {
+        flushPending();
+        if (millis() - lastIndexWrite > GEO_INDEX_MS) writeIndex();
+    }
+    xSemaphoreGive(geoLock);
+}
+
+void geoStoreFlush() {
+    if (!geoReady) return;
+    if (xSemaphoreTake(geoLock, pdMS_TO_TICKS(1000)) != pdTRUE) return;
+    if (pendingCount) flushPending();
+    if (indexDirty) writeIndex();
+    xSemaphoreGive(geoLock);
+}
+
+static String formatRecordTime(uint32_t time, uint8_t flags) {
+    if (!(flags & GEO_REC_UTC)) return "uptime " + String(time) + "s";
+    UtcStamp t = {true, time, 0, 0};
+    String s = formatUtc(t);
+    int cut = s.indexOf('.');
+    return cut > 0 ? s.substring(0, cut) + "Z" : s;
+}
+
+struct GeoNearHit {
+    uint8_t mac[6];
+    bool used;
+    uint8_t flags;
+    int8_t bestRssi;
+    uint32_t count;
+    float minDist;
+    uint32_t lastTime;
+};
+
+String geoQueryNear(double lat, double lon, float radiusM) {
+    if (!geoReady) return "Sighting store unavailable (no SD card)\n";
+    if (radiusM < 1.0f) radiusM = 1.0f;
+    if (radiusM > GEO_MAX_RADIUS_M) radiusM = GEO_MAX_RADIUS_M;
+
+    double kx = METERS_PER_DEG * cos(lat * M_PI / 180.0);
+    double dLat = radiusM / METERS_PER_DEG;
+    double dLon = kx > 1.0 ? radiusM / kx : 180.0;
+    uint32_t la0 = latIndex(lat - dLat), la1 = latIndex(lat + dLat);
+    uint32_t lo0 = lonIndex(lon - dLon), lo1 = lonIndex(lon + dLon);
+
+    // Open-addressed by MAC so each record costs one probe on average
+    static const size_t SLOTS = GEO_MAX_RESULTS * 2;
+    GeoNearHit *hits = (GeoNearHit *)calloc(SLOTS, sizeof(GeoNearHit));
+    if (!hits) return "Out of memory\n";
+    size_t unique = 0;
+    uint32_t scanned = 0, filesRead = 0;
+    bool truncated = false;
+    float r2 = radiusM * radiusM;
+
+    if (xSemaphoreTake(geoLock, pdMS_TO_TICKS(2000)) != pdTRUE) {
+        free(hits);
+        return "Sighting store busy\n";
+    }
+    if (pendingCount) flushPending();
+
+    GeoRecord buf[GEO_READ_RECORDS];
+    for (uint32_t la = la0; la <= la1; la++) {
+        for (uint32_t lo = lo0; lo <= lo1; lo++) {
+            uint32_t id = cellId(la, lo);
+            File f = SD.open(cellPath(id), FILE_READ);
+            if (!f) continue;
+            filesRead++;
+            size_t n;
+            while ((n = f.read((uint8_t *)buf, sizeof(buf)) / sizeof(GeoRecord)) > 0) {
+                for (size_t i = 0; i < n; i++) {
+                    const GeoRecord &r = buf[i];
+                    scanned++;
+                    float dy = (float)((r.latE7 / 1e7 - lat) * METERS_PER_DEG);
+                    float dx = (float)((r.lonE7 / 1e7 - lon) * kx);
+                    float d2 = dx * dx + dy * dy;
+                    if (d2 > r2) continue;
+
+                    uint32_t h = 0;
+                    for (int k = 0; k < 6; k++) h = h * 31 + r.mac[k];
+                    size_t s = h % SLOTS;
+                    while (hits[s].used && memcmp(hits[s].mac, r.mac, 6) != 0) s = (s + 1) % SLOTS;
+                    GeoNearHit &e = hits[s];
+                    if (!e.used) {
+                        if (unique >= GEO_MAX_RESULTS) {
+                            truncated = true;
+                            continue;
+                        }
+                        unique++;
+                        e.used = true;
+                        memcpy(e.mac, r.mac, 6);
+                        e.bestRssi = r.rssi;
+                        e.minDist = sqrtf(d2);
+                        e.lastTime = r.time;
+                        e.flags = r.flags;
+                    }
+                    e.count++;
+                    if (r.rssi > e.bestRssi) e.bestRssi = r.rssi;
+                    float d = sqrtf(d2);
+                    if (d < e.minDist) e.minDist = d;
+                    if (r.time >= e.lastTime) {
+                        e.lastTime = r.time;
+                        e.flags = r.flags;
+                    }
+                }
+            }
+            f.close();
+        }
+    }
+    xSemaphoreGive(geoLock);
+
+    // Compact and order by distance
+    size_t out = 0;
+    for (size_t i = 0; i < SLOTS; i++) {
+        if (hits[i].used) hits[out++] = hits[i];
+    }
+    std::sort(hits, hits + out, [](const GeoNearHit &a, const GeoNearHit &b) { return a.minDist < b.minDist; });
+
+    String s = "Devices within " + String((int)radiusM) + "m of " + String(lat, 6) + "," + String(lon, 6) + ": " +
+               String((unsigned)out) + (truncated ? "+" : "") + "\n";
+    s += "(" + String(scanned) + " records in " + String(filesRead) + " cells)\n";
+    for (size_t i = 0; i < out; i++) {
+        const GeoNearHit &e = hits[i];
+        s += String(e.flags & GEO_REC_BLE ? "BLE  " : "WiFi ") + macFmt6(e.mac);
+        s += " dist=" + String((int)e.minDist) + "m";
+        s += " seen=" + String(e.count);
+        s += " best=" + String((int)e.bestRssi) + "dBm";
+        s += " last=" + formatRecordTime(e.lastTime, e.flags) + "\n";
+    }
+    free(hits);
+    return s;
+}
+
+String geoQueryMac(const uint8_t mac[6]) {
+    if (!geoReady) return "Sighting store unavailable (no SD card)\n";
+    if (xSemaphoreTake(geoLock, pdMS_TO_TICKS(2000)) != pdTRUE) return "Sighting store busy\n";
+    if (pendingCount) flushPending();
+
+    String s = "Cells where " + macFmt6(mac) + " was seen:\n";
+    uint32_t skipped = 0, found = 0;
+    GeoRecord buf[GEO_READ_RECORDS];
+    File dir = SD.open(GEO_DIR);
+    for (File f = dir ? dir.openNextFile() : File(); f; f = dir.openNextFile()) {
+        uint32_t id;
+        if (f.isDirectory() || !parseCellName(f.name(), id)) {
+            f.close();
+            continue;
+        }
+        const GeoCell *c = findCell(id);
+        if (c && !bloomMaybe(*c, mac)) {
+            skipped++;
+            f.close();
+            continue;
+        }
+
+        uint32_t count = 0, first = 0, last = 0;
+        uint8_t firstFlags = 0, lastFlags = 0;
+        int8_t best = -128;
+        double sumLat = 0, sumLon = 0;
+        size_t n;
+        while ((n = f.read((uint8_t *)buf, sizeof(buf)) / sizeof(GeoRecord)) > 0) {
+            for (size_t i = 0; i < n; i++) {
+                const GeoRecord &r = buf[i];
+                if (memcmp(r.mac, mac, 6) != 0) continue;
+                if (!count || r.time < first) {
+                    first = r.time;
+                    firstFlags = r.flags;
+                }
+                if (r.time >= last) {
+                    last = r.time;
+                    lastFlags = r.flags;
+                }
+                if (r.rssi > best) best = r.rssi;
+                sumLat += r.latE7 / 1e7;
+                sumLon += r.lonE7 / 1e7;
+                count++;
+            }
+        }
+        f.close();
+        if (!count) continue;
+
+        found++;
+        s += cellName(id);
+        s += " at " + String(sumLat / count, 6) + "," + String(sumLon / count, 6);
+        s += " seen=" + String(count);
+        s += " best=" + String((int)best) + "dBm";
+        s += " first=" + formatRecordTime(first, firstFlags);
+        s += " last=" + formatRecordTime(last, lastFlags) + "\n";
+    }
+    if (dir) dir.close();
+    xSemaphoreGive(geoLock);
+
+    if (!found) s += "none\n";
+    s += "(" + String(skipped) + " cells skipped by filter)\n";
+    return s;
+}
+
+String getGeoStoreStatus() {
+    if (!geoReady) return "Geo store: unavailable\n";
+    uint32_t records = 0;
+    for (size_t i = 0; i < cellCount; i++) records += cells[i].records;
+    String s = "Geo store: " + String((unsigned)cellCount) + " cells, " + String(records) + " records";
+    if (droppedRecords) s += ", " + String(droppedRecords) + " dropped";
+    return s + "\n";
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <Arduino.h>
+#include "scanner.h"
+#include "hardware.h"
+
+// SD-backed store of geotagged sightings. Records are appended to one file
+// per geohash-5 cell (~4.9 km square) under /geo, so a radius query only
+// reads the handful of cells its bounding box touches. A per-cell Bloom
+// filter of MACs, kept in RAM and in /geo/cells.idx, lets a per-MAC query
+// skip every cell the device was never seen in.
+
+static const float GEO_MAX_RADIUS_M = 5000.0f;
+
+void initGeoStore();
+// Buffers a hit taken at a valid fix; written out in batches
+void geoStoreRecord(const Hit &h, const GpsFix &fix);
+void geoStoreFlush();
+String geoQueryNear(double lat, double lon, float radiusM);
+String geoQueryMac(const uint8_t mac[6]);
+String getGeoStoreStatus();
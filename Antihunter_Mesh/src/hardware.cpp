@@ -1,10 +1,20 @@
 #include "hardware.h"
 #include "scanner.h"
 #include "network.h"
+#include "chanplan.h"
+#include "meshqueue.h"
+#include "meshcmd.h"
+#include "timesync.h"
+#include "geostore.h"
+#include "devhistory.h"
+#include "rpa.h"
+#include "probefp.h"
+#include "apwatch.h"
 #include <SPI.h>
 #include <SD.h>
 #include <TinyGPSPlus.h>
 #include <HardwareSerial.h>
+#include <esp_timer.h>
 
 extern Preferences prefs;
 extern int cfgBeeps, cfgGapMs;
@@ -15,9 +25,16 @@ extern std::vector<uint8_t> CHANNELS;
 TinyGPSPlus gps;
 HardwareSerial GPS(2);
 bool sdAvailable = false;
-String lastGPSData = "No GPS data";
-float gpsLat = 0.0, gpsLon = 0.0;
-bool gpsValid = false;
+static GpsFix gpsFix = {};
+static portMUX_TYPE gpsMux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t gpsTaskHandle = nullptr;
+// A fix is dropped when the receiver has been silent this long
+static const uint32_t GPS_STALE_MS = 30000;
+// Wake at least this often to notice a silent receiver
+static const uint32_t GPS_IDLE_MS = 1000;
+static const uint32_t GPS_BAUD = 9600;
+// Time on the wire for one 8N1 byte
+static const int64_t GPS_BYTE_US = 10 * 1000000LL / GPS_BAUD;
 
 // getDiagnostics vars
 extern volatile bool scanning;
@@ -129,6 +146,11 @@ String getDiagnostics() {
     s += "Scan Mode: " + modeStr + "\n";
     s += String("Scanning: ") + (scanning ? "yes" : "no") + "\n";
     s += "WiFi Frames seen: " + String((unsigned)framesSeen) + "\n";
+    s += getRadioStatus();
+    s += getRxFilterStatus();
+    s += getBlueTeamStatus();
+    s += getDeauthStatus();
+    s += getApStatus();
     s += "BLE Frames seen: " + String((unsigned)bleFramesSeen) + "\n";
     s += "Total hits: " + String(totalHits) + "\n";
     s += "Country: " + String(COUNTRY) + "\n";
@@ -173,21 +195,28 @@ String getDiagnostics() {
 
     /// GPS Status
     s += "GPS Status: ";
-    if (gpsValid) {
-        s += "Valid fix at " + String(gpsLat, 6) + ", " + String(gpsLon, 6) + "\n";
+    GpsFix fix = getGpsFix();
+    if (fix.valid) {
+        s += "Valid fix at " + String(fix.lat, 6) + ", " + String(fix.lon, 6) +
+             " sats=" + String(fix.sats) + " hdop=" + String(fix.hdop, 1) + "\n";
     } else {
         s += "Searching for satellites\n";
     }
+    s += getTimeSyncStatus();
+    s += getGeoStoreStatus();
+    s += getHistoryStatus();
+    s += getRpaStatus();
+    s += getProbeFpStatus();
 
     if (trackerMode) {
-        uint8_t trackerMac[6];
-        int8_t trackerRssi;
-        uint32_t trackerLastSeen, trackerPackets;
-        getTrackerStatus(trackerMac, trackerRssi, trackerLastSeen, trackerPackets);
-
-        s += "Tracker: target=" + macFmt6(trackerMac) + " lastRSSI=" + String((int)trackerRssi) + "dBm";
-        s += "  lastSeen(ms ago)=" + String((unsigned)(millis() - trackerLastSeen));
-        s += " pkts=" + String((unsigned)trackerPackets) + "\n";
+        TrackerStatus status[TRACKER_MAX_TARGETS];
+        size_t n = getTrackerTargets(status, TRACKER_MAX_TARGETS);
+        for (size_t i = 0; i < n; i++) {
+            s += String(status[i].primary ? "Tracker*: target=" : "Tracker: target=") + macFmt6(status[i].mac);
+            s += " RSSI=" + String((int)status[i].rssi) + "dBm";
+            s += "  lastSeen(ms ago)=" + String(status[i].lastSeen ? (unsigned)(millis() - status[i].lastSeen) : 0);
+            s += " pkts=" + String((unsigned)status[i].packets) + "\n";
+        }
     }
 
     s += "Last scan secs: " + String((unsigned)lastScanSecs) + (lastScanForever ? " (forever)" : "") + "\n";
@@ -203,6 +232,9 @@ String getDiagnostics() {
         s += String((int)c) + " ";
     }
     s += "\n";
+    s += getChannelPlanStatus();
+    s += getMeshQueueStatus();
+    s += getMeshAuthStatus();
 
     return s;
 }
@@ -256,12 +288,109 @@ void initializeSD()
     Serial.println("SD card initialization failed");
 }
 
+static void publishGpsFix(const GpsFix &f)
+{
+    portENTER_CRITICAL(&gpsMux);
+    uint32_t v = gpsFix.version + 1;
+    gpsFix = f;
+    gpsFix.version = v;
+    portEXIT_CRITICAL(&gpsMux);
+}
+
+GpsFix getGpsFix()
+{
+    portENTER_CRITICAL(&gpsMux);
+    GpsFix f = gpsFix;
+    portEXIT_CRITICAL(&gpsMux);
+    return f;
+}
+
+static void onGpsReceive()
+{
+    if (gpsTaskHandle)
+        xTaskNotifyGive(gpsTaskHandle);
+}
+
+// Sleeps until the UART reports bytes, feeds them to TinyGPSPlus and
+// publishes a new snapshot whenever a sentence updates position or time.
+// Each byte's arrival is back-dated from the wake time so time tags can
+// discipline the UTC clock against the moment their sentence began.
+static void gpsTask(void *)
+{
+    uint32_t lastSentence = 0;
+    bool stale = false;
+    int64_t sentenceStartUs = 0;
+    uint32_t utc = 0;
+    uint16_t utcMs = 0;
+
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(GPS_IDLE_MS));
+
+        int64_t wakeUs = esp_timer_get_time();
+        int pending = GPS.available();
+        bool updated = false;
+        for (int i = 0; i < pending; i++)
+        {
+            char c = (char)GPS.read();
+            if (c == '$')
+                sentenceStartUs = wakeUs - (pending - i) * GPS_BYTE_US;
+            if (!gps.encode(c))
+                continue;
+
+            lastSentence = millis();
+            bool timeUpdated = gps.time.isUpdated();
+            if (gps.location.isUpdated() || timeUpdated)
+                updated = true;
+            if (timeUpdated && gps.date.isValid() && gps.time.isValid() && gps.date.year() >= 2020)
+            {
+                utc = utcFromCivil(gps.date.year(), gps.date.month(), gps.date.day(),
+                                   gps.time.hour(), gps.time.minute(), gps.time.second());
+                utcMs = (uint16_t)(gps.time.centisecond() * 10);
+                timeSyncNmea(sentenceStartUs, utc, utcMs);
+            }
+        }
+
+        if (updated)
+        {
+            GpsFix f = getGpsFix();
+            f.valid = gps.location.isValid();
+            if (f.valid)
+            {
+                f.lat = gps.location.lat();
+                f.lon = gps.location.lng();
+            }
+            if (gps.altitude.isValid())
+                f.altM = (float)gps.altitude.meters();
+            if (gps.hdop.isValid())
+                f.hdop = (float)gps.hdop.hdop();
+            if (gps.satellites.isValid())
+                f.sats = (uint8_t)gps.satellites.value();
+            if (utc)
+            {
+                f.utc = utc;
+                f.utcMs = utcMs;
+            }
+            f.fixMs = lastSentence;
+            publishGpsFix(f);
+            stale = false;
+        }
+        else if (lastSentence && !stale && millis() - lastSentence > GPS_STALE_MS)
+        {
+            GpsFix f = getGpsFix();
+            f.valid = false;
+            publishGpsFix(f);
+            stale = true;
+        }
+    }
+}
+
 void initializeGPS()
 {
     Serial.println("Initializing GPS...");
     
     GPS.setRxBufferSize(2048);
-    GPS.begin(9600, SERIAL_8N1, GPS_RX_PIN, GPS_TX_PIN);
+    GPS.begin(GPS_BAUD, SERIAL_8N1, GPS_RX_PIN, GPS_TX_PIN);
     
     delay(120); // enough time to let it settle
     
@@ -271,11 +400,21 @@ void initializeGPS()
         Serial.println("[GPS] No initial response - GPS may need more time for cold start");
         Serial.println("[GPS] Allow 5-15 minutes outdoors for first fix");
     }
+
+    initTimeSync();
+    xTaskCreatePinnedToCore(gpsTask, "gps", 4096, nullptr, 1, &gpsTaskHandle, 0);
+    GPS.onReceive(onGpsReceive);
     
     Serial.printf("[GPS] UART initialized on pins RX:%d TX:%d\n", GPS_RX_PIN, GPS_TX_PIN);
 }
 
 void logToSD(const String &data)
+{
+    logToSD(data, esp_timer_get_time());
+}
+
+// Lines carry GPS-disciplined UTC once synced, uptime ms before that
+void logToSD(const String &data, int64_t tsUs)
 {
     if (!sdAvailable)
         return;
@@ -283,8 +422,12 @@ void logToSD(const String &data)
     File logFile = SD.open("/antihunter.log", FILE_APPEND);
     if (logFile)
     {
+        UtcStamp t = utcAt(tsUs);
         logFile.print("[");
-        logFile.print(millis());
+        if (t.valid)
+            logFile.print(formatUtc(t));
+        else
+            logFile.print((unsigned long)(tsUs / 1000));
         logFile.print("] ");
         logFile.println(data);
         logFile.close();
@@ -293,40 +436,14 @@ void logToSD(const String &data)
 
 String getGPSData()
 {
-    return lastGPSData;
-}
-
-void updateGPSLocation() {
-    static unsigned long lastDataTime = 0;
-
-    while (GPS.available() > 0) {
-        char c = GPS.read();
-        if (gps.encode(c)) {
-            lastDataTime = millis();
-
-            if (gps.location.isValid()) {
-                gpsLat      = gps.location.lat();
-                gpsLon      = gps.location.lng();
-                gpsValid    = true;
-                lastGPSData = "Lat: " + String(gpsLat, 6)
-                            + ", Lon: " + String(gpsLon, 6)
-                            + " (" + String((millis() - lastDataTime) / 1000) 
-                            + "s ago)";
-            } else {
-                gpsValid    = false;
-                lastGPSData = "No valid GPS fix (" 
-                            + String((millis() - lastDataTime) / 1000)
-                            + "s ago)";
-            }
-        }
-    }
-
-    if (lastDataTime > 0 && millis() - lastDataTime > 30000) {
-        gpsValid    = false;
-        lastGPSData = "No data for " 
-                    + String((millis() - lastDataTime) / 1000)
-                    + "s";
-    }
+    GpsFix f = getGpsFix();
+    if (f.version == 0)
+        return "No GPS data";
+
+    uint32_t ago = (millis() - f.fixMs) / 1000;
+    if (!f.valid)
+        return "No valid GPS fix (" + String(ago) + "s ago)";
+    return "Lat: " + String(f.lat, 6) + ", Lon: " + String(f.lon, 6) + " (" + String(ago) + "s ago)";
 }
 
 void testGPSPins() {
@@ -38,10 +38,23 @@
 #define GPS_RX_PIN 44   // D7 = GPIO44 (ESP RX)
 #define GPS_TX_PIN 43   // D6 = GPIO43 (ESP TX)
 
+// Latest GPS state, published as a whole by the GPS task. version
+// increments on every publish so readers can tell a fresh fix from a copy
+// they already have.
+struct GpsFix {
+    uint32_t version;
+    bool valid;
+    double lat;
+    double lon;
+    float altM;
+    float hdop;
+    uint8_t sats;
+    uint32_t utc;        // Unix seconds, 0 until the receiver reports date and time
+    uint16_t utcMs;
+    uint32_t fixMs;      // millis() when the sentence completed
+};
+
 extern bool sdAvailable;
-extern bool gpsValid;
-extern float gpsLat, gpsLon;
-extern String lastGPSData;
 extern HardwareSerial GPS;
 
 
@@ -56,5 +69,6 @@ String getDiagnostics();
 int getBeepsPerHit();
 int getGapMs();
 void logToSD(const String &data);
+void logToSD(const String &data, int64_t tsUs);
 String getGPSData();
-void updateGPSLocation();
\ No newline at end of file
+GpsFix getGpsFix();
\ No newline at end of file
@@ -0,0 +1,189 @@
+#include "locate.h"
+#include <math.h>
+
+static const double EARTH_RADIUS_M = 6371000.0;
+static const double DEG_TO_RAD = M_PI / 180.0;
+static const float MIN_RANGE_M = 0.5f;
+static const float MAX_RANGE_M = 2000.0f;
+// Weight, in residual degrees of freedom, given to the path-loss model's
+// own error estimate when scaling the ellipse
+static const float PRIOR_DOF = 4.0f;
+static const int MAX_ITERATIONS = 25;
+
+// Samples projected onto the local east/north plane
+struct LocatePlane {
+    float x[LOCATE_MAX_SAMPLES];
+    float y[LOCATE_MAX_SAMPLES];
+    float lnD[LOCATE_MAX_SAMPLES];
+    size_t n;
+};
+
+float rssiToDistance(const PathLossModel &m, float rssi) {
+    float d = powf(10.0f, (m.rssi1m - rssi) / (10.0f * m.exponent));
+    if (d < MIN_RANGE_M) return MIN_RANGE_M;
+    if (d > MAX_RANGE_M) return MAX_RANGE_M;
+    return d;
+}
+
+// Residual ln|p - s_i| - ln d_i and its gradient with respect to p
+static float residual(const LocatePlane &pl, size_t i, float px, float py, float &jx, float &jy) {
+    float dx = px - pl.x[i], dy = py - pl.y[i];
+    float dist2 = dx * dx + dy * dy;
+    if (dist2 < MIN_RANGE_M * MIN_RANGE_M) {
+        dist2 = MIN_RANGE_M * MIN_RANGE_M;
+        dx = MIN_RANGE_M;
+        dy = 0;
+    }
+    jx = dx / dist2;
+    jy = dy / dist2;
+    return 0.5f * logf(dist2) - pl.lnD[i];
+}
+
+static float fitCost(const LocatePlane &pl, float px, float py) {
+    float c = 0, jx, jy;
+    for (size_t i = 0; i < pl.n; i++) {
+        float r = residual(pl, i, px, py, jx, jy);
+        c += r * r;
+    }
+    return c;
+}
+
+// Gauss-Newton from (px, py); steps that raise the cost are halved.
+// Returns the cost at the point it stops.
+static float gaussNewton(const LocatePlane &pl, float &px, float &py, int &iterations) {
+    float cur = fitCost(pl, px, py);
+    int it = 0;
+    for (; it < MAX_ITERATIONS; it++) {
+        float h00 = 0, h01 = 0, h11 = 0, g0 = 0, g1 = 0, jx, jy;
+        for (size_t i = 0; i < pl.n; i++) {
+            float r = residual(pl, i, px, py, jx, jy);
+            h00 += jx * jx;
+            h01 += jx * jy;
+            h11 += jy * jy;
+            g0 += jx * r;
+            g1 += jy * r;
+        }
+        float det = h00 * h11 - h01 * h01;
+        if (!(det > 0)) break;
+        float sx = -(h11 * g0 - h01 * g1) / det;
+        float sy = -(h00 * g1 - h01 * g0) / det;
+        float next = fitCost(pl, px + sx, py + sy);
+        for (int k = 0; k < 10 && !(next <= cur); k++) {
+            sx *= 0.5f;
+            sy *= 0.5f;
+            next = fitCost(pl, px + sx, py + sy);
+        }
+        if (!(next <= cur)) break;
+        px += sx;
+        py += sy;
+        cur = next;
+        if (sx * sx + sy * sy < 1e-4f) break;
+    }
+    iterations += it + 1;
+    return cur;
+}
+
+bool locateTarget(const LocateSample *samples, size_t count, const PathLossModel &m, LocateResult &out) {
+    size_t n = count < LOCATE_MAX_SAMPLES ? count : LOCATE_MAX_SAMPLES;
+    if (n < 3) return false;
+
+    // Work in a local east/north plane around the mean node position;
+    // the solver runs in float, which the ESP32-S3 FPU handles natively
+    double lat0 = 0, lon0 = 0;
+    for (size_t i = 0; i < n; i++) {
+        lat0 += samples[i].lat;
+        lon0 += samples[i].lon;
+    }
+    lat0 /= n;
+    lon0 /= n;
+    double kx = EARTH_RADIUS_M * cos(lat0 * DEG_TO_RAD) * DEG_TO_RAD;
+    double ky = EARTH_RADIUS_M * DEG_TO_RAD;
+
+    // Shadowing is log-normal, so ln(range) has the same spread at every
+    // range and the unweighted log-range fit is the maximum-likelihood one
+    float lnSigma = logf(10.0f) / (10.0f * m.exponent) * m.shadowDb;
+    LocatePlane pl;
+    pl.n = n;
+    float cx = 0, cy = 0, wsum = 0;
+    for (size_t i = 0; i < n; i++) {
+        pl.x[i] = (float)((samples[i].lon - lon0) * kx);
+        pl.y[i] = (float)((samples[i].lat - lat0) * ky);
+        float d = rssiToDistance(m, samples[i].rssi + samples[i].offsetDb);
+        pl.lnD[i] = logf(d);
+        float cw = 1.0f / (d * d);
+        cx += pl.x[i] * cw;
+        cy += pl.y[i] * cw;
+        wsum += cw;
+    }
+    cx /= wsum;
+    cy /= wsum;
+
+    // Range-only fits have local minima (mirror images across a pair of
+    // nodes), so besides the range-weighted centroid every node position
+    // is tried as a start and the lowest cost wins
+    float px = cx, py = cy;
+    int iterations = 0;
+    float best = gaussNewton(pl, px, py, iterations);
+    for (size_t s = 0; s < n; s++) {
+        float qx = pl.x[s] + 0.5f * (cx - pl.x[s]), qy = pl.y[s] + 0.5f * (cy - pl.y[s]);
+        float c = gaussNewton(pl, qx, qy, iterations);
+        if (c < best) {
+            best = c;
+            px = qx;
+            py = qy;
+        }
+    }
+
+    // A solution far outside every range is a divergence, not a fix
+    if (!(px * px + py * py <= 4 * MAX_RANGE_M * MAX_RANGE_M)) return false;
+
+    // Covariance (J'WJ)^-1 * r'Wr / (n - 2) with W = 1 / lnSigma^2. With
+    // few nodes r'Wr rests on one or two residuals, so it is pooled with
+    // PRIOR_DOF pseudo-observations at the model's own value of 1, and the
+    // 95% region is 2 F(2, dof) for the pooled degrees of freedom, which
+    // tends to the chi-square 5.991 as n grows
+    float w = 1.0f / (lnSigma * lnSigma);
+    float h00 = 0, h01 = 0, h11 = 0, wsq = 0, sq = 0, jx, jy;
+    for (size_t i = 0; i < n; i++) {
+        float r = residual(pl, i, px, py, jx, jy);
+        h00 += w * jx * jx;
+        h01 += w * jx * jy;
+        h11 += w * jy * jy;
+        wsq += w * r * r;
+        float dist = sqrtf((px - pl.x[i]) * (px - pl.x[i]) + (py - pl.y[i]) * (py - pl.y[i]));
+        float rm = dist - expf(pl.lnD[i]);
+        sq += rm * rm;
+    }
+    // Collinear nodes leave the mirror image unresolved
+    float det = h00 * h11 - h01 * h01;
+    if (!(det > 1e-12f * (h00 + h11) * (h00 + h11))) return false;
+
+    float dof = (float)(n - 2) + PRIOR_DOF;
+    float variance = (wsq + PRIOR_DOF) / dof;
+    float quantile = dof * (powf(0.05f, -2.0f / dof) - 1.0f);
+    float scale = variance * quantile / det;
+    float c00 = h11 * scale, c11 = h00 * scale, c01 = -h01 * scale;
+
+    float mid = 0.5f * (c00 + c11);
+    float rad = sqrtf(0.25f * (c00 - c11) * (c00 - c11) + c01 * c01);
+    float l1 = mid + rad, l2 = mid - rad;
+    if (l2 < 0) l2 = 0;
+    float theta = 0.5f * atan2f(2.0f * c01, c00 - c11);
+    float bearing = 90.0f - theta * 180.0f / (float)M_PI;
+    while (bearing < 0) bearing += 180.0f;
+    while (bearing >= 180.0f) bearing -= 180.0f;
+
+    out.lat = lat0 + py / ky;
+    out.lon = lon0 + px / kx;
+    // Beyond the longest range the model produces the ellipse says nothing
+    out.semiMajor = sqrtf(l1);
+    out.semiMinor = sqrtf(l2);
+    out.rough = n == 3 || out.semiMajor > MAX_RANGE_M;
+    if (out.semiMajor > MAX_RANGE_M) out.semiMajor = MAX_RANGE_M;
+    if (out.semiMinor > MAX_RANGE_M) out.semiMinor = MAX_RANGE_M;
+    out.bearing = bearing;
+    out.rmsResidual = sqrtf(sq / n);
+    out.used = (uint8_t)n;
+    out.iterations = (uint8_t)(iterations > 255 ? 255 : iterations);
+    return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// RSSI trilateration. Each sample is one node's position and the RSSI it
+// measured for the target; a log-distance path-loss model turns RSSI into
+// range and a Gauss-Newton fit on log-range finds the position that best
+// agrees with all ranges. The 95% ellipse comes from the same fit, so it is
+// a linearised region: it holds in the near-linear regime (about 1 dB of
+// shadowing) and under-covers as shadowing grows and the position error
+// grows heavy tails (tools/locatecheck.cpp has the numbers). Plain C++ so
+// it can be checked on the host with synthetic data.
+
+static const size_t LOCATE_MAX_SAMPLES = 16;
+
+struct PathLossModel {
+    float rssi1m;        // received power at 1 m, dBm
+    float exponent;      // 2 in free space, 2.5-3.5 outdoors with clutter
+    float shadowDb;      // log-normal shadowing std deviation
+};
+
+static const PathLossModel DEFAULT_PATH_LOSS = { -45.0f, 2.7f, 5.0f };
+
+struct LocateSample {
+    double lat;
+    double lon;
+    float rssi;
+    float offsetDb;      // per-node calibration, added to rssi
+};
+
+struct LocateResult {
+    double lat;
+    double lon;
+    float semiMajor;     // 95% error ellipse axes, metres
+    float semiMinor;
+    float bearing;       // major axis, degrees clockwise from north
+    float rmsResidual;   // metres
+    uint8_t used;
+    uint8_t iterations;
+    // Three nodes (one residual degree of freedom, mirror solutions nearby)
+    // or an axis capped at the model's maximum range: position only
+    bool rough;
+};
+
+float rssiToDistance(const PathLossModel &m, float rssi);
+bool locateTarget(const LocateSample *samples, size_t count, const PathLossModel &m, LocateResult &out);
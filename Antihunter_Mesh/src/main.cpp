@@ -3,10 +3,11 @@
 #include "network.h"
 #include "scanner.h" 
 #include "hardware.h"
+#include "geostore.h"
+#include "devhistory.h"
 
 // Global configuration
 Preferences prefs;
-volatile bool stopRequested = false;
 
 // Configuration constants
 #ifndef AP_SSID
@@ -26,11 +27,11 @@ volatile bool stopRequested = false;
 ScanMode currentScanMode = SCAN_WIFI;
 int cfgBeeps = 2;
 int cfgGapMs = 80;
-String lastResults;
 std::vector<uint8_t> CHANNELS;
 
 // Task handles
 TaskHandle_t workerTaskHandle = nullptr;
+TaskHandle_t trackerTaskHandle = nullptr;
 TaskHandle_t blueTeamTaskHandle = nullptr;
 
 // Helper functions
@@ -54,6 +55,24 @@ bool parseMac6(const String &in, uint8_t out[6]) {
     return true;
 }
 
+// Comma, semicolon, space or newline separated MACs. Returns the number
+// parsed, or -1 if any entry is not a MAC or there are more than maxCount.
+int parseMacList(const String &in, uint8_t out[][6], size_t maxCount) {
+    size_t n = 0;
+    int start = 0;
+    int len = in.length();
+    while (start < len) {
+        int end = start;
+        while (end < len && in[end] != ',' && in[end] != ';' && in[end] != ' ' && in[end] != '\n') end++;
+        if (end > start) {
+            if (n >= maxCount || !parseMac6(in.substring(start, end), out[n])) return -1;
+            n++;
+        }
+        start = end + 1;
+    }
+    return (int)n;
+}
+
 inline uint16_t u16(const uint8_t *p) { 
     return (uint16_t)p[0] | ((uint16_t)p[1] << 8); 
 }
@@ -105,6 +124,8 @@ void setup() {
     initializeHardware();
     initializeSD();
     initializeGPS();
+    initGeoStore();
+    initDeviceHistory();
     delay(3000);
     // testGPSPins(); // GPS diagnostic for testing
     initializeScanner();
@@ -115,7 +136,7 @@ void setup() {
     Serial.println("Mesh: Serial1 @ 115200 baud on pins 4,5");
 }
 
+// All work runs in dedicated tasks; nothing is left for the loop task
 void loop() {
-    updateGPSLocation();
-    delay(100); 
+    vTaskDelete(nullptr);
 }
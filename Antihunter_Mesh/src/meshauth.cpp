@@ -0,0 +1,168 @@
+#include "meshauth.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t ror(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+struct Sha256 {
+    uint32_t h[8];
+    uint8_t block[64];
+    size_t fill;
+    uint64_t total;
+};
+
+static void shaBlock(Sha256 &s, const uint8_t *b) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)b[4 * i] << 24 | (uint32_t)b[4 * i + 1] << 16 | (uint32_t)b[4 * i + 2] << 8 | b[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = s.h[0], bb = s.h[1], c = s.h[2], d = s.h[3], e = s.h[4], f = s.h[5], g = s.h[6], h = s.h[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+        uint32_t t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a & bb) ^ (a & c) ^ (bb & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = bb;
+        bb = a;
+        a = t1 + t2;
+    }
+    s.h[0] += a;
+    s.h[1] += bb;
+    s.h[2] += c;
+    s.h[3] += d;
+    s.h[4] += e;
+    s.h[5] += f;
+    s.h[6] += g;
+    s.h[7] += h;
+}
+
+static void shaInit(Sha256 &s) {
+    static const uint32_t H0[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                   0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    memcpy(s.h, H0, sizeof(H0));
+    s.fill = 0;
+    s.total = 0;
+}
+
+static void shaUpdate(Sha256 &s, const uint8_t *p, size_t n) {
+    s.total += n;
+    while (n) {
+        size_t take = 64 - s.fill < n ? 64 - s.fill : n;
+        memcpy(s.block + s.fill, p, take);
+        s.fill += take;
+        p += take;
+        n -= take;
+        if (s.fill == 64) {
+            shaBlock(s, s.block);
+            s.fill = 0;
+        }
+    }
+}
+
+static void shaFinal(Sha256 &s, uint8_t out[32]) {
+    uint64_t bits = s.total * 8;
+    uint8_t pad = 0x80;
+    shaUpdate(s, &pad, 1);
+    pad = 0;
+    while (s.fill != 56) shaUpdate(s, &pad, 1);
+    uint8_t len[8];
+    for (int i = 0; i < 8; i++) len[i] = (uint8_t)(bits >> (56 - 8 * i));
+    shaUpdate(s, len, 8);
+    for (int i = 0; i < 8; i++) {
+        out[4 * i] = (uint8_t)(s.h[i] >> 24);
+        out[4 * i + 1] = (uint8_t)(s.h[i] >> 16);
+        out[4 * i + 2] = (uint8_t)(s.h[i] >> 8);
+        out[4 * i + 3] = (uint8_t)s.h[i];
+    }
+}
+
+void sha256(const uint8_t *data, size_t len, uint8_t out[32]) {
+    Sha256 s;
+    shaInit(s);
+    shaUpdate(s, data, len);
+    shaFinal(s, out);
+}
+
+void hmacSha256(const uint8_t *key, size_t keyLen, const uint8_t *msg, size_t msgLen, uint8_t out[32]) {
+    uint8_t k[64] = {0};
+    if (keyLen > 64) sha256(key, keyLen, k);
+    else memcpy(k, key, keyLen);
+
+    uint8_t pad[64], inner[32];
+    Sha256 s;
+    for (int i = 0; i < 64; i++) pad[i] = k[i] ^ 0x36;
+    shaInit(s);
+    shaUpdate(s, pad, 64);
+    shaUpdate(s, msg, msgLen);
+    shaFinal(s, inner);
+    for (int i = 0; i < 64; i++) pad[i] = k[i] ^ 0x5c;
+    shaInit(s);
+    shaUpdate(s, pad, 64);
+    shaUpdate(s, inner, 32);
+    shaFinal(s, out);
+}
+
+void meshAuthTag(const uint8_t *key, size_t keyLen, uint32_t target, uint32_t seq, const char *cmd,
+                 char tag[MESH_AUTH_TAG_HEX + 1]) {
+    char msg[320];
+    int n = target ? snprintf(msg, sizeof(msg), "%08lX %lu %s", (unsigned long)target, (unsigned long)seq, cmd)
+                   : snprintf(msg, sizeof(msg), "ALL %lu %s", (unsigned long)seq, cmd);
+    if (n < 0) n = 0;
+    if ((size_t)n >= sizeof(msg)) n = sizeof(msg) - 1;
+    uint8_t mac[32];
+    hmacSha256(key, keyLen, (const uint8_t *)msg, (size_t)n, mac);
+    for (size_t i = 0; i < MESH_AUTH_TAG_HEX / 2; i++) snprintf(tag + 2 * i, 3, "%02x", mac[i]);
+    tag[MESH_AUTH_TAG_HEX] = 0;
+}
+
+bool meshAuthSplit(char *cmd, uint32_t &seq, const char *&tag) {
+    char *hash = strrchr(cmd, '#');
+    if (!hash || hash == cmd || hash[-1] != ' ') return false;
+    char *end = nullptr;
+    unsigned long v = strtoul(hash + 1, &end, 10);
+    if (end == hash + 1 || *end != '.') return false;
+    const char *t = end + 1;
+    size_t len = strlen(t);
+    while (len && isspace((unsigned char)t[len - 1])) len--;
+    if (len != MESH_AUTH_TAG_HEX) return false;
+    for (size_t i = 0; i < len; i++) {
+        if (!isxdigit((unsigned char)t[i])) return false;
+    }
+    end[1 + len] = 0;
+    seq = (uint32_t)v;
+    tag = t;
+    // Drop the suffix and the space before it
+    char *p = hash - 1;
+    while (p > cmd && p[-1] == ' ') p--;
+    *p = 0;
+    return true;
+}
+
+bool meshAuthTagEqual(const char *a, const char *b) {
+    uint8_t diff = 0;
+    for (size_t i = 0; i < MESH_AUTH_TAG_HEX; i++) diff |= (uint8_t)(tolower((unsigned char)a[i]) ^ tolower((unsigned char)b[i]));
+    return diff == 0;
+}
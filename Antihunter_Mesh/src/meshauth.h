@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Mesh command authentication. Any node on the channel can send AH:CMD,
+// so every command carries " #<seq>.<tag>" after its text, where tag is
+// the first 16 hex digits of HMAC-SHA256(key, "<TARGET> <seq> <command>")
+// and TARGET is "ALL" or the 8-digit node id. seq must grow with every
+// command (a Unix time works); a node refuses any seq at or below the last
+// one it accepted, so captured commands cannot be replayed. Plain C++ so
+// tools/meshsign.cpp produces the same tags on the host.
+
+static const size_t MESH_AUTH_TAG_HEX = 16;
+static const size_t MESH_AUTH_MAX_KEY = 64;
+
+void sha256(const uint8_t *data, size_t len, uint8_t out[32]);
+void hmacSha256(const uint8_t *key, size_t keyLen, const uint8_t *msg, size_t msgLen, uint8_t out[32]);
+// Writes MESH_AUTH_TAG_HEX hex digits and a terminator to tag
+void meshAuthTag(const uint8_t *key, size_t keyLen, uint32_t target, uint32_t seq, const char *cmd,
+                 char tag[MESH_AUTH_TAG_HEX + 1]);
+// Splits " #<seq>.<tag>" off the end of cmd in place. Returns false when
+// the suffix is missing or malformed.
+bool meshAuthSplit(char *cmd, uint32_t &seq, const char *&tag);
+// Constant-time tag comparison
+bool meshAuthTagEqual(const char *a, const char *b);
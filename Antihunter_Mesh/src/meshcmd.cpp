@@ -0,0 +1,551 @@
+#include "meshcmd.h"
+#include "meshlink.h"
+#include "meshproto.h"
+#include "meshqueue.h"
+#include "meshauth.h"
+#include "chanplan.h"
+#include "fusion.h"
+#include "locate.h"
+#include "network.h"
+#include "scanner.h"
+#include "hardware.h"
+#include <Preferences.h>
+#include <stdarg.h>
+#include <strings.h>
+
+// Upper bound on how long the task sleeps when no bytes arrive; the channel
+// plan and send queue are serviced on the same cadence
+static const uint32_t MESH_TICK_MS = 100;
+
+static const uint32_t FUSION_EXPIRE_MS = 5000;
+static const uint32_t LOCATE_INTERVAL_MS = 1000;
+// Reports further apart than this describe different target positions
+static const uint32_t LOCATE_ALIGN_S = 10;
+
+static TaskHandle_t meshRxTaskHandle = nullptr;
+static uint32_t commandCount = 0;
+
+// Shared command key and the highest sequence accepted with it, both in NVS
+static uint8_t authKey[MESH_AUTH_MAX_KEY];
+static size_t authKeyLen = 0;
+static uint32_t authLastSeq = 0;
+static uint32_t authRejected = 0;
+
+// Merged view of target sightings from this node and every peer
+static FusionTable fusion;
+static SemaphoreHandle_t fusionLock = nullptr;
+
+// Per-node RSSI corrections for radio and antenna differences, persisted
+struct NodeCalibration {
+    uint32_t nodeId;
+    float offsetDb;
+};
+static NodeCalibration nodeCal[FUSION_MAX_NODES];
+static size_t nodeCalCount = 0;
+
+extern Preferences prefs;
+
+extern ScanMode currentScanMode;
+extern int parseMacList(const String &in, uint8_t out[][6], size_t maxCount);
+extern String macFmt6(const uint8_t *m);
+
+static void meshReply(const char *fmt, ...) {
+    char msg[MAX_MESH_SIZE];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+
+    Serial.printf("[MESH] %s\n", msg);
+    if (meshLink().availableForWrite() >= (int)strlen(msg) + 2) {
+        meshLink().println(msg);
+    }
+}
+
+static bool parseScanMode(const char *s, ScanMode &mode) {
+    if (!s) return false;
+    if (strcasecmp(s, "wifi") == 0) mode = SCAN_WIFI;
+    else if (strcasecmp(s, "ble") == 0) mode = SCAN_BLE;
+    else if (strcasecmp(s, "both") == 0) mode = SCAN_BOTH;
+    else return false;
+    return true;
+}
+
+static void replyStatus() {
+    const char *mode = (currentScanMode == SCAN_WIFI) ? "WiFi" :
+                       (currentScanMode == SCAN_BLE) ? "BLE" : "WiFi+BLE";
+    // Sessions share the radio, so several can be reported at once
+    uint8_t subs = radioSubscribers();
+    char task[24] = "";
+    if (subs & RADIO_SUB_TARGETS) strcat(task, "scan+");
+    if (subs & RADIO_SUB_TRACKER) strcat(task, "track+");
+    if (subs & RADIO_SUB_DETECTORS) strcat(task, "blueteam+");
+    if (task[0]) task[strlen(task) - 1] = 0;
+    else strcpy(task, "idle");
+    char gps[32] = "none";
+    GpsFix fix = getGpsFix();
+    if (fix.valid) snprintf(gps, sizeof(gps), "%.5f,%.5f", fix.lat, fix.lon);
+
+    meshReply("AH:STATUS %08lX %s mode=%s hits=%d uniq=%u targets=%u frames=%u ble=%u gps=%s",
+              (unsigned long)meshNodeId(), task, mode, (int)totalHits, (unsigned)uniqueMacs.size(),
+              (unsigned)getTargetCount(), (unsigned)framesSeen, (unsigned)bleFramesSeen, gps);
+}
+
+static bool updateTargets(const char *op, const char *list, String &err) {
+    TargetUpdateMode mode;
+    if (strcasecmp(op, "CLEAR") == 0) {
+        mode = TARGETS_REPLACE;
+        list = "";
+    } else if (strcasecmp(op, "SET") == 0 && list) {
+        mode = TARGETS_REPLACE;
+    } else if (strcasecmp(op, "ADD") == 0 && list) {
+        mode = TARGETS_ADD;
+    } else if (strcasecmp(op, "DEL") == 0 && list) {
+        mode = TARGETS_REMOVE;
+    } else {
+        err = "usage: TARGETS SET|ADD|DEL|CLEAR [mac,...]";
+        return false;
+    }
+    String summary;
+    if (!applyTargetText(mode, list, strlen(list), summary)) {
+        err = summary;
+        return false;
+    }
+    return true;
+}
+
+// Checks and strips the " #seq.tag" suffix; see meshauth.h
+static bool authenticateCommand(uint32_t target, char *buf) {
+    uint32_t seq;
+    const char *tag;
+    const char *why = nullptr;
+    char expect[MESH_AUTH_TAG_HEX + 1];
+    if (!authKeyLen) {
+        why = "no command key set";
+    } else if (!meshAuthSplit(buf, seq, tag)) {
+        why = "unsigned";
+    } else {
+        meshAuthTag(authKey, authKeyLen, target, seq, buf, expect);
+        if (!meshAuthTagEqual(tag, expect)) why = "bad tag";
+        else if (seq <= authLastSeq) why = "replayed sequence";
+    }
+    if (why) {
+        authRejected++;
+        Serial.printf("[MESH] Command rejected (%s): %s\n", why, buf);
+        return false;
+    }
+    authLastSeq = seq;
+    prefs.putUInt("meshseq", authLastSeq);
+    return true;
+}
+
+bool dispatchMeshCommand(uint32_t target, const char *cmd) {
+    if (target != 0 && target != meshNodeId()) return false;
+
+    char buf[MAX_MESH_SIZE];
+    strncpy(buf, cmd, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = 0;
+    if (!authenticateCommand(target, buf)) return false;
+
+    char *save = nullptr;
+    char *verb = strtok_r(buf, " ", &save);
+    if (!verb) return false;
+
+    commandCount++;
+    Serial.printf("[MESH] Command: %s\n", cmd);
+    unsigned long id = (unsigned long)meshNodeId();
+
+    if (strcasecmp(verb, "STATUS") == 0) {
+        replyStatus();
+        return true;
+    }
+
+    if (strcasecmp(verb, "STOP") == 0) {
+        const char *which = strtok_r(nullptr, " ", &save);
+        uint8_t subs = which ? parseRadioSessions(which) : RADIO_SUB_ALL;
+        if (!subs) {
+            meshReply("AH:ACK %08lX STOP err unknown session", id);
+            return false;
+        }
+        radioRequestStop(subs);
+        meshReply("AH:ACK %08lX STOP ok", id);
+        return true;
+    }
+
+    if (strcasecmp(verb, "SCAN") == 0) {
+        const char *secsArg = strtok_r(nullptr, " ", &save);
+        const char *modeArg = strtok_r(nullptr, " ", &save);
+        const char *chArg = strtok_r(nullptr, " ", &save);
+        ScanMode mode = SCAN_WIFI;
+        if (modeArg && !parseScanMode(modeArg, mode)) chArg = modeArg;
+
+        int secs = secsArg ? atoi(secsArg) : 60;
+        bool ok = startListScan(secs, mode, chArg ? String(chArg) : String("1,6,11"));
+        meshReply("AH:ACK %08lX SCAN %s", id, ok ? "ok" : "busy");
+        return true;
+    }
+
+    if (strcasecmp(verb, "TRACK") == 0) {
+        const char *macArg = strtok_r(nullptr, " ", &save);
+        const char *secsArg = strtok_r(nullptr, " ", &save);
+        const char *modeArg = strtok_r(nullptr, " ", &save);
+        const char *chArg = strtok_r(nullptr, " ", &save);
+        uint8_t macs[TRACKER_MAX_TARGETS][6];
+        int count = macArg ? parseMacList(String(macArg), macs, TRACKER_MAX_TARGETS) : -1;
+        if (count <= 0) {
+            meshReply("AH:ACK %08lX TRACK err invalid MAC list", id);
+            return true;
+        }
+        ScanMode mode = SCAN_WIFI;
+        if (modeArg && !parseScanMode(modeArg, mode)) chArg = modeArg;
+
+        int secs = secsArg ? atoi(secsArg) : 180;
+        bool ok = startTracker(macs, count, secs, mode, chArg ? String(chArg) : String("6"));
+        meshReply("AH:ACK %08lX TRACK %s", id, ok ? "ok" : "busy");
+        return true;
+    }
+
+    if (strcasecmp(verb, "DETECT") == 0) {
+        const char *listArg = strtok_r(nullptr, " ", &save);
+        const char *secsArg = strtok_r(nullptr, " ", &save);
+        uint8_t mask = listArg ? parseBlueTeamDetectors(listArg) : BLUE_ALL;
+        if (!mask) {
+            meshReply("AH:ACK %08lX DETECT err usage: DETECT deauth,flood,evilap|all [secs]", id);
+            return true;
+        }
+        bool started = startBlueTeam(mask, secsArg ? atoi(secsArg) : 300);
+        meshReply("AH:ACK %08lX DETECT %s 0x%02X", id, started ? "ok" : "updated", mask);
+        return true;
+    }
+
+    if (strcasecmp(verb, "TARGETS") == 0) {
+        const char *op = strtok_r(nullptr, " ", &save);
+        const char *list = strtok_r(nullptr, "", &save);
+        String err;
+        if (op && updateTargets(op, list, err)) {
+            meshReply("AH:ACK %08lX TARGETS ok count=%u", id, (unsigned)getTargetCount());
+        } else {
+            meshReply("AH:ACK %08lX TARGETS err %s", id, err.length() ? err.c_str() : "missing op");
+        }
+        return true;
+    }
+
+    meshReply("AH:ACK %08lX %s err unknown command", id, verb);
+    return true;
+}
+
+static void handleMeshLine(const char *line) {
+    if (channelPlanHandleLine(line)) return;
+
+    // Meshtastic may prefix relayed text with the sender name, so search
+    const char *p = strstr(line, "AH:CMD ");
+    if (!p) return;
+    p += 7;
+
+    uint32_t target;
+    if (strncasecmp(p, "ALL ", 4) == 0) {
+        target = 0;
+        p += 4;
+    } else {
+        char *end = nullptr;
+        target = (uint32_t)strtoul(p, &end, 16);
+        if (end == p || *end != ' ') return;
+        if (target == 0) return;
+        p = end + 1;
+    }
+    dispatchMeshCommand(target, p);
+}
+
+// Peer clocks are not synchronised, so sightings are placed on this node's
+// clock using the receive time minus the reported age
+static void fuseFrame(MeshFrameReader &rd) {
+    const MeshHeader &hdr = rd.header();
+    uint32_t now = millis() / 1000;
+    unsigned fused = 0;
+
+    if (!fusionLock || xSemaphoreTake(fusionLock, pdMS_TO_TICKS(50)) != pdTRUE) return;
+    fusion.noteNode(hdr.nodeId, now, hdr.flags & MESH_FLAG_FIX, hdr.latE7, hdr.lonE7);
+    for (unsigned i = 0; i < rd.count(); i++) {
+        if (hdr.type == MESH_MSG_SIGHTINGS) {
+            MeshSighting s;
+            if (!rd.nextSighting(s)) break;
+            fused += fusion.ingest(hdr.nodeId, now - s.age, s.mac, s.rssi, s.count, s.isBLE, s.ch, s.name);
+        } else {
+            MeshTrackerReport t;
+            if (!rd.nextTracker(t)) break;
+            fused += fusion.ingest(hdr.nodeId, now - t.lastSeenAge, t.mac, t.rssi, 1, false, 0, nullptr);
+        }
+    }
+    xSemaphoreGive(fusionLock);
+
+    Serial.printf("[MESH] Fused %u/%u records from %08lX seq=%u\n",
+                  fused, rd.count(), (unsigned long)hdr.nodeId, hdr.seq);
+}
+
+static void handleMeshFrame(const uint8_t *payload, size_t len) {
+    MeshFrameReader rd;
+    if (!rd.open(payload, len)) return;
+
+    const MeshHeader &hdr = rd.header();
+    if (hdr.nodeId == meshNodeId()) return;
+
+    if (hdr.type == MESH_MSG_SIGHTINGS || hdr.type == MESH_MSG_TRACKER) {
+        fuseFrame(rd);
+    } else if (hdr.type == MESH_MSG_HELLO) {
+        uint16_t mask;
+        if (rd.nextHello(mask)) channelPlanHandleHello(hdr.nodeId, mask);
+    } else if (hdr.type == MESH_MSG_COMMAND) {
+        uint32_t target;
+        char text[MAX_MESH_SIZE];
+        for (unsigned i = 0; i < rd.count() && rd.nextCommand(target, text, sizeof(text)); i++) {
+            dispatchMeshCommand(target, text);
+        }
+    } else {
+        Serial.printf("[MESH] Frame from %08lX type=%u seq=%u records=%u\n",
+                      (unsigned long)hdr.nodeId, hdr.type, hdr.seq, rd.count());
+    }
+}
+
+static float nodeOffset(uint32_t nodeId) {
+    for (size_t i = 0; i < nodeCalCount; i++) {
+        if (nodeCal[i].nodeId == nodeId) return nodeCal[i].offsetDb;
+    }
+    return 0;
+}
+
+static void loadNodeCalibration() {
+    size_t n = prefs.getBytes("meshcal", nodeCal, sizeof(nodeCal));
+    nodeCalCount = n / sizeof(NodeCalibration);
+}
+
+static void loadMeshAuth() {
+    authKeyLen = prefs.getBytes("meshkey", authKey, sizeof(authKey));
+    authLastSeq = prefs.getUInt("meshseq", 0);
+}
+
+// Caller holds fusionLock
+static bool locateEntry(const FusionEntry &e, LocateResult &out) {
+    LocateSample samples[FUSION_SLOTS];
+    size_t n = 0;
+    for (uint8_t s = 0; s < e.reports; s++) {
+        const FusionReport &r = e.slot[s];
+        const FusionNode &node = fusion.node(r.node);
+        if (!node.hasFix || e.lastSeen - r.lastSeen > LOCATE_ALIGN_S) continue;
+        samples[n].lat = node.latE7 / 1e7;
+        samples[n].lon = node.lonE7 / 1e7;
+        samples[n].rssi = r.rssi;
+        samples[n].offsetDb = nodeOffset(node.nodeId);
+        n++;
+    }
+    return locateTarget(samples, n, DEFAULT_PATH_LOSS, out);
+}
+
+// What locateTrackerTargets last did for one tracker list position
+struct LocateSlot {
+    uint8_t mac[6];
+    uint32_t lastFed;
+    LocateResult last;
+};
+
+// Feeds this node's tracker readings into the fusion table once per second
+// and refreshes each target's position from every node hearing it
+static void locateTrackerTargets() {
+    static LocateSlot slots[TRACKER_MAX_TARGETS];
+
+    TrackerStatus status[TRACKER_MAX_TARGETS];
+    size_t n = getTrackerTargets(status, TRACKER_MAX_TARGETS);
+    for (size_t i = 0; i < n; i++) {
+        const TrackerStatus &t = status[i];
+        LocateSlot &slot = slots[i];
+        // TRACK and TARGETS can change the list; a position that now
+        // holds another MAC starts over
+        if (memcmp(slot.mac, t.mac, 6) != 0) {
+            memset(&slot, 0, sizeof(slot));
+            memcpy(slot.mac, t.mac, 6);
+        }
+        if (t.lastSeen == 0 || t.lastSeen == slot.lastFed) continue;
+        slot.lastFed = t.lastSeen;
+        meshFusionLocal(t.mac, t.rssi, false, 0, nullptr);
+
+        LocateResult est;
+        if (xSemaphoreTake(fusionLock, pdMS_TO_TICKS(20)) != pdTRUE) return;
+        const FusionEntry *e = fusion.find(t.mac);
+        bool ok = e && locateEntry(*e, est);
+        xSemaphoreGive(fusionLock);
+
+        if (ok && (est.lat != slot.last.lat || est.lon != slot.last.lon)) {
+            slot.last = est;
+            Serial.printf("[LOCATE] %s at %.6f,%.6f +/- %.0fx%.0fm @%.0f deg from %u nodes%s\n",
+                          macFmt6(t.mac).c_str(), est.lat, est.lon, est.semiMajor, est.semiMinor,
+                          est.bearing, est.used, est.rough ? " (rough)" : "");
+        }
+    }
+}
+
+static void onMeshReceive() {
+    if (meshRxTaskHandle) xTaskNotifyGive(meshRxTaskHandle);
+}
+
+static void meshRxTask(void *) {
+    static char line[MAX_MESH_SIZE + 1];
+    size_t len = 0;
+    MeshFrameParser parser;
+    uint32_t lastExpire = 0;
+    uint32_t lastLocate = 0;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MESH_TICK_MS));
+
+#ifdef MESH_LOOPBACK
+        // Console input stands in for traffic from peer nodes
+        while (Serial.available() > 0) {
+            uint8_t c = (uint8_t)Serial.read();
+            loopbackMeshLink().inject(&c, 1);
+        }
+#endif
+
+        while (meshLink().available() > 0) {
+            int c = meshLink().read();
+            if (c < 0) break;
+            if (parser.push((uint8_t)c)) {
+                handleMeshFrame(parser.payload(), parser.payloadLen());
+                len = 0;
+                continue;
+            }
+            if (c == '\r' || c == '\n') {
+                if (len > 0) {
+                    line[len] = 0;
+                    handleMeshLine(line);
+                    len = 0;
+                }
+            } else if (len < MAX_MESH_SIZE) {
+                line[len++] = (char)c;
+            }
+        }
+
+        if (millis() - lastExpire >= FUSION_EXPIRE_MS) {
+            lastExpire = millis();
+            if (xSemaphoreTake(fusionLock, pdMS_TO_TICKS(50)) == pdTRUE) {
+                fusion.expire(lastExpire / 1000);
+                xSemaphoreGive(fusionLock);
+            }
+        }
+
+        if (trackerMode && millis() - lastLocate >= LOCATE_INTERVAL_MS) {
+            lastLocate = millis();
+            locateTrackerTargets();
+        }
+
+        channelPlanTick();
+        meshQueueTick();
+    }
+}
+
+void startMeshRxTask() {
+    if (meshRxTaskHandle) return;
+    if (!fusionLock) fusionLock = xSemaphoreCreateMutex();
+    loadNodeCalibration();
+    loadMeshAuth();
+    xTaskCreatePinnedToCore(meshRxTask, "meshrx", 6144, nullptr, 1, &meshRxTaskHandle, 0);
+    meshLink().onReceive(&onMeshReceive);
+}
+
+uint32_t getMeshCommandCount() {
+    return commandCount;
+}
+
+bool setMeshCommandKey(const String &key) {
+    if (key.length() > MESH_AUTH_MAX_KEY) return false;
+    memcpy(authKey, key.c_str(), key.length());
+    authKeyLen = key.length();
+    // A new key starts a new sequence
+    authLastSeq = 0;
+    if (authKeyLen) prefs.putBytes("meshkey", authKey, authKeyLen);
+    else prefs.remove("meshkey");
+    prefs.putUInt("meshseq", 0);
+    return true;
+}
+
+String getMeshAuthStatus() {
+    return String("Mesh commands: ") + (authKeyLen ? "signed" : "disabled (no key)") + ", " + String(commandCount) +
+           " accepted, " + String(authRejected) + " rejected, last seq " + String(authLastSeq) + "\n";
+}
+
+void meshFusionLocal(const uint8_t mac[6], int8_t rssi, bool isBLE, uint8_t ch, const char *name) {
+    if (!fusionLock || xSemaphoreTake(fusionLock, pdMS_TO_TICKS(10)) != pdTRUE) return;
+    uint32_t now = millis() / 1000;
+    GpsFix fix = getGpsFix();
+    fusion.noteNode(meshNodeId(), now, fix.valid, (int32_t)lround(fix.lat * 1e7), (int32_t)lround(fix.lon * 1e7));
+    fusion.ingest(meshNodeId(), now, mac, rssi, 1, isBLE, ch, name);
+    xSemaphoreGive(fusionLock);
+}
+
+String getMeshFusionTable() {
+    String out;
+    if (!fusionLock || xSemaphoreTake(fusionLock, pdMS_TO_TICKS(200)) != pdTRUE) return "Fusion table busy\n";
+
+    uint32_t now = millis() / 1000;
+    char line[96];
+    snprintf(line, sizeof(line), "Fused targets: %u from %u nodes (merged %u, evicted %u)\n",
+             (unsigned)fusion.size(), (unsigned)fusion.nodeCount(),
+             (unsigned)fusion.merged(), (unsigned)fusion.evicted());
+    out += line;
+
+    for (size_t i = 0; i < fusion.capacity(); i++) {
+        const FusionEntry &e = fusion.entry(i);
+        if (!e.used) continue;
+        snprintf(line, sizeof(line), "%02X:%02X:%02X:%02X:%02X:%02X %s",
+                 e.mac[0], e.mac[1], e.mac[2], e.mac[3], e.mac[4], e.mac[5], e.isBLE ? "BLE " : "WiFi");
+        out += line;
+        if (e.name[0]) out += String(" ") + e.name;
+        snprintf(line, sizeof(line), " total=%u last=%us nodes=%u\n",
+                 (unsigned)e.total, (unsigned)(now - e.lastSeen), (unsigned)e.reports);
+        out += line;
+        for (uint8_t s = 0; s < e.reports; s++) {
+            const FusionReport &r = e.slot[s];
+            snprintf(line, sizeof(line), "  %08lX RSSI:%d max:%d x%u %us ago\n",
+                     (unsigned long)fusion.node(r.node).nodeId, r.rssi, r.rssiMax,
+                     (unsigned)r.count, (unsigned)(now - r.lastSeen));
+            out += line;
+        }
+        LocateResult est;
+        if (locateEntry(e, est)) {
+            snprintf(line, sizeof(line), "  est %.6f,%.6f +/- %.0fx%.0fm @%.0f deg%s\n",
+                     est.lat, est.lon, est.semiMajor, est.semiMinor, est.bearing, est.rough ? " rough" : "");
+            out += line;
+        }
+    }
+    xSemaphoreGive(fusionLock);
+    return out;
+}
+
+String getMeshLocate(const uint8_t mac[6]) {
+    if (!fusionLock || xSemaphoreTake(fusionLock, pdMS_TO_TICKS(200)) != pdTRUE) return "Fusion table busy\n";
+    const FusionEntry *e = fusion.find(mac);
+    LocateResult est;
+    bool ok = e && locateEntry(*e, est);
+    uint8_t reports = e ? e->reports : 0;
+    xSemaphoreGive(fusionLock);
+
+    String out = macFmt6(mac) + " ";
+    if (!ok) return out + "no fix: " + String(reports) + " node(s) reporting, need 3 with GPS\n";
+
+    char line[128];
+    snprintf(line, sizeof(line), "%.6f,%.6f +/- %.0fx%.0fm @%.0f deg rms=%.1fm nodes=%u%s\n",
+             est.lat, est.lon, est.semiMajor, est.semiMinor, est.bearing, est.rmsResidual, est.used,
+             est.rough ? " rough" : "");
+    return out + line;
+}
+
+bool setMeshNodeOffset(uint32_t nodeId, float offsetDb) {
+    size_t i = 0;
+    while (i < nodeCalCount && nodeCal[i].nodeId != nodeId) i++;
+    if (i == nodeCalCount) {
+        if (nodeCalCount >= FUSION_MAX_NODES) return false;
+        nodeCalCount++;
+    }
+    nodeCal[i].nodeId = nodeId;
+    nodeCal[i].offsetDb = offsetDb;
+    prefs.putBytes("meshcal", nodeCal, nodeCalCount * sizeof(NodeCalibration));
+    return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <Arduino.h>
+
+// Mesh receive path. A dedicated task sleeps until the link reports new
+// bytes, splits the stream into binary frames and text lines, and hands
+// presence messages to the channel plan and commands to the dispatcher.
+//
+// Text commands (binary MESH_MSG_COMMAND frames carry the same text):
+//   AH:CMD <node|ALL> SCAN <secs> [wifi|ble|both] [channels]
+//   AH:CMD <node|ALL> TRACK <mac[,mac...]> [secs] [wifi|ble|both] [channels]
+//   AH:CMD <node|ALL> STOP [scan,track,detect|all]
+//   AH:CMD <node|ALL> DETECT <deauth,flood,evilap|all> [secs]
+//   AH:CMD <node|ALL> TARGETS SET|ADD|DEL|CLEAR [mac,mac,...]
+//   AH:CMD <node|ALL> STATUS
+// secs of 0 runs until stopped. Each command is answered with an AH:ACK line.
+// Every command must end in an HMAC suffix from the shared key set on the
+// web UI (see meshauth.h, tools/meshsign.cpp); with no key set, commands
+// are refused.
+//
+// Sighting and tracker frames from peers, plus this node's own target hits,
+// feed a fusion table that merges reports of the same MAC across nodes.
+// Rows heard by three or more nodes with GPS are trilaterated; per-node
+// RSSI offsets calibrate for differing radios.
+
+void startMeshRxTask();
+bool dispatchMeshCommand(uint32_t target, const char *cmd);
+uint32_t getMeshCommandCount();
+// Empty key disables mesh commands. Resets the replay sequence.
+bool setMeshCommandKey(const String &key);
+String getMeshAuthStatus();
+void meshFusionLocal(const uint8_t mac[6], int8_t rssi, bool isBLE, uint8_t ch, const char *name);
+String getMeshFusionTable();
+String getMeshLocate(const uint8_t mac[6]);
+bool setMeshNodeOffset(uint32_t nodeId, float offsetDb);
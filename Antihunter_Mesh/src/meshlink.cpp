@@ -0,0 +1,113 @@
+#include "meshlink.h"
+#include "hardware.h"
+
+size_t MeshLink::println(const char *line) {
+    size_t n = write((const uint8_t *)line, strlen(line));
+    n += write((const uint8_t *)"\r\n", 2);
+    return n;
+}
+
+// UART link
+UartMeshLink::UartMeshLink(HardwareSerial &port, int rxPin, int txPin, uint32_t baud)
+    : port(port), rxPin(rxPin), txPin(txPin), baud(baud) {}
+
+void UartMeshLink::begin() {
+    port.begin(baud, SERIAL_8N1, rxPin, txPin);
+}
+
+size_t UartMeshLink::write(const uint8_t *data, size_t len) {
+    return port.write(data, len);
+}
+
+int UartMeshLink::availableForWrite() {
+    return port.availableForWrite();
+}
+
+int UartMeshLink::available() {
+    return port.available();
+}
+
+int UartMeshLink::read() {
+    return port.read();
+}
+
+void UartMeshLink::onReceive(ReceiveCallback cb) {
+    port.onReceive(cb);
+}
+
+// Loopback link
+void LoopbackMeshLink::begin() {
+    head = tail = 0;
+}
+
+size_t LoopbackMeshLink::write(const uint8_t *data, size_t len) {
+    return inject(data, len);
+}
+
+size_t LoopbackMeshLink::inject(const uint8_t *data, size_t len) {
+    size_t n = 0;
+    portENTER_CRITICAL(&mux);
+    while (n < len) {
+        size_t next = (head + 1) % RING_SIZE;
+        if (next == tail) break;
+        ring[head] = data[n++];
+        head = next;
+    }
+    portEXIT_CRITICAL(&mux);
+    if (n && rxCallback) rxCallback();
+    return n;
+}
+
+int LoopbackMeshLink::availableForWrite() {
+    portENTER_CRITICAL(&mux);
+    int used = (int)((head + RING_SIZE - tail) % RING_SIZE);
+    portEXIT_CRITICAL(&mux);
+    return (int)RING_SIZE - 1 - used;
+}
+
+int LoopbackMeshLink::available() {
+    portENTER_CRITICAL(&mux);
+    int used = (int)((head + RING_SIZE - tail) % RING_SIZE);
+    portEXIT_CRITICAL(&mux);
+    return used;
+}
+
+int LoopbackMeshLink::read() {
+    int c = -1;
+    portENTER_CRITICAL(&mux);
+    if (tail != head) {
+        c = ring[tail];
+        tail = (tail + 1) % RING_SIZE;
+    }
+    portEXIT_CRITICAL(&mux);
+    return c;
+}
+
+void LoopbackMeshLink::onReceive(ReceiveCallback cb) {
+    rxCallback = cb;
+}
+
+// Active link
+static UartMeshLink uartLink(Serial1, MESH_RX_PIN, MESH_TX_PIN, 115200);
+static LoopbackMeshLink loopbackLink;
+#ifdef MESH_LOOPBACK
+static MeshLink *activeLink = &loopbackLink;
+#else
+static MeshLink *activeLink = &uartLink;
+#endif
+
+MeshLink &meshLink() {
+    return *activeLink;
+}
+
+LoopbackMeshLink &loopbackMeshLink() {
+    return loopbackLink;
+}
+
+void setMeshLink(MeshLink *link) {
+    activeLink = link ? link : &uartLink;
+}
+
+bool meshLinkIsLoopback() {
+    return activeLink == &loopbackLink;
+}
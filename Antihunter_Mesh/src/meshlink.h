@@ -0,0 +1,62 @@
+#pragma once
+#include <Arduino.h>
+
+// Byte transport to the mesh radio. The UART link talks to the attached
+// Meshtastic node on Serial1; the loopback link feeds everything written
+// back into its own receive side so mesh logic can run without a radio.
+class MeshLink {
+public:
+    typedef void (*ReceiveCallback)();
+
+    virtual ~MeshLink() {}
+    virtual void begin() = 0;
+    virtual size_t write(const uint8_t *data, size_t len) = 0;
+    virtual int availableForWrite() = 0;
+    virtual int available() = 0;
+    virtual int read() = 0;
+    // Called from the link's receive context whenever new bytes arrive
+    virtual void onReceive(ReceiveCallback cb) = 0;
+
+    size_t println(const char *line);
+};
+
+class UartMeshLink : public MeshLink {
+public:
+    UartMeshLink(HardwareSerial &port, int rxPin, int txPin, uint32_t baud);
+    void begin() override;
+    size_t write(const uint8_t *data, size_t len) override;
+    int availableForWrite() override;
+    int available() override;
+    int read() override;
+    void onReceive(ReceiveCallback cb) override;
+
+private:
+    HardwareSerial &port;
+    int rxPin, txPin;
+    uint32_t baud;
+};
+
+class LoopbackMeshLink : public MeshLink {
+public:
+    void begin() override;
+    size_t write(const uint8_t *data, size_t len) override;
+    int availableForWrite() override;
+    int available() override;
+    int read() override;
+    void onReceive(ReceiveCallback cb) override;
+
+    // Queue bytes as if a peer had sent them
+    size_t inject(const uint8_t *data, size_t len);
+
+private:
+    static const size_t RING_SIZE = 1024;
+    uint8_t ring[RING_SIZE];
+    size_t head = 0, tail = 0;
+    ReceiveCallback rxCallback = nullptr;
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+MeshLink &meshLink();
+LoopbackMeshLink &loopbackMeshLink();
+void setMeshLink(MeshLink *link);
+bool meshLinkIsLoopback();
@@ -0,0 +1,282 @@
+#include "meshproto.h"
+#include <string.h>
+
+uint16_t meshCrc16(const uint8_t *data, size_t len) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+size_t meshPutVarint(uint8_t *out, uint32_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+bool meshGetVarint(const uint8_t *&p, const uint8_t *end, uint32_t &v) {
+    v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (p >= end) return false;
+        uint8_t b = *p++;
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+static inline void putU16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void putU32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static inline uint16_t getU16(const uint8_t *p) {
+    return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+static inline uint32_t getU32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint8_t packRssi(int8_t rssi) {
+    return rssi >= 0 ? 0 : (uint8_t)(-(int)rssi);
+}
+
+// Writer
+void MeshFrameWriter::begin(uint8_t *out, size_t outCap, const MeshHeader &hdr) {
+    buf = out;
+    cap = outCap < MESH_MAX_PAYLOAD + MESH_FRAME_OVERHEAD ? outCap : MESH_MAX_PAYLOAD + MESH_FRAME_OVERHEAD;
+    recCount = 0;
+    haveOui = false;
+
+    buf[0] = MESH_MAGIC0;
+    buf[1] = MESH_MAGIC1;
+    len = 3;
+    buf[len++] = (uint8_t)((MESH_PROTO_VERSION << 4) | (hdr.flags & 0x0F));
+    buf[len++] = hdr.type;
+    putU32(buf + len, hdr.nodeId);
+    len += 4;
+    putU16(buf + len, hdr.seq);
+    len += 2;
+    len += meshPutVarint(buf + len, hdr.time);
+    if (hdr.flags & MESH_FLAG_FIX) {
+        putU32(buf + len, (uint32_t)hdr.latE7);
+        putU32(buf + len + 4, (uint32_t)hdr.lonE7);
+        len += 8;
+    }
+    countPos = len;
+    buf[len++] = 0;
+}
+
+bool MeshFrameWriter::append(const uint8_t *rec, size_t n) {
+    if (recCount == 255 || len + n + 2 > cap) return false;
+    memcpy(buf + len, rec, n);
+    len += n;
+    buf[countPos] = ++recCount;
+    return true;
+}
+
+bool MeshFrameWriter::addSighting(const MeshSighting &s) {
+    uint8_t rec[48];
+    size_t n = 1;
+    uint8_t bits = (uint8_t)((s.ch & 0x0F) << 4);
+    if (s.isBLE) bits |= MESH_REC_BLE;
+    if (s.isNew) bits |= MESH_REC_NEW;
+
+    bool sameOui = haveOui && memcmp(lastOui, s.mac, 3) == 0;
+    if (sameOui) {
+        bits |= MESH_REC_SAME_OUI;
+        memcpy(rec + n, s.mac + 3, 3);
+        n += 3;
+    } else {
+        memcpy(rec + n, s.mac, 6);
+        n += 6;
+    }
+    rec[n++] = packRssi(s.rssi);
+    n += meshPutVarint(rec + n, s.count);
+    n += meshPutVarint(rec + n, s.age);
+
+    size_t nameLen = strnlen(s.name, sizeof(s.name) - 1);
+    if (nameLen > 0) {
+        bits |= MESH_REC_NAME;
+        rec[n++] = (uint8_t)nameLen;
+        memcpy(rec + n, s.name, nameLen);
+        n += nameLen;
+    }
+    rec[0] = bits;
+
+    if (!append(rec, n)) return false;
+    memcpy(lastOui, s.mac, 3);
+    haveOui = true;
+    return true;
+}
+
+bool MeshFrameWriter::addTracker(const MeshTrackerReport &t) {
+    uint8_t rec[20];
+    size_t n = 0;
+    memcpy(rec, t.mac, 6);
+    n += 6;
+    rec[n++] = packRssi(t.rssi);
+    n += meshPutVarint(rec + n, t.packets);
+    n += meshPutVarint(rec + n, t.lastSeenAge);
+    return append(rec, n);
+}
+
+bool MeshFrameWriter::addHello(uint16_t chanMask) {
+    uint8_t rec[2];
+    putU16(rec, chanMask);
+    return append(rec, 2);
+}
+
+bool MeshFrameWriter::addCommand(uint32_t target, const char *text) {
+    uint8_t rec[5 + MESH_MAX_PAYLOAD];
+    size_t textLen = strnlen(text, 255);
+    if (textLen > MESH_MAX_PAYLOAD) return false;
+    putU32(rec, target);
+    rec[4] = (uint8_t)textLen;
+    memcpy(rec + 5, text, textLen);
+    return append(rec, 5 + textLen);
+}
+
+size_t MeshFrameWriter::finish() {
+    size_t payloadLen = len - 3;
+    buf[2] = (uint8_t)payloadLen;
+    putU16(buf + len, meshCrc16(buf + 3, payloadLen));
+    len += 2;
+    return len;
+}
+
+// Reader
+bool MeshFrameReader::open(const uint8_t *payload, size_t n) {
+    p = payload;
+    end = payload + n;
+    haveOui = false;
+    if (n < 8 || (p[0] >> 4) != MESH_PROTO_VERSION) return false;
+
+    hdr.flags = p[0] & 0x0F;
+    hdr.type = p[1];
+    hdr.nodeId = getU32(p + 2);
+    hdr.seq = getU16(p + 6);
+    p += 8;
+    if (!meshGetVarint(p, end, hdr.time)) return false;
+
+    hdr.latE7 = hdr.lonE7 = 0;
+    if (hdr.flags & MESH_FLAG_FIX) {
+        if (end - p < 8) return false;
+        hdr.latE7 = (int32_t)getU32(p);
+        hdr.lonE7 = (int32_t)getU32(p + 4);
+        p += 8;
+    }
+    if (p >= end) return false;
+    recCount = *p++;
+    return true;
+}
+
+bool MeshFrameReader::nextSighting(MeshSighting &s) {
+    if (p >= end) return false;
+    uint8_t bits = *p++;
+    s.isBLE = bits & MESH_REC_BLE;
+    s.isNew = bits & MESH_REC_NEW;
+    s.ch = bits >> 4;
+
+    if (bits & MESH_REC_SAME_OUI) {
+        if (!haveOui || end - p < 3) return false;
+        memcpy(s.mac, lastOui, 3);
+        memcpy(s.mac + 3, p, 3);
+        p += 3;
+    } else {
+        if (end - p < 6) return false;
+        memcpy(s.mac, p, 6);
+        p += 6;
+    }
+    memcpy(lastOui, s.mac, 3);
+    haveOui = true;
+
+    if (p >= end) return false;
+    s.rssi = (int8_t)(-(int)*p++);
+    uint32_t count;
+    if (!meshGetVarint(p, end, count) || !meshGetVarint(p, end, s.age)) return false;
+    s.count = count > 0xFFFF ? 0xFFFF : (uint16_t)count;
+
+    s.name[0] = 0;
+    if (bits & MESH_REC_NAME) {
+        if (p >= end) return false;
+        size_t n = *p++;
+        if ((size_t)(end - p) < n) return false;
+        size_t keep = n < sizeof(s.name) - 1 ? n : sizeof(s.name) - 1;
+        memcpy(s.name, p, keep);
+        s.name[keep] = 0;
+        p += n;
+    }
+    return true;
+}
+
+bool MeshFrameReader::nextTracker(MeshTrackerReport &t) {
+    if (end - p < 7) return false;
+    memcpy(t.mac, p, 6);
+    t.rssi = (int8_t)(-(int)p[6]);
+    p += 7;
+    return meshGetVarint(p, end, t.packets) && meshGetVarint(p, end, t.lastSeenAge);
+}
+
+bool MeshFrameReader::nextHello(uint16_t &chanMask) {
+    if (end - p < 2) return false;
+    chanMask = getU16(p);
+    p += 2;
+    return true;
+}
+
+bool MeshFrameReader::nextCommand(uint32_t &target, char *text, size_t cap) {
+    if (end - p < 5 || cap == 0) return false;
+    target = getU32(p);
+    size_t n = p[4];
+    p += 5;
+    if ((size_t)(end - p) < n) return false;
+    size_t keep = n < cap - 1 ? n : cap - 1;
+    memcpy(text, p, keep);
+    text[keep] = 0;
+    p += n;
+    return true;
+}
+
+// Stream parser
+bool MeshFrameParser::push(uint8_t c) {
+    switch (state) {
+    case 0:
+        if (c == MESH_MAGIC0) state = 1;
+        return false;
+    case 1:
+        state = (c == MESH_MAGIC1) ? 2 : (c == MESH_MAGIC0 ? 1 : 0);
+        return false;
+    case 2:
+        if (c == 0 || c > MESH_MAX_PAYLOAD) {
+            state = (c == MESH_MAGIC0) ? 1 : 0;
+            return false;
+        }
+        len = c;
+        pos = 0;
+        state = 3;
+        return false;
+    default:
+        buf[pos++] = c;
+        if (pos < len + 2) return false;
+        state = 0;
+        if (getU16(buf + len) != meshCrc16(buf, len)) {
+            badCrc++;
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Binary mesh frames. Plain C++ with no Arduino dependencies so the same
+// codec builds on the host for decoding captures.
+//
+// Frame:   A5 7E | len u8 | payload[len] | crc16 LE (CCITT-FALSE over payload)
+// Payload: ver<<4|flags | type | node u32 | seq u16 | time varint
+//          [lat_e7 i32, lon_e7 i32 if MESH_FLAG_FIX] | count u8 | records
+//
+// Sighting record: bits(ch<<4 | SAME_OUI | NAME | NEW | BLE) | mac[6] or
+//                  mac[3..5] when SAME_OUI | -rssi u8 | count varint |
+//                  age varint | [name len u8 + bytes]
+// Tracker record:  mac[6] | -rssi u8 | packets varint | lastSeen age varint
+// Hello record:    channel mask u16 LE (0 = node leaving the channel plan)
+// Command record:  target node u32 (0 = all) | len u8 | command text
+
+static const uint8_t MESH_MAGIC0 = 0xA5;
+static const uint8_t MESH_MAGIC1 = 0x7E;
+static const uint8_t MESH_PROTO_VERSION = 1;
+static const size_t MESH_FRAME_OVERHEAD = 5;
+static const size_t MESH_MAX_PAYLOAD = 225;
+
+enum MeshMsgType : uint8_t {
+    MESH_MSG_SIGHTINGS = 1,
+    MESH_MSG_TRACKER = 2,
+    MESH_MSG_HELLO = 3,
+    MESH_MSG_COMMAND = 4
+};
+
+static const uint8_t MESH_FLAG_FIX = 0x01;
+// time is GPS-disciplined Unix seconds rather than sender uptime
+static const uint8_t MESH_FLAG_UTC = 0x02;
+
+static const uint8_t MESH_REC_BLE = 0x01;
+static const uint8_t MESH_REC_NEW = 0x02;
+static const uint8_t MESH_REC_NAME = 0x04;
+static const uint8_t MESH_REC_SAME_OUI = 0x08;
+
+struct MeshHeader {
+    uint8_t type;
+    uint8_t flags;
+    uint32_t nodeId;
+    uint16_t seq;
+    uint32_t time;
+    int32_t latE7;
+    int32_t lonE7;
+};
+
+struct MeshSighting {
+    uint8_t mac[6];
+    int8_t rssi;
+    uint8_t ch;
+    bool isBLE;
+    bool isNew;
+    uint16_t count;
+    uint32_t age;
+    char name[24];
+};
+
+struct MeshTrackerReport {
+    uint8_t mac[6];
+    int8_t rssi;
+    uint32_t packets;
+    uint32_t lastSeenAge;
+};
+
+uint16_t meshCrc16(const uint8_t *data, size_t len);
+size_t meshPutVarint(uint8_t *out, uint32_t v);
+bool meshGetVarint(const uint8_t *&p, const uint8_t *end, uint32_t &v);
+
+// Builds one frame in a caller-supplied buffer. add*() returns false and
+// leaves the frame untouched when the record would not fit.
+class MeshFrameWriter {
+public:
+    void begin(uint8_t *buf, size_t cap, const MeshHeader &hdr);
+    bool addSighting(const MeshSighting &s);
+    bool addTracker(const MeshTrackerReport &t);
+    bool addHello(uint16_t chanMask);
+    bool addCommand(uint32_t target, const char *text);
+    size_t finish();
+    uint8_t count() const { return recCount; }
+
+private:
+    bool append(const uint8_t *rec, size_t n);
+
+    uint8_t *buf = nullptr;
+    size_t cap = 0;
+    size_t len = 0;
+    size_t countPos = 0;
+    uint8_t recCount = 0;
+    uint8_t lastOui[3];
+    bool haveOui = false;
+};
+
+// Walks the records of a validated payload
+class MeshFrameReader {
+public:
+    bool open(const uint8_t *payload, size_t len);
+    const MeshHeader &header() const { return hdr; }
+    uint8_t count() const { return recCount; }
+    bool nextSighting(MeshSighting &s);
+    bool nextTracker(MeshTrackerReport &t);
+    bool nextHello(uint16_t &chanMask);
+    bool nextCommand(uint32_t &target, char *text, size_t cap);
+
+private:
+    MeshHeader hdr;
+    const uint8_t *p = nullptr;
+    const uint8_t *end = nullptr;
+    uint8_t recCount = 0;
+    uint8_t lastOui[3];
+    bool haveOui = false;
+};
+
+// Byte-at-a-time frame sync. Bytes that are not part of a frame (text
+// traffic, line noise) are skipped; push() returns true once a frame with
+// a valid CRC is complete and payload()/payloadLen() describe it.
+class MeshFrameParser {
+public:
+    bool push(uint8_t c);
+    const uint8_t *payload() const { return buf; }
+    size_t payloadLen() const { return len; }
+    uint32_t crcErrors() const { return badCrc; }
+    void reset() { state = 0; }
+
+private:
+    uint8_t buf[MESH_MAX_PAYLOAD + 2];
+    size_t len = 0;
+    size_t pos = 0;
+    uint8_t state = 0;
+    uint32_t badCrc = 0;
+};
@@ -0,0 +1,282 @@
+#include "meshqueue.h"
+#include "meshlink.h"
+#include "meshproto.h"
+#include "chanplan.h"
+#include "hardware.h"
+#include "timesync.h"
+#include "network.h"
+
+// One message per token; a full bucket allows a short burst after a quiet
+// period while the long-run rate stays at one message per MESH_TOKEN_MS.
+static const uint32_t MESH_BUCKET_SIZE = 3;
+static const uint32_t MESH_TOKEN_MS = 5000;
+// Wait this long after the first pending item so a burst shares a message
+static const uint32_t MESH_LINGER_MS = 750;
+static const uint8_t RING_CAP = 24;
+
+struct MeshRing {
+    MeshItem items[RING_CAP];
+    uint8_t head;
+    uint8_t count;
+};
+
+static MeshRing rings[MESH_PRIO_COUNT];
+static SemaphoreHandle_t queueLock = nullptr;
+static uint32_t creditMs = MESH_BUCKET_SIZE * MESH_TOKEN_MS;
+static uint32_t lastRefill = 0;
+static uint32_t firstPendingAt = 0;
+static uint16_t frameSeq = 0;
+// Type of the last binary frame sent; the two types alternate when both wait
+static bool lastFrameSightings = false;
+
+static uint32_t msgsSent = 0;
+static uint32_t itemsSent = 0;
+static uint32_t itemsMerged = 0;
+static uint32_t itemsDropped = 0;
+
+static inline MeshItem &ringAt(MeshRing &r, uint8_t i) {
+    return r.items[(r.head + i) % RING_CAP];
+}
+
+static size_t pendingCount() {
+    size_t n = 0;
+    for (auto &r : rings) n += r.count;
+    return n;
+}
+
+static MeshItem *findPending(const MeshItem &item) {
+    for (auto &r : rings) {
+        for (uint8_t i = 0; i < r.count; i++) {
+            MeshItem &e = ringAt(r, i);
+            if (e.kind == item.kind && memcmp(e.mac, item.mac, 6) == 0) return &e;
+        }
+    }
+    return nullptr;
+}
+
+static int formatItem(const MeshItem &e, char *out, size_t cap) {
+    char mac[18];
+    snprintf(mac, sizeof(mac), "%02x:%02x:%02x:%02x:%02x:%02x",
+             e.mac[0], e.mac[1], e.mac[2], e.mac[3], e.mac[4], e.mac[5]);
+
+    if (e.kind == MESH_ITEM_TRACKER) {
+        uint32_t ago = e.lastSeen ? (millis() - e.lastSeen) / 1000 : 999;
+        return snprintf(out, cap, "Tracking: %s RSSI:%ddBm LastSeen:%us Pkts:%u",
+                        mac, (int)e.rssi, (unsigned)ago, (unsigned)e.packets);
+    }
+
+    int n = snprintf(out, cap, "Target: %s %s RSSI:%d", e.isBLE ? "BLE" : "WiFi", mac, (int)e.rssi);
+    if (n > 0 && (size_t)n < cap && e.name[0] && strcmp(e.name, "WiFi") != 0) {
+        n += snprintf(out + n, cap - n, " Name:%s", e.name);
+    }
+    if (n > 0 && (size_t)n < cap && e.count > 1) {
+        n += snprintf(out + n, cap - n, " x%u", (unsigned)e.count);
+    }
+    return n;
+}
+
+// Caller holds queueLock. Packs text entries in priority order until the
+// next one does not fit; take[] receives how many leave each ring.
+static size_t packText(char *msg, size_t cap, uint8_t *take) {
+    size_t len = 0;
+    bool full = false;
+
+    for (int p = 0; p < MESH_PRIO_COUNT && !full; p++) {
+        MeshRing &r = rings[p];
+        for (uint8_t i = 0; i < r.count; i++) {
+            char entry[MAX_MESH_SIZE];
+            int n = formatItem(ringAt(r, i), entry, sizeof(entry));
+            if (n <= 0) {
+                take[p]++;
+                continue;
+            }
+            size_t sep = len ? 3 : 0;
+            if (len + sep + (size_t)n >= cap) {
+                full = true;
+                break;
+            }
+            if (sep) memcpy(msg + len, " | ", 3);
+            memcpy(msg + len + sep, entry, n);
+            len += sep + n;
+            take[p]++;
+        }
+    }
+    msg[len] = 0;
+    return len;
+}
+
+// Caller holds queueLock. A frame carries one record type: sightings (new,
+// then repeat) or tracker status. When both are pending they take turns, so
+// a steady stream of sightings cannot starve the tracker reports.
+static size_t packBinary(uint8_t *frame, size_t cap, uint8_t *take, uint32_t now) {
+    bool sightings = rings[MESH_PRIO_NEW_TARGET].count || rings[MESH_PRIO_REPEAT].count;
+    if (sightings && rings[MESH_PRIO_TRACKER].count && lastFrameSightings) sightings = false;
+
+    MeshHeader hdr = {};
+    hdr.type = sightings ? MESH_MSG_SIGHTINGS : MESH_MSG_TRACKER;
+    hdr.nodeId = meshNodeId();
+    hdr.seq = frameSeq;
+    hdr.time = now / 1000;
+    UtcStamp utc = utcNow();
+    if (utc.valid && utc.uncUs < 1000000) {
+        hdr.flags |= MESH_FLAG_UTC;
+        hdr.time = utc.sec;
+    }
+    GpsFix fix = getGpsFix();
+    if (fix.valid) {
+        hdr.flags |= MESH_FLAG_FIX;
+        hdr.latE7 = (int32_t)lround(fix.lat * 1e7);
+        hdr.lonE7 = (int32_t)lround(fix.lon * 1e7);
+    }
+
+    MeshFrameWriter w;
+    w.begin(frame, cap, hdr);
+
+    int first = sightings ? MESH_PRIO_NEW_TARGET : MESH_PRIO_TRACKER;
+    int last = sightings ? MESH_PRIO_REPEAT : MESH_PRIO_TRACKER;
+    bool full = false;
+    for (int p = first; p <= last && !full; p++) {
+        MeshRing &r = rings[p];
+        for (uint8_t i = 0; i < r.count; i++) {
+            const MeshItem &e = ringAt(r, i);
+            bool added;
+            if (e.kind == MESH_ITEM_TRACKER) {
+                MeshTrackerReport t;
+                memcpy(t.mac, e.mac, 6);
+                t.rssi = e.rssi;
+                t.packets = e.packets;
+                t.lastSeenAge = e.lastSeen ? (now - e.lastSeen) / 1000 : 0xFFFF;
+                added = w.addTracker(t);
+            } else {
+                MeshSighting s;
+                memcpy(s.mac, e.mac, 6);
+                s.rssi = e.rssi;
+                s.ch = e.ch;
+                s.isBLE = e.isBLE;
+                s.isNew = (p == MESH_PRIO_NEW_TARGET);
+                s.count = e.count;
+                s.age = (now - e.lastSeen) / 1000;
+                memcpy(s.name, e.name, sizeof(s.name));
+                if (!s.isBLE && strcmp(s.name, "WiFi") == 0) s.name[0] = 0;
+                added = w.addSighting(s);
+            }
+            if (!added) {
+                full = true;
+                break;
+            }
+            take[p]++;
+        }
+    }
+
+    if (w.count() == 0) return 0;
+    return w.finish();
+}
+
+void initMeshQueue() {
+    queueLock = xSemaphoreCreateMutex();
+    lastRefill = millis();
+}
+
+bool meshEnqueue(const MeshItem &item, MeshPriority prio) {
+    if (!queueLock) return false;
+    if (prio >= MESH_PRIO_COUNT) prio = MESH_PRIO_TRACKER;
+
+    xSemaphoreTake(queueLock, portMAX_DELAY);
+    if (MeshItem *e = findPending(item)) {
+        e->rssi = item.rssi;
+        e->ch = item.ch;
+        e->lastSeen = item.lastSeen;
+        e->packets = item.packets;
+        e->count += item.count ? item.count : 1;
+        if (item.name[0]) memcpy(e->name, item.name, sizeof(e->name));
+        itemsMerged++;
+    } else {
+        MeshRing &r = rings[prio];
+        if (r.count == RING_CAP) {
+            // Oldest entry of the same class gives way
+            r.head = (r.head + 1) % RING_CAP;
+            r.count--;
+            itemsDropped++;
+        }
+        if (pendingCount() == 0) firstPendingAt = millis();
+        MeshItem &slot = ringAt(r, r.count);
+        slot = item;
+        if (slot.count == 0) slot.count = 1;
+        slot.name[sizeof(slot.name) - 1] = 0;
+        r.count++;
+    }
+    xSemaphoreGive(queueLock);
+    return true;
+}
+
+void meshQueueTick() {
+    if (!queueLock) return;
+
+    uint32_t now = millis();
+    creditMs += now - lastRefill;
+    if (creditMs > MESH_BUCKET_SIZE * MESH_TOKEN_MS) creditMs = MESH_BUCKET_SIZE * MESH_TOKEN_MS;
+    lastRefill = now;
+
+    if (creditMs < MESH_TOKEN_MS) return;
+
+    xSemaphoreTake(queueLock, portMAX_DELAY);
+    if (pendingCount() == 0 || now - firstPendingAt < MESH_LINGER_MS) {
+        xSemaphoreGive(queueLock);
+        return;
+    }
+
+    uint8_t msg[MAX_MESH_SIZE + 1];
+    uint8_t take[MESH_PRIO_COUNT] = {0};
+    size_t len = meshBinaryFormat ? packBinary(msg, MAX_MESH_SIZE, take, now)
+                                  : packText((char *)msg, MAX_MESH_SIZE, take);
+
+    // The UART keeps its backlog; try again next tick rather than drop
+    if (len == 0 || meshLink().availableForWrite() < (int)len + 2) {
+        xSemaphoreGive(queueLock);
+        return;
+    }
+
+    if (meshBinaryFormat) {
+        Serial.printf("[MESH] Frame seq=%u %u bytes\n", (unsigned)frameSeq, (unsigned)len);
+        meshLink().write(msg, len);
+        frameSeq++;
+        lastFrameSightings = take[MESH_PRIO_NEW_TARGET] || take[MESH_PRIO_REPEAT];
+    } else {
+        Serial.printf("[MESH] %s\n", (char *)msg);
+        meshLink().println((char *)msg);
+    }
+    creditMs -= MESH_TOKEN_MS;
+    msgsSent++;
+
+    for (int p = 0; p < MESH_PRIO_COUNT; p++) {
+        MeshRing &r = rings[p];
+        r.head = (r.head + take[p]) % RING_CAP;
+        r.count -= take[p];
+        itemsSent += take[p];
+    }
+    firstPendingAt = now;
+    xSemaphoreGive(queueLock);
+}
+
+void meshQueueClear() {
+    if (!queueLock) return;
+    xSemaphoreTake(queueLock, portMAX_DELAY);
+    for (auto &r : rings) {
+        r.head = 0;
+        r.count = 0;
+    }
+    xSemaphoreGive(queueLock);
+}
+
+String getMeshQueueStatus() {
+    size_t pending = 0;
+    if (queueLock) {
+        xSemaphoreTake(queueLock, portMAX_DELAY);
+        pending = pendingCount();
+        xSemaphoreGive(queueLock);
+    }
+    String s = "Mesh queue: pending=" + String((unsigned)pending);
+    s += " sent=" + String((unsigned)msgsSent) + " msgs/" + String((unsigned)itemsSent) + " items";
+    s += " merged=" + String((unsigned)itemsMerged) + " dropped=" + String((unsigned)itemsDropped) + "\n";
+    return s;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <Arduino.h>
+
+// Outbound mesh queue. Items wait in per-priority rings, repeat sightings of
+// a pending MAC are merged in place, and a token bucket decides when the
+// next message goes out. Each message packs as many pending items as fit
+// in MAX_MESH_SIZE, highest priority first.
+enum MeshPriority : uint8_t {
+    MESH_PRIO_NEW_TARGET = 0,
+    MESH_PRIO_REPEAT,
+    MESH_PRIO_TRACKER,
+    MESH_PRIO_COUNT
+};
+
+enum MeshItemKind : uint8_t {
+    MESH_ITEM_TARGET = 0,
+    MESH_ITEM_TRACKER
+};
+
+struct MeshItem {
+    uint8_t kind;
+    uint8_t mac[6];
+    int8_t rssi;
+    uint8_t ch;
+    bool isBLE;
+    uint16_t count;      // sightings merged into this entry
+    uint32_t lastSeen;   // millis() of the latest sighting
+    uint32_t packets;    // tracker only
+    char name[24];
+};
+
+const int MAX_MESH_SIZE = 230;
+
+void initMeshQueue();
+bool meshEnqueue(const MeshItem &item, MeshPriority prio);
+void meshQueueTick();
+void meshQueueClear();
+String getMeshQueueStatus();
@@ -1,7 +1,21 @@
 #include "network.h"
 #include "hardware.h"
 #include "scanner.h"
+#include "meshlink.h"
+#include "chanplan.h"
+#include "meshqueue.h"
+#include "meshcmd.h"
+#include "timesync.h"
+#include "geostore.h"
+#include "devhistory.h"
+#include "blematch.h"
+#include "rpa.h"
+#include "probefp.h"
+#include "apwatch.h"
 #include <AsyncTCP.h>
+#include <array>
+#include <atomic>
+#include <memory>
 
 extern "C"
 {
@@ -12,25 +26,29 @@ extern "C"
 
 AsyncWebServer *server = nullptr;
 bool meshEnabled = true;
-static unsigned long lastMeshSend = 0;
-const unsigned long MESH_SEND_INTERVAL = 10000;
-const int MAX_MESH_SIZE = 230;
+bool meshBinaryFormat = false;
 
 // External references
 extern Preferences prefs;
-extern volatile bool stopRequested;
 extern ScanMode currentScanMode;
 extern int cfgBeeps, cfgGapMs;
-extern String lastResults;
 extern std::vector<uint8_t> CHANNELS;
 extern TaskHandle_t workerTaskHandle;
+extern TaskHandle_t trackerTaskHandle;
 extern TaskHandle_t blueTeamTaskHandle;
+// Web handlers and mesh commands both start tasks; this keeps the
+// handle check and the task creation one step
+static SemaphoreHandle_t taskStartLock = nullptr;
 extern String macFmt6(const uint8_t *m);
 extern bool parseMac6(const String &in, uint8_t out[6]);
+extern int parseMacList(const String &in, uint8_t out[][6], size_t maxCount);
 extern void parseChannelsCSV(const String &csv);
 
 void initializeNetwork()
 {
+  if (!taskStartLock)
+    taskStartLock = xSemaphoreCreateMutex();
+
   Serial.println("Initializing mesh UART...");
   initializeMesh();
 
@@ -95,15 +113,38 @@ a{color:var(--accent)} hr{border:0;border-top:1px dashed #003b24;margin:14px 0}
 
 <div class="grid">
   <div class="card">
-    <div class="banner">Targets: full MACs (<code>AA:BB:CC:DD:EE:FF</code>) or OUIs (<code>AA:BB:CC</code>), one per line. Used in <b>List Scan</b>.</div>
+    <div class="banner">Targets: full MACs (<code>AA:BB:CC:DD:EE:FF</code>), OUIs (<code>AA:BB:CC</code>), prefixes (<code>70:B3:D5:12:3/36</code>), wildcards (<code>AA:BB:*:*:*:01</code>); a leading <code>~</code> ignores the locally administered bit. One per line. Used in <b>List Scan</b>.</div>
     <form id="f" method="POST" action="/save">
       <label for="list">Targets</label>
       <textarea id="list" name="list" placeholder="AA:BB:CC:DD:EE:FF&#10;DC:A6:32"></textarea>
+      <label for="listFile">Or upload a file</label>
+      <input type="file" id="listFile" accept=".txt,.csv,text/plain">
+      <label for="listMode">Apply as</label>
+      <select id="listMode">
+        <option value="replace">Replace list</option>
+        <option value="add">Add to list</option>
+        <option value="remove">Remove from list</option>
+      </select>
       <div class="row" style="margin-top:10px">
         <button class="btn primary" type="submit">Save</button>
         <a class="btn" href="/export" data-ajax="false">Download</a>
       </div>
     </form>
+    <form id="bp" method="POST" action="/ble-patterns">
+      <label for="blePatterns">BLE payload patterns</label>
+      <textarea id="blePatterns" name="spec" placeholder="FindMy mfg 004C 1219&#10;Tile uuid16 FEED&#10;Beacon name Tile-"></textarea>
+      <div class="row" style="margin-top:10px">
+        <button class="btn primary" type="submit">Save Patterns</button>
+        <button class="btn" type="button" id="blePreset">Tracker Presets</button>
+      </div>
+    </form>
+    <form id="ik" method="POST" action="/irks">
+      <label for="irkList">BLE identity keys (IRK)</label>
+      <textarea id="irkList" name="spec" placeholder="Phone EC0234A357C8AD05341010A60A397D9B"></textarea>
+      <div class="row" style="margin-top:10px">
+        <button class="btn primary" type="submit">Save IRKs</button>
+      </div>
+    </form>
   </div>
 
   <div class="card">
@@ -120,17 +161,19 @@ a{color:var(--accent)} hr{border:0;border-top:1px dashed #003b24;margin:14px 0}
       <div class="row"><input type="checkbox" id="forever1" name="forever" value="1"><label for="forever1">∞ Forever</label></div>
       <label>WiFi Channels CSV</label>
       <input type="text" name="ch" value="1,6,11">
+      <label>Min RSSI (dBm, blank for none)</label>
+      <input type="number" name="minrssi" min="-100" max="0" placeholder="-85">
       <div class="row" style="margin-top:10px">
         <button class="btn primary" type="submit">Start List Scan</button>
         <a class="btn alt" href="/beep" data-ajax="true">Test Buzzer</a>
-        <a class="btn" href="/stop" data-ajax="true">Stop</a>
+        <a class="btn" href="/stop?session=scan" data-ajax="true">Stop</a>
       </div>
       <p class="small">AP goes offline during scan and returns.</p>
     </form>
   </div>
 
   <div class="card">
-    <h3>Tracker (single MAC "Geiger")</h3>
+    <h3>Tracker ("Geiger", up to 16 MACs)</h3>
     <form id="t" method="POST" action="/track">
       <label>Scan Mode</label>
       <select name="mode">
@@ -138,17 +181,17 @@ a{color:var(--accent)} hr{border:0;border-top:1px dashed #003b24;margin:14px 0}
         <option value="1">BLE Only</option>
         <option value="2">WiFi + BLE</option>
       </select>
-      <label>Target MAC (AA:BB:CC:DD:EE:FF)</label>
-      <input type="text" name="mac" placeholder="34:21:09:83:D9:51">
+      <label>Target MACs, comma separated (first listed has buzzer priority)</label>
+      <input type="text" name="mac" placeholder="34:21:09:83:D9:51, 8C:AA:B5:12:34:56">
       <label>Duration (seconds)</label>
       <input type="number" name="secs" min="0" max="86400" value="180">
       <div class="row"><input type="checkbox" id="forever2" name="forever" value="1"><label for="forever2">∞ Forever</label></div>
       <label>WiFi Channels CSV (use single channel for smoother tracking)</label>
       <input type="text" name="ch" value="6">
-      <p class="small">Closer = faster & higher-pitch beeps. Lost = slow click.</p>
+      <p class="small">Closer = faster & higher-pitch beeps. Lost = slow click. The buzzer follows the first listed target currently heard.</p>
       <div class="row" style="margin-top:10px">
         <button class="btn primary" type="submit">Start Tracker</button>
-        <a class="btn" href="/stop" data-ajax="true">Stop</a>
+        <a class="btn" href="/stop?session=track" data-ajax="true">Stop</a>
       </div>
     </form>
   </div>
@@ -156,12 +199,10 @@ a{color:var(--accent)} hr{border:0;border-top:1px dashed #003b24;margin:14px 0}
   <div class="card">
   <h3>WiFi Traffic Sniffers</h3>
   <form id="bt" method="POST" action="/blueteam">
-    <label>Detection Mode</label>
-    <select name="detection" id="detectionMode">
-      <option value="deauth">Deauth/Disassoc Detection</option>
-      <option value="beacon-flood">Beacon Flood Detection</option>
-      <option value="evil-twin">Evil Twin Detection</option>
-    </select>
+    <label>Detectors</label>
+    <div class="row"><input type="checkbox" id="btDeauth" name="deauth" value="1" checked><label for="btDeauth">Deauth/Disassoc</label></div>
+    <div class="row"><input type="checkbox" id="btFlood" name="flood" value="1" checked><label for="btFlood">Beacon Flood</label></div>
+    <div class="row"><input type="checkbox" id="btEvilap" name="evilap" value="1" checked><label for="btEvilap">Evil Twin</label></div>
     
     <div id="deauthSettings">
       <label>Duration (seconds)</label>
@@ -175,9 +216,9 @@ a{color:var(--accent)} hr{border:0;border-top:1px dashed #003b24;margin:14px 0}
     
     <div class="row" style="margin-top:10px">
       <button class="btn primary" type="submit">Start Detection</button>
-      <a class="btn" href="/stop" data-ajax="true">Stop</a>
+      <a class="btn" href="/stop?session=detect" data-ajax="true">Stop</a>
     </div>
-    <p class="small">Monitors adversarial & suspicious WiFi traffic. AP goes offline during detection. </p>
+    <p class="small">Monitors adversarial & suspicious WiFi traffic. AP goes offline during detection. Detectors run together from one capture. </p>
   </form>
 </div>
 
@@ -201,10 +242,20 @@ a{color:var(--accent)} hr{border:0;border-top:1px dashed #003b24;margin:14px 0}
     <input type="checkbox" id="meshEnabled" checked>
     <label for="meshEnabled">Enable Mesh Notifications</label>
   </div>
-  <div class="row" style="margin-top:10px">
-    <a class="btn alt" href="/mesh-test" data-ajax="true">Test Mesh</a>
-  </div>
-  <p class="small">Sends list and tracker target alerts over meshtastic.</p>
+  <label for="meshFormat">Message Format</label>
+  <select id="meshFormat">
+    <option value="text">Text</option>
+    <option value="binary">Binary frames (compact)</option>
+  </select>
+  <form id="meshKeyForm" method="POST" action="/mesh">
+    <label for="meshKey">Command Key</label>
+    <input type="password" id="meshKey" name="key" maxlength="64" placeholder="shared secret, blank disables mesh commands">
+    <div class="row" style="margin-top:10px">
+      <button class="btn" type="submit">Save Key</button>
+      <a class="btn alt" href="/mesh-test" data-ajax="true">Test Mesh</a>
+    </div>
+  </form>
+  <p class="small">Sends list and tracker target alerts over meshtastic. Binary frames need a decoder on the receiving side. Mesh commands must be signed with the command key (tools/meshsign).</p>
 </div>
 
   <div class="card">
@@ -248,9 +299,12 @@ async function load(){
   try{
     const r = await fetch('/export'); 
     document.getElementById('list').value = await r.text();
+    document.getElementById('blePatterns').value = await fetch('/ble-patterns').then(r=>r.text());
+    document.getElementById('irkList').value = await fetch('/irks').then(r=>r.text());
     const cfg = await fetch('/config').then(r=>r.json());
     document.getElementById('beeps').value = cfg.beeps;
     document.getElementById('gap').value = cfg.gap;
+    document.getElementById('meshFormat').value = cfg.meshFormat;
     const rr = await fetch('/results'); 
     document.getElementById('r').innerText = await rr.text();
   }catch(e){}
@@ -289,15 +343,32 @@ function updateModeIndicator(mode) {
   }
 }
 
-document.getElementById('f').addEventListener('submit', e=>{ e.preventDefault(); ajaxForm(e.target, 'Targets saved ✓'); });
+document.getElementById('f').addEventListener('submit', async e=>{
+  e.preventDefault();
+  const file = document.getElementById('listFile').files[0];
+  const mode = document.getElementById('listMode').value;
+  try{
+    const r = await fetch('/targets?mode='+mode, {method:'POST', headers:{'Content-Type':'text/plain'},
+                          body: file || document.getElementById('list').value});
+    toast(await r.text());
+    if (r.ok) { document.getElementById('listFile').value = ''; load(); }
+  }catch(err){
+    toast('Error: '+err.message);
+  }
+});
+document.getElementById('bp').addEventListener('submit', e=>{ e.preventDefault(); ajaxForm(e.target); });
+document.getElementById('ik').addEventListener('submit', e=>{ e.preventDefault(); ajaxForm(e.target); });
+document.getElementById('blePreset').addEventListener('click', async ()=>{
+  document.getElementById('blePatterns').value = await fetch('/ble-patterns?preset=trackers').then(r=>r.text());
+});
 document.getElementById('c').addEventListener('submit', e=>{ e.preventDefault(); ajaxForm(e.target, 'Config saved ✓'); });
 
 document.getElementById('s').addEventListener('submit', e=>{
   e.preventDefault();
   const fd = new FormData(e.target);
   updateModeIndicator(fd.get('mode'));
-  fetch('/scan', {method:'POST', body:fd}).then(()=>{
-    toast('List scan started. AP will drop & return…');
+  fetch('/scan', {method:'POST', body:fd}).then(async r=>{
+    toast(r.ok ? 'List scan started. AP will drop & return…' : await r.text());
   }).catch(err=>toast('Error: '+err.message));
 });
 
@@ -309,11 +380,20 @@ document.getElementById('meshEnabled').addEventListener('change', e=>{
     .catch(err=>toast('Error: '+err.message));
 });
 
+document.getElementById('meshKeyForm').addEventListener('submit', e=>{ e.preventDefault(); ajaxForm(e.target); e.target.reset(); });
+
+document.getElementById('meshFormat').addEventListener('change', e=>{
+  fetch('/mesh', {method:'POST', body: new URLSearchParams({format: e.target.value})})
+    .then(r=>r.text())
+    .then(t=>toast(t))
+    .catch(err=>toast('Error: '+err.message));
+});
+
 document.getElementById('bt').addEventListener('submit', e=>{
   e.preventDefault();
   const fd = new FormData(e.target);
-  fetch('/blueteam', {method:'POST', body:fd}).then(()=>{
-    toast('Blue team detection started. AP will drop & return…');
+  fetch('/blueteam', {method:'POST', body:fd}).then(r=>r.text()).then(t=>{
+    toast(t.startsWith('Detection starting') ? 'Blue team detection started. AP will drop & return…' : t);
   }).catch(err=>toast('Error: '+err.message));
 });
 
@@ -321,8 +401,8 @@ document.getElementById('t').addEventListener('submit', e=>{
   e.preventDefault();
   const fd = new FormData(e.target);
   updateModeIndicator(fd.get('mode'));
-  fetch('/track', {method:'POST', body:fd}).then(()=>{
-    toast('Tracker started. AP will drop & return…');
+  fetch('/track', {method:'POST', body:fd}).then(async r=>{
+    toast(r.ok ? 'Tracker started. AP will drop & return…' : await r.text());
   }).catch(err=>toast('Error: '+err.message));
 });
 
@@ -335,10 +415,10 @@ document.querySelector('#t select[name="mode"]').addEventListener('change', e=>{
 });
 
 document.addEventListener('click', e=>{
-  const a = e.target.closest('a[href="/stop"]');
+  const a = e.target.closest('a[href^="/stop"]');
   if (!a) return;
   e.preventDefault();
-  fetch('/stop').then(r=>r.text()).then(t=>toast(t));
+  fetch(a.getAttribute('href')).then(r=>r.text()).then(t=>toast(t));
 });
 
 load();
@@ -347,6 +427,91 @@ setInterval(tick, 1000);
 </body></html>
 )HTML";
 
+// SD queries (geo cells, history) can read for seconds, far too long for the
+// async_tcp task. One runs at a time on its own task; the response is a
+// chunked stream that asks the library to retry until the text is ready.
+// Both sides hold the job, so a client that disconnects early is harmless.
+struct SdQueryJob
+{
+  std::function<String()> run;
+  String out;
+  std::atomic<bool> done{false};
+};
+
+static volatile bool sdQueryBusy = false;
+
+static void sdQueryTask(void *arg)
+{
+  std::shared_ptr<SdQueryJob> *held = static_cast<std::shared_ptr<SdQueryJob> *>(arg);
+  std::shared_ptr<SdQueryJob> job = *held;
+  delete held;
+  job->out = job->run();
+  job->done = true;
+  sdQueryBusy = false;
+  vTaskDelete(nullptr);
+}
+
+static void sendSdQuery(AsyncWebServerRequest *r, std::function<String()> run)
+{
+  if (sdQueryBusy)
+  {
+    r->send(409, "text/plain", "Another SD query is running; try again shortly");
+    return;
+  }
+  std::shared_ptr<SdQueryJob> job = std::make_shared<SdQueryJob>();
+  job->run = run;
+  sdQueryBusy = true;
+  std::shared_ptr<SdQueryJob> *held = new std::shared_ptr<SdQueryJob>(job);
+  if (xTaskCreatePinnedToCore(sdQueryTask, "sdquery", 8192, held, 1, nullptr, 0) != pdPASS)
+  {
+    delete held;
+    sdQueryBusy = false;
+    r->send(503, "text/plain", "Query task could not start");
+    return;
+  }
+  std::shared_ptr<size_t> cursor = std::make_shared<size_t>(0);
+  r->send(r->beginChunkedResponse("text/plain", [job, cursor](uint8_t *buf, size_t maxLen, size_t) -> size_t {
+    if (!job->done)
+      return RESPONSE_TRY_AGAIN;
+    size_t n = job->out.length() - *cursor;
+    if (n > maxLen)
+      n = maxLen;
+    memcpy(buf, job->out.c_str() + *cursor, n);
+    *cursor += n;
+    return n;
+  }));
+}
+
+// Claims the single upload session for this request and keeps its id in
+// _tempObject, which the library frees with the request.
+static void beginTargetUpload(AsyncWebServerRequest *req)
+{
+  TargetUpdateMode mode = TARGETS_REPLACE;
+  if (req->hasParam("mode"))
+  {
+    const String &m = req->getParam("mode")->value();
+    if (m == "add")
+      mode = TARGETS_ADD;
+    else if (m == "remove")
+      mode = TARGETS_REMOVE;
+  }
+  uint32_t session = targetUploadBegin(mode, req->contentLength());
+  if (session)
+  {
+    req->_tempObject = malloc(sizeof(session));
+    if (req->_tempObject)
+      memcpy(req->_tempObject, &session, sizeof(session));
+  }
+}
+
+static uint32_t uploadSessionOf(AsyncWebServerRequest *req)
+{
+  uint32_t session = 0;
+  if (req->_tempObject)
+    memcpy(&session, req->_tempObject, sizeof(session));
+  return session;
+}
+
 void startWebServer()
 {
   if (!server)
@@ -359,10 +524,18 @@ void startWebServer()
         r->send(res); });
 
   server->on("/export", HTTP_GET, [](AsyncWebServerRequest *r)
-             { r->send(200, "text/plain", getTargetsList()); });
+             {
+        std::shared_ptr<size_t> cursor = std::make_shared<size_t>(0);
+        r->send(r->beginChunkedResponse("text/plain", [cursor](uint8_t *buf, size_t maxLen, size_t) {
+            return exportTargets(buf, maxLen, *cursor);
+        })); });
 
   server->on("/results", HTTP_GET, [](AsyncWebServerRequest *r)
-             { r->send(200, "text/plain", lastResults.length() ? lastResults : String("None yet.")); });
+             {
+        uint8_t subs = RADIO_SUB_ALL;
+        if (r->hasParam("session")) subs = parseRadioSessions(r->getParam("session")->value().c_str());
+        String results = getSessionResults(subs);
+        r->send(200, "text/plain", results.length() ? results : String("None yet.")); });
 
   server->on("/save", HTTP_POST, [](AsyncWebServerRequest *req)
              {
@@ -370,9 +543,63 @@ void startWebServer()
             req->send(400, "text/plain", "Missing 'list'");
             return;
         }
-        String txt = req->getParam("list", true)->value();
-        saveTargetsList(txt);
-        req->send(200, "text/plain", "Saved"); });
+        const String &txt = req->getParam("list", true)->value();
+        String summary;
+        bool ok = applyTargetText(TARGETS_REPLACE, txt.c_str(), txt.length(), summary);
+        req->send(ok ? 200 : 503, "text/plain", summary); });
+
+  // Raw text/plain body or a multipart file part, parsed as it streams in.
+  // ?mode=replace (default), add or remove.
+  server->on("/targets", HTTP_POST, [](AsyncWebServerRequest *req)
+             {
+        String summary;
+        if (!req->_tempObject) {
+            if (req->contentLength() == 0) req->send(400, "text/plain", "Empty upload");
+            else req->send(409, "text/plain", "Another target upload is in progress");
+            return;
+        }
+        bool ok = targetUploadFinish(uploadSessionOf(req), summary);
+        req->send(ok ? 200 : 503, "text/plain", summary); },
+             [](AsyncWebServerRequest *req, const String &, size_t index, uint8_t *data, size_t len, bool)
+             {
+        if (index == 0) beginTargetUpload(req);
+        if (req->_tempObject) targetUploadFeed(uploadSessionOf(req), data, len); },
+             [](AsyncWebServerRequest *req, uint8_t *data, size_t len, size_t index, size_t)
+             {
+        if (index == 0) beginTargetUpload(req);
+        if (req->_tempObject) targetUploadFeed(uploadSessionOf(req), data, len); });
+
+  // BLE advert payload patterns; ?preset=trackers returns the built-in set
+  server->on("/ble-patterns", HTTP_GET, [](AsyncWebServerRequest *r)
+             {
+        if (r->hasParam("preset")) r->send(200, "text/plain", BLE_TRACKER_PRESETS);
+        else r->send(200, "text/plain", getBlePatterns()); });
+
+  server->on("/ble-patterns", HTTP_POST, [](AsyncWebServerRequest *req)
+             {
+        if (!req->hasParam("spec", true)) {
+            req->send(400, "text/plain", "Missing 'spec'");
+            return;
+        }
+        const String &spec = req->getParam("spec", true)->value();
+        String summary;
+        bool ok = setBlePatterns(spec.c_str(), spec.length(), summary);
+        req->send(ok ? 200 : 503, "text/plain", summary); });
+
+  // Identity Resolving Keys for BLE targets with rotating addresses
+  server->on("/irks", HTTP_GET, [](AsyncWebServerRequest *r)
+             { r->send(200, "text/plain", getIrkTargets()); });
+
+  server->on("/irks", HTTP_POST, [](AsyncWebServerRequest *req)
+             {
+        if (!req->hasParam("spec", true)) {
+            req->send(400, "text/plain", "Missing 'spec'");
+            return;
+        }
+        const String &spec = req->getParam("spec", true)->value();
+        String summary;
+        bool ok = setIrkTargets(spec.c_str(), spec.length(), summary);
+        req->send(ok ? 200 : 503, "text/plain", summary); });
 
   server->on("/scan", HTTP_POST, [](AsyncWebServerRequest *req)
              {
@@ -393,17 +620,18 @@ void startWebServer()
         }
         String ch = "1,6,11";
         if (req->hasParam("ch", true)) ch = req->getParam("ch", true)->value();
+        int minRssi = -128;
+        if (req->hasParam("minrssi", true) && req->getParam("minrssi", true)->value().length()) {
+            minRssi = req->getParam("minrssi", true)->value().toInt();
+        }
+        setScanMinRssi(minRssi);
         
-        parseChannelsCSV(ch);
-        currentScanMode = mode;
-        stopRequested = false;
-        
+        if (!startListScan(forever ? 0 : secs, mode, ch)) {
+            req->send(409, "text/plain", "List scan already running; stop it first");
+            return;
+        }
         String modeStr = (mode == SCAN_WIFI) ? "WiFi" : (mode == SCAN_BLE) ? "BLE" : "WiFi+BLE";
-        req->send(200, "text/plain", forever ? ("Scan starting (forever) - " + modeStr) : ("Scan starting for " + String(secs) + "s - " + modeStr));
-        
-        if (!workerTaskHandle) {
-            xTaskCreatePinnedToCore(listScanTask, "scan", 8192, (void*)(intptr_t)(forever ? 0 : secs), 1, &workerTaskHandle, 1);
-        } });
+        req->send(200, "text/plain", forever ? ("Scan starting (forever) - " + modeStr) : ("Scan starting for " + String(secs) + "s - " + modeStr)); });
 
   server->on("/track", HTTP_POST, [](AsyncWebServerRequest *req)
              {
@@ -418,63 +646,52 @@ void startWebServer()
         }
         String ch = req->getParam("ch", true) ? req->getParam("ch", true)->value() : "6";
         
-        uint8_t tmp[6];
-        if (!parseMac6(mac, tmp)) {
-            req->send(400, "text/plain", "Invalid MAC");
+        uint8_t macs[TRACKER_MAX_TARGETS][6];
+        int count = parseMacList(mac, macs, TRACKER_MAX_TARGETS);
+        if (count <= 0) {
+            req->send(400, "text/plain", "Invalid MAC list (up to " + String((unsigned)TRACKER_MAX_TARGETS) + ")");
             return;
         }
         
-        setTrackerMac(tmp);
-        parseChannelsCSV(ch);
-        currentScanMode = mode;
-        stopRequested = false;
-        
+        if (!startTracker(macs, count, forever ? 0 : secs, mode, ch)) {
+            req->send(409, "text/plain", "Tracker already running; stop it first");
+            return;
+        }
         String modeStr = (mode == SCAN_WIFI) ? "WiFi" : (mode == SCAN_BLE) ? "BLE" : "WiFi+BLE";
-        req->send(200, "text/plain", forever ? ("Tracker starting (forever) - " + modeStr) : ("Tracker starting for " + String(secs) + "s - " + modeStr));
-        
-        if (!workerTaskHandle) {
-            xTaskCreatePinnedToCore(trackerTask, "tracker", 8192, (void*)(intptr_t)(forever ? 0 : secs), 1, &workerTaskHandle, 1);
-        } });
+        req->send(200, "text/plain", forever ? ("Tracker starting (forever) - " + modeStr) : ("Tracker starting for " + String(secs) + "s - " + modeStr)); });
 
   server->on("/blueteam", HTTP_POST, [](AsyncWebServerRequest *req)
              {
-        String detection = req->getParam("detection", true) ? req->getParam("detection", true)->value() : "deauth";
+        // Detectors are checkboxes; "detection" is the older single-mode field
+        uint8_t mask = 0;
+        if (req->hasParam("deauth", true)) mask |= BLUE_DEAUTH;
+        if (req->hasParam("flood", true)) mask |= BLUE_FLOOD;
+        if (req->hasParam("evilap", true)) mask |= BLUE_EVILAP;
+        if (!mask && req->hasParam("detection", true)) {
+            String detection = req->getParam("detection", true)->value();
+            if (detection == "deauth") mask = BLUE_DEAUTH;
+            else if (detection == "beacon-flood") mask = BLUE_FLOOD;
+            else if (detection == "evil-twin") mask = BLUE_EVILAP;
+            else if (detection == "all") mask = BLUE_ALL;
+        }
+        if (!mask) {
+            req->send(400, "text/plain", "Select at least one detector");
+            return;
+        }
+
+        if (blueTeamTaskHandle) {
+            startBlueTeam(mask, 0);
+            req->send(200, "text/plain", "Detectors updated");
+            return;
+        }
+
         int secs = req->getParam("secs", true) ? req->getParam("secs", true)->value().toInt() : 300;
         bool forever = req->hasParam("forever", true);
-        
-        if (detection == "deauth") {
-            if (secs < 0) secs = 0;
-            if (secs > 86400) secs = 86400;
-            
-            stopRequested = false;
-            req->send(200, "text/plain", forever ? "Deauth detection starting (forever)" : ("Deauth detection starting for " + String(secs) + "s"));
-            
-            if (!blueTeamTaskHandle) {
-                xTaskCreatePinnedToCore(deauthDetectionTask, "blueteam", 8192, (void*)(intptr_t)(forever ? 0 : secs), 1, &blueTeamTaskHandle, 1);
-            }
-        } else if (detection == "beacon-flood") {
-            if (secs < 0) secs = 0;
-            if (secs > 86400) secs = 86400;
-            
-            stopRequested = false;
-            req->send(200, "text/plain", forever ? "Beacon flood detection starting (forever)" : ("Beacon flood detection starting for " + String(secs) + "s"));
-            
-            if (!blueTeamTaskHandle) {
-                xTaskCreatePinnedToCore(beaconFloodTask, "beaconflood", 10240, (void*)(intptr_t)(forever ? 0 : secs), 1, &blueTeamTaskHandle, 1);
-            }
-        } else if (detection == "evil-twin") {
-            if (secs < 0) secs = 0;
-            if (secs > 86400) secs = 86400;
-            
-            stopRequested = false;
-            req->send(200, "text/plain", forever ? "Evil AP detection starting (forever)" : ("Evil AP detection starting for " + String(secs) + "s"));
-            
-            if (!blueTeamTaskHandle) {
-                xTaskCreatePinnedToCore(evilAPDetectionTask, "evilap", 12288, (void*)(intptr_t)(forever ? 0 : secs), 1, &blueTeamTaskHandle, 1);
-            }
-        } else {
-            req->send(400, "text/plain", "Detection mode not yet implemented");
-        } });
+        if (secs < 0) secs = 0;
+        if (secs > 86400) secs = 86400;
+
+        req->send(200, "text/plain", forever ? "Detection starting (forever)" : ("Detection starting for " + String(secs) + "s"));
+        startBlueTeam(mask, forever ? 0 : secs); });
 
   server->on("/evilap-results", HTTP_GET, [](AsyncWebServerRequest *r)
              {
@@ -488,11 +705,14 @@ void startWebServer()
             results += "EVIL_AP " + macFmt6(hit.bssid) + " '" + hit.ssid + "'";
             results += " RSSI:" + String(hit.rssi) + "dBm";
             results += " CH:" + String(hit.channel);
+            results += " SEC:" + apSecurityLabel(hit.security, hit.ciphers, hit.akms);
             if (hit.detectionFlags & EVIL_AP_FLAG_TWIN) results += " [TWIN]";
             if (hit.detectionFlags & EVIL_AP_FLAG_STRONG_SIGNAL) results += " [STRONG]";
             if (hit.detectionFlags & EVIL_AP_FLAG_KARMA) results += " [KARMA]";
             if (hit.detectionFlags & EVIL_AP_FLAG_OPEN_SPOOF) results += " [OPEN_SPOOF]";
             if (hit.detectionFlags & EVIL_AP_FLAG_TIMING) results += " [TIMING]";
+            UtcStamp at = utcAt(hit.tsUs);
+            if (at.valid) results += " UTC:" + formatUtc(at);
             results += "\n";
         }  
         r->send(200, "text/plain", results); });
@@ -501,28 +721,41 @@ void startWebServer()
         String results = "Deauth Detection Results\n";
         results += "Deauth frames: " + String(deauthCount) + "\n";
         results += "Disassoc frames: " + String(disassocCount) + "\n\n";
-        
+
+        // Heap, not the async_tcp stack
+        std::vector<DeauthEpisode> open(DEAUTH_SETS * DEAUTH_WAYS);
+        size_t n = getDeauthEpisodes(open.data(), open.size());
+        for (size_t i = 0; i < n; i++) {
+            results += "ACTIVE " + deauthEpisodeLine(open[i]);
+            UtcStamp at = utcAt(open[i].tsUs);
+            if (at.valid) results += " UTC:" + formatUtc(at);
+            results += "\n";
+        }
+
+        // Newest finished episodes first
         int show = min((int)deauthLog.size(), 100);
         for (int i = 0; i < show; i++) {
-            const auto &hit = deauthLog[i];
-            results += String(hit.isDisassoc ? "DISASSOC" : "DEAUTH") + " ";
-            results += macFmt6(hit.srcMac) + " -> " + macFmt6(hit.destMac);
-            results += " BSSID:" + macFmt6(hit.bssid);
-            results += " RSSI:" + String(hit.rssi) + "dBm";
-            results += " CH:" + String(hit.channel);
-            results += " Reason:" + String(hit.reasonCode) + "\n";
+            const auto &ep = deauthLog[deauthLog.size() - 1 - i];
+            results += deauthEpisodeLine(ep);
+            UtcStamp at = utcAt(ep.tsUs);
+            if (at.valid) results += " UTC:" + formatUtc(at);
+            results += "\n";
         }  
         r->send(200, "text/plain", results); });
 
   server->on("/gps", HTTP_GET, [](AsyncWebServerRequest *r)
              {
     String gpsInfo = "GPS Data: " + getGPSData() + "\n";
-    if (gpsValid) {
-        gpsInfo += "Latitude: " + String(gpsLat, 6) + "\n";
-        gpsInfo += "Longitude: " + String(gpsLon, 6) + "\n";
+    GpsFix fix = getGpsFix();
+    if (fix.valid) {
+        gpsInfo += "Latitude: " + String(fix.lat, 6) + "\n";
+        gpsInfo += "Longitude: " + String(fix.lon, 6) + "\n";
+        gpsInfo += "Altitude: " + String(fix.altM, 1) + "m\n";
+        gpsInfo += "Satellites: " + String(fix.sats) + " HDOP: " + String(fix.hdop, 1) + "\n";
     } else {
         gpsInfo += "GPS: No valid fix\n";
     }
+    gpsInfo += getTimeSyncStatus();
     r->send(200, "text/plain", gpsInfo); });
 
   server->on("/sd-status", HTTP_GET, [](AsyncWebServerRequest *r)
@@ -532,7 +765,13 @@ void startWebServer()
 
   server->on("/stop", HTTP_GET, [](AsyncWebServerRequest *r)
              {
-        stopRequested = true;
+        uint8_t subs = RADIO_SUB_ALL;
+        if (r->hasParam("session")) subs = parseRadioSessions(r->getParam("session")->value().c_str());
+        if (!subs) {
+          r->send(400, "text/plain", "Unknown session (scan, track, detect or all)");
+          return;
+        }
+        radioRequestStop(subs);
         r->send(200, "text/plain", "Stopping… (AP will return shortly)"); });
 
   server->on("/beep", HTTP_GET, [](AsyncWebServerRequest *r)
@@ -542,7 +781,8 @@ void startWebServer()
 
   server->on("/config", HTTP_GET, [](AsyncWebServerRequest *r)
              {
-        String j = String("{\"beeps\":") + cfgBeeps + ",\"gap\":" + cfgGapMs + "}";
+        String j = String("{\"beeps\":") + cfgBeeps + ",\"gap\":" + cfgGapMs +
+                   ",\"meshFormat\":\"" + (meshBinaryFormat ? "binary" : "text") + "\"}";
         r->send(200, "application/json", j); });
 
   server->on("/config", HTTP_POST, [](AsyncWebServerRequest *req)
@@ -561,8 +801,21 @@ void startWebServer()
 
   server->on("/mesh", HTTP_POST, [](AsyncWebServerRequest *req)
              {
-        if (req->hasParam("enabled", true)) {
+        if (req->hasParam("format", true)) {
+            meshBinaryFormat = req->getParam("format", true)->value() == "binary";
+            prefs.putBool("meshbin", meshBinaryFormat);
+            Serial.printf("[MESH] Format: %s\n", meshBinaryFormat ? "binary" : "text");
+            req->send(200, "text/plain", meshBinaryFormat ? "Mesh format: binary" : "Mesh format: text");
+        } else if (req->hasParam("key", true)) {
+            String key = req->getParam("key", true)->value();
+            if (!setMeshCommandKey(key)) {
+                req->send(400, "text/plain", "Command key too long (64 max)");
+                return;
+            }
+            req->send(200, "text/plain", key.length() ? "Mesh command key saved" : "Mesh commands disabled");
+        } else if (req->hasParam("enabled", true)) {
             meshEnabled = req->getParam("enabled", true)->value() == "true";
+            if (!meshEnabled) meshQueueClear();
             Serial.printf("[MESH] %s\n", meshEnabled ? "Enabled" : "Disabled");
             req->send(200, "text/plain", meshEnabled ? "Mesh enabled" : "Mesh disabled");
         } else {
@@ -573,9 +826,97 @@ void startWebServer()
              {
         char test_msg[] = "Antihunter: Test mesh notification";
         Serial.printf("[MESH] Test: %s\n", test_msg);
-        Serial1.println(test_msg);
+        meshLink().println(test_msg);
         r->send(200, "text/plain", "Test message sent to mesh"); });
 
+  server->on("/mesh-peers", HTTP_GET, [](AsyncWebServerRequest *r)
+             { r->send(200, "text/plain", getChannelPlanStatus() + getMeshQueueStatus()); });
+
+  server->on("/mesh-fusion", HTTP_GET, [](AsyncWebServerRequest *r)
+             { r->send(200, "text/plain", getMeshFusionTable()); });
+
+  server->on("/mesh-locate", HTTP_GET, [](AsyncWebServerRequest *r)
+             {
+        uint8_t mac[6];
+        if (r->hasParam("mac")) {
+            if (!parseMac6(r->getParam("mac")->value(), mac)) {
+                r->send(400, "text/plain", "Invalid MAC");
+                return;
+            }
+        } else {
+            int8_t rssi;
+            uint32_t lastSeen, packets;
+            getTrackerStatus(mac, rssi, lastSeen, packets);
+        }
+        r->send(200, "text/plain", getMeshLocate(mac)); });
+
+  server->on("/mesh-calibrate", HTTP_POST, [](AsyncWebServerRequest *req)
+             {
+        if (!req->hasParam("node", true) || !req->hasParam("offset", true)) {
+            req->send(400, "text/plain", "Missing node or offset");
+            return;
+        }
+        uint32_t node = strtoul(req->getParam("node", true)->value().c_str(), nullptr, 16);
+        float offset = req->getParam("offset", true)->value().toFloat();
+        if (!node || !setMeshNodeOffset(node, offset)) {
+            req->send(400, "text/plain", "Invalid node");
+            return;
+        }
+        req->send(200, "text/plain", "Calibration saved"); });
+
+  server->on("/geo-near", HTTP_GET, [](AsyncWebServerRequest *r)
+             {
+        double lat, lon;
+        if (r->hasParam("lat") && r->hasParam("lon")) {
+            lat = r->getParam("lat")->value().toDouble();
+            lon = r->getParam("lon")->value().toDouble();
+        } else {
+            GpsFix fix = getGpsFix();
+            if (!fix.valid) {
+                r->send(400, "text/plain", "No GPS fix; pass lat and lon");
+                return;
+            }
+            lat = fix.lat;
+            lon = fix.lon;
+        }
+        float radius = r->hasParam("r") ? r->getParam("r")->value().toFloat() : 100.0f;
+        sendSdQuery(r, [lat, lon, radius]() { return geoQueryNear(lat, lon, radius); }); });
+
+  server->on("/geo-mac", HTTP_GET, [](AsyncWebServerRequest *r)
+             {
+        uint8_t mac[6];
+        if (!r->hasParam("mac") || !parseMac6(r->getParam("mac")->value(), mac)) {
+            r->send(400, "text/plain", "Invalid MAC");
+            return;
+        }
+        std::array<uint8_t, 6> m;
+        memcpy(m.data(), mac, 6);
+        sendSdQuery(r, [m]() { return geoQueryMac(m.data()); }); });
+
+  server->on("/history", HTTP_GET, [](AsyncWebServerRequest *r)
+             {
+        if (r->hasParam("mac")) {
+            uint8_t mac[6];
+            if (!parseMac6(r->getParam("mac")->value(), mac)) {
+                r->send(400, "text/plain", "Invalid MAC");
+                return;
+            }
+            r->send(200, "text/plain", getDeviceHistory(mac));
+            return;
+        }
+        int minSessions = r->hasParam("min") ? r->getParam("min")->value().toInt() : 2;
+        int limit = r->hasParam("n") ? r->getParam("n")->value().toInt() : 50;
+        uint16_t minS = (uint16_t)max(minSessions, 1);
+        size_t n = (size_t)max(limit, 1);
+        sendSdQuery(r, [minS, n]() { return getRecurringDevices(minS, n); }); });
+
+  // Probe-request fingerprints; ?all=1 includes devices seen with one MAC
+  server->on("/probe-fp", HTTP_GET, [](AsyncWebServerRequest *r)
+             {
+        int limit = r->hasParam("n") ? r->getParam("n")->value().toInt() : 50;
+        bool all = r->hasParam("all") && r->getParam("all")->value() == "1";
+        r->send(200, "text/plain", getProbeDevicesReport((size_t)max(min(limit, 256), 1), !all)); });
+
   server->on("/diag", HTTP_GET, [](AsyncWebServerRequest *r)
              {
         String s = getDiagnostics();
@@ -650,33 +991,97 @@ void startAPAndServer()
   }
 }
 
-// Mesh UART Messages
-void sendMeshNotification(const Hit &hit)
+// Shared by the web UI and mesh commands. secs <= 0 runs until stopped.
+// A session joining a running sniffer keeps its channel plan, so ch only
+// applies when the radio is idle.
+// Creates a scan task under taskStartLock with its own ScanStart, so two
+// callers cannot both see a free handle or read each other's mode
+static bool startScanTask(TaskFunction_t fn, const char *name, TaskHandle_t &handle, int secs, ScanMode mode)
 {
-  if (!meshEnabled || millis() - lastMeshSend < MESH_SEND_INTERVAL)
-    return;
-  lastMeshSend = millis();
+  ScanStart *start = new ScanStart{secs > 0 ? secs : 0, mode};
+  if (xTaskCreatePinnedToCore(fn, name, 8192, start, 1, &handle, 1) != pdPASS)
+  {
+    handle = nullptr;
+    delete start;
+    return false;
+  }
+  return true;
+}
 
-  char mac_str[18];
-  snprintf(mac_str, sizeof(mac_str), "%02x:%02x:%02x:%02x:%02x:%02x",
-           hit.mac[0], hit.mac[1], hit.mac[2], hit.mac[3], hit.mac[4], hit.mac[5]);
+bool startListScan(int secs, ScanMode mode, const String &ch)
+{
+  xSemaphoreTake(taskStartLock, portMAX_DELAY);
+  bool ok = false;
+  if (!workerTaskHandle)
+  {
+    if (!radioSubscribers())
+      parseChannelsCSV(ch);
+    currentScanMode = mode;
+    radioClearStop(RADIO_SUB_TARGETS);
+    ok = startScanTask(listScanTask, "scan", workerTaskHandle, secs, mode);
+  }
+  xSemaphoreGive(taskStartLock);
+  return ok;
+}
 
-  char mesh_msg[MAX_MESH_SIZE];
-  int msg_len = snprintf(mesh_msg, sizeof(mesh_msg),
-                         "Target: %s %s RSSI:%d",
-                         hit.isBLE ? "BLE" : "WiFi", mac_str, hit.rssi);
+bool startTracker(const uint8_t (*macs)[6], size_t count, int secs, ScanMode mode, const String &ch)
+{
+  if (count == 0)
+    return false;
 
-  if (msg_len < MAX_MESH_SIZE && hit.name.length() > 0 && hit.name != "WiFi")
+  xSemaphoreTake(taskStartLock, portMAX_DELAY);
+  bool ok = false;
+  if (!trackerTaskHandle)
   {
-    msg_len += snprintf(mesh_msg + msg_len, sizeof(mesh_msg) - msg_len,
-                        " Name:%s", hit.name.c_str());
+    setTrackerTargets(macs, count);
+    if (!radioSubscribers())
+      parseChannelsCSV(ch);
+    currentScanMode = mode;
+    radioClearStop(RADIO_SUB_TRACKER);
+    ok = startScanTask(trackerTask, "tracker", trackerTaskHandle, secs, mode);
   }
+  xSemaphoreGive(taskStartLock);
+  return ok;
+}
 
-  if (Serial1.availableForWrite() >= msg_len)
+// Starts the blue-team engine, or switches a running one to these
+// detectors without touching the radio. Returns true when it started.
+bool startBlueTeam(uint8_t detectors, int secs)
+{
+  xSemaphoreTake(taskStartLock, portMAX_DELAY);
+  setBlueTeamDetectors(detectors);
+  bool started = false;
+  if (!blueTeamTaskHandle)
   {
-    Serial.printf("[MESH] %s\n", mesh_msg);
-    Serial1.println(mesh_msg);
+    radioClearStop(RADIO_SUB_DETECTORS);
+    started = xTaskCreatePinnedToCore(blueTeamTask, "blueteam", 12288, (void *)(intptr_t)(secs > 0 ? secs : 0), 1,
+                                      &blueTeamTaskHandle, 1) == pdPASS;
+    if (!started)
+      blueTeamTaskHandle = nullptr;
   }
+  xSemaphoreGive(taskStartLock);
+  return started;
+}
+
+// Mesh UART Messages
+void sendMeshNotification(const Hit &hit, bool firstSighting)
+{
+  meshFusionLocal(hit.mac, hit.rssi, hit.isBLE, hit.ch, hit.isBLE ? hit.name.c_str() : nullptr);
+
+  if (!meshEnabled)
+    return;
+
+  MeshItem item = {};
+  item.kind = MESH_ITEM_TARGET;
+  memcpy(item.mac, hit.mac, 6);
+  item.rssi = hit.rssi;
+  item.ch = hit.ch;
+  item.isBLE = hit.isBLE;
+  item.count = 1;
+  item.lastSeen = millis();
+  strncpy(item.name, hit.name.c_str(), sizeof(item.name) - 1);
+
+  meshEnqueue(item, firstSighting ? MESH_PRIO_NEW_TARGET : MESH_PRIO_REPEAT);
 }
 
 void sendTrackerMeshUpdate()
@@ -684,36 +1089,35 @@ void sendTrackerMeshUpdate()
   static unsigned long lastTrackerMesh = 0;
   const unsigned long trackerInterval = 15000;
 
-  if (millis() - lastTrackerMesh < trackerInterval)
+  if (!meshEnabled || millis() - lastTrackerMesh < trackerInterval)
     return;
   lastTrackerMesh = millis();
 
-  uint8_t trackerMac[6];
-  int8_t trackerRssi;
-  uint32_t trackerLastSeen, trackerPackets;
-  getTrackerStatus(trackerMac, trackerRssi, trackerLastSeen, trackerPackets);
-
-  char mac_str[18];
-  snprintf(mac_str, sizeof(mac_str), "%02x:%02x:%02x:%02x:%02x:%02x",
-           trackerMac[0], trackerMac[1], trackerMac[2],
-           trackerMac[3], trackerMac[4], trackerMac[5]);
-
-  char tracker_msg[MAX_MESH_SIZE];
-  uint32_t ago = trackerLastSeen ? (millis() - trackerLastSeen) / 1000 : 999;
-
-  int msg_len = snprintf(tracker_msg, sizeof(tracker_msg),
-                         "Tracking: %s RSSI:%ddBm LastSeen:%us Pkts:%u",
-                         mac_str, (int)trackerRssi, ago, (unsigned)trackerPackets);
-
-  if (Serial1.availableForWrite() >= msg_len)
+  TrackerStatus status[TRACKER_MAX_TARGETS];
+  size_t n = getTrackerTargets(status, TRACKER_MAX_TARGETS);
+  for (size_t i = 0; i < n; i++)
   {
-    Serial.printf("[MESH] %s\n", tracker_msg);
-    Serial1.println(tracker_msg);
+    if (!status[i].packets)
+      continue;
+
+    MeshItem item = {};
+    item.kind = MESH_ITEM_TRACKER;
+    memcpy(item.mac, status[i].mac, 6);
+    item.rssi = status[i].rssi;
+    item.lastSeen = status[i].lastSeen;
+    item.packets = status[i].packets;
+    item.count = 1;
+    meshEnqueue(item, MESH_PRIO_TRACKER);
   }
 }
 
 void initializeMesh()
 {
-  Serial1.begin(115200, SERIAL_8N1, MESH_RX_PIN, MESH_TX_PIN);
-  Serial.println("Mesh UART communication initialized on Serial1");
+  meshBinaryFormat = prefs.getBool("meshbin", false);
+  meshLink().begin();
+  initMeshQueue();
+  initChannelPlan();
+  startMeshRxTask();
+  Serial.println(meshLinkIsLoopback() ? "Mesh loopback link initialized (no radio)"
+                                      : "Mesh UART communication initialized on Serial1");
 }
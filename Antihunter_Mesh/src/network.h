@@ -6,8 +6,15 @@
 
 enum ScanMode { SCAN_WIFI, SCAN_BLE, SCAN_BOTH };
 
+// Handed to listScanTask and trackerTask, which free it
+struct ScanStart {
+    int secs;        // <= 0 runs until stopped
+    ScanMode mode;
+};
+
 extern AsyncWebServer *server;
 extern bool meshEnabled;
+extern bool meshBinaryFormat;
 
 #ifndef AP_SSID
 #define AP_SSID "Antihunter"
@@ -23,6 +30,9 @@ void initializeNetwork();
 void startWebServer();
 void stopAPAndServer();
 void startAPAndServer();
-void sendMeshNotification(const Hit &hit);
+void sendMeshNotification(const Hit &hit, bool firstSighting);
 void sendTrackerMeshUpdate();
-void initializeMesh();
\ No newline at end of file
+void initializeMesh();
+bool startListScan(int secs, ScanMode mode, const String &ch);
+bool startTracker(const uint8_t (*macs)[6], size_t count, int secs, ScanMode mode, const String &ch);
+bool startBlueTeam(uint8_t detectors, int secs);
\ No newline at end of file
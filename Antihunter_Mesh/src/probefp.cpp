@@ -0,0 +1,212 @@
+#include "probefp.h"
+#include <algorithm>
+#include <vector>
+
+extern String macFmt6(const uint8_t *m);
+
+static const uint64_t FNV_OFFSET = 0xCBF29CE484222325ULL;
+static const uint64_t FNV_PRIME = 0x100000001B3ULL;
+
+static const uint8_t IE_SSID = 0;
+static const uint8_t IE_RATES = 1;
+static const uint8_t IE_DS = 3;
+static const uint8_t IE_HT_CAP = 45;
+static const uint8_t IE_EXT_RATES = 50;
+static const uint8_t IE_RM_CAP = 70;
+static const uint8_t IE_EXT_CAP = 127;
+static const uint8_t IE_VHT_CAP = 191;
+static const uint8_t IE_VENDOR = 221;
+static const uint8_t IE_EXTENSION = 255;
+static const uint8_t EXT_HE_CAP = 35;
+
+static ProbeDevice table[PROBE_FP_SETS][PROBE_FP_WAYS];
+static portMUX_TYPE probeMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t probesSeen = 0, devicesEvicted = 0, targetLinks = 0;
+
+static inline uint64_t fnv(uint64_t h, const uint8_t *p, size_t n) {
+    for (size_t i = 0; i < n; i++) h = (h ^ p[i]) * FNV_PRIME;
+    return h;
+}
+
+static inline uint64_t fnvByte(uint64_t h, uint8_t b) {
+    return (h ^ b) * FNV_PRIME;
+}
+
+uint64_t IRAM_ATTR probeFingerprint(const uint8_t *ies, size_t len, uint8_t &ieCount) {
+    uint64_t h = FNV_OFFSET;
+    const uint8_t *p = ies;
+    const uint8_t *end = ies + len;
+    bool capable = false;
+    ieCount = 0;
+    while (end - p >= 2) {
+        uint8_t id = p[0];
+        uint8_t l = p[1];
+        const uint8_t *body = p + 2;
+        if ((size_t)(end - body) < l) break;
+        p = body + l;
+        if (ieCount < 255) ieCount++;
+        // Every IE contributes its id, so the order is part of the hash
+        h = fnvByte(h, id);
+
+        switch (id) {
+        case IE_SSID:
+        case IE_DS:
+            // Directed SSIDs and the current channel vary per probe
+            break;
+        case IE_HT_CAP:
+            if (l) {
+                // SM power save bits follow the power state
+                h = fnvByte(h, body[0] & ~0x0C);
+                h = fnv(h, body + 1, l - 1);
+            }
+            capable = true;
+            break;
+        case IE_VHT_CAP:
+        case IE_EXT_CAP:
+            capable = true;
+            // fall through
+        case IE_RATES:
+        case IE_EXT_RATES:
+        case IE_RM_CAP:
+            h = fnvByte(h, l);
+            h = fnv(h, body, l);
+            break;
+        case IE_VENDOR:
+            // OUI and type; the payload (WPS UUIDs, counters) is volatile
+            h = fnv(h, body, l < 4 ? l : 4);
+            capable = true;
+            break;
+        case IE_EXTENSION:
+            if (l) {
+                h = fnvByte(h, body[0]);
+                if (body[0] == EXT_HE_CAP) h = fnv(h, body + 1, l - 1);
+            }
+            capable = true;
+            break;
+        default:
+            break;
+        }
+    }
+    // SSID and rates alone are shared by far too many devices to link on
+    if (!capable) return 0;
+    return h ? h : 1;
+}
+
+static inline size_t setFor(uint64_t fp) {
+    return (size_t)(fp >> 17) & (PROBE_FP_SETS - 1);
+}
+
+bool IRAM_ATTR probeRecord(const uint8_t mac[6], uint64_t fp, uint8_t ieCount, int8_t rssi, bool macIsTarget) {
+    if (!fp) return false;
+    uint32_t now = millis();
+    portENTER_CRITICAL(&probeMux);
+    probesSeen++;
+    ProbeDevice *set = table[setFor(fp)];
+    ProbeDevice *e = nullptr;
+    for (size_t w = 0; w < PROBE_FP_WAYS; w++) {
+        if (set[w].probes && set[w].fp == fp) {
+            e = &set[w];
+            break;
+        }
+    }
+    if (!e) {
+        // Free way, else the stalest untargeted one, else the stalest
+        for (size_t w = 0; w < PROBE_FP_WAYS; w++) {
+            ProbeDevice &c = set[w];
+            if (!c.probes) {
+                e = &c;
+                break;
+            }
+            if (!e || (e->targeted && !c.targeted) ||
+                (e->targeted == c.targeted && (int32_t)(c.lastSeen - e->lastSeen) < 0)) {
+                e = &c;
+            }
+        }
+        if (e->probes) devicesEvicted++;
+        memset(e, 0, sizeof(*e));
+        e->fp = fp;
+        e->firstSeen = now;
+    }
+
+    e->probes++;
+    e->lastSeen = now;
+    e->rssi = rssi;
+    e->ieCount = ieCount;
+    if (macIsTarget && !e->targeted) {
+        e->targeted = true;
+        targetLinks++;
+    }
+    size_t held = std::min<size_t>(e->macCount, PROBE_FP_MACS);
+    bool known = false;
+    for (size_t i = 0; i < held && !known; i++) known = !memcmp(e->macs[i], mac, 6);
+    if (!known) {
+        memcpy(e->macs[e->macHead], mac, 6);
+        e->macHead = (uint8_t)((e->macHead + 1) % PROBE_FP_MACS);
+        if (e->macCount < 0xFFFF) e->macCount++;
+    }
+    bool linked = e->targeted;
+    portEXIT_CRITICAL(&probeMux);
+    return linked;
+}
+
+// One set per critical section, so the sniffer callback never waits on
+// more than PROBE_FP_WAYS record copies
+size_t getProbeDevices(ProbeDevice *out, size_t maxCount) {
+    size_t n = 0;
+    for (size_t s = 0; s < PROBE_FP_SETS && n < maxCount; s++) {
+        portENTER_CRITICAL(&probeMux);
+        for (size_t w = 0; w < PROBE_FP_WAYS && n < maxCount; w++) {
+            if (table[s][w].probes) out[n++] = table[s][w];
+        }
+        portEXIT_CRITICAL(&probeMux);
+    }
+    return n;
+}
+
+String getProbeDevicesReport(size_t limit, bool multiOnly) {
+    std::vector<ProbeDevice> devs(PROBE_FP_SETS * PROBE_FP_WAYS);
+    devs.resize(getProbeDevices(devs.data(), devs.size()));
+    if (multiOnly) {
+        devs.erase(std::remove_if(devs.begin(), devs.end(), [](const ProbeDevice &d) { return d.macCount < 2; }),
+                   devs.end());
+    }
+    std::sort(devs.begin(), devs.end(), [](const ProbeDevice &a, const ProbeDevice &b) {
+        if (a.targeted != b.targeted) return a.targeted;
+        return a.macCount != b.macCount ? a.macCount > b.macCount : a.lastSeen > b.lastSeen;
+    });
+    if (devs.size() > limit) devs.resize(limit);
+
+    uint32_t now = millis();
+    String out;
+    for (const ProbeDevice &d : devs) {
+        char fp[17];
+        snprintf(fp, sizeof(fp), "%08X%08X", (unsigned)(d.fp >> 32), (unsigned)d.fp);
+        out += String("fp=") + fp + " macs=" + String(d.macCount) + " probes=" + String(d.probes) +
+               " ies=" + String(d.ieCount) + " rssi=" + String((int)d.rssi) + " age=" +
+               String((now - d.lastSeen) / 1000) + "s" + (d.targeted ? " TARGET" : "") + "\n ";
+        size_t held = std::min<size_t>(d.macCount, PROBE_FP_MACS);
+        for (size_t i = 0; i < held; i++) {
+            // Newest first
+            size_t slot = (d.macHead + PROBE_FP_MACS - 1 - i) % PROBE_FP_MACS;
+            out += " " + macFmt6(d.macs[slot]);
+        }
+        out += "\n";
+    }
+    return out.length() ? out : String("No probe fingerprints yet\n");
+}
+
+String getProbeFpStatus() {
+    size_t used = 0, multi = 0;
+    portENTER_CRITICAL(&probeMux);
+    for (size_t s = 0; s < PROBE_FP_SETS; s++) {
+        for (size_t w = 0; w < PROBE_FP_WAYS; w++) {
+            if (!table[s][w].probes) continue;
+            used++;
+            if (table[s][w].macCount > 1) multi++;
+        }
+    }
+    portEXIT_CRITICAL(&probeMux);
+    return "Probe FP: " + String((unsigned)used) + " devices (" + String((unsigned)multi) + " with rotating MACs), " +
+           String(probesSeen) + " probes, " + String(devicesEvicted) + " evicted, " + String(targetLinks) +
+           " target links\n";
+}
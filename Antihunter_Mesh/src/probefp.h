@@ -0,0 +1,39 @@
+#pragma once
+#include <Arduino.h>
+
+// Probe-request fingerprinting. A phone that randomises its MAC still
+// sends the same capability IEs with every probe: rates, HT/VHT/HE caps,
+// extended caps, vendor IE OUIs and the order they come in. Those are
+// hashed in one pass over the frame (FNV-1a, no allocation) so it fits in
+// the RX callback. The hash keys a bounded set-associative table that
+// links the rotating MACs seen with it to one logical device. Identical
+// handsets on the same OS build share a fingerprint, so a link is a lead
+// rather than proof.
+
+static const size_t PROBE_FP_SETS = 64;
+static const size_t PROBE_FP_WAYS = 4;
+static const size_t PROBE_FP_MACS = 6;   // most recent MACs kept per device
+
+struct ProbeDevice {
+    uint64_t fp;
+    uint8_t macs[PROBE_FP_MACS][6];      // ring, newest at macHead - 1
+    uint8_t macHead;
+    uint8_t ieCount;
+    int8_t rssi;
+    bool targeted;       // one of its MACs is on the watchlist
+    uint16_t macCount;   // distinct MACs linked, saturating
+    uint32_t probes;
+    uint32_t firstSeen;  // millis
+    uint32_t lastSeen;
+};
+
+// Hash of a probe request body (the IEs after the 24-byte header); 0 when
+// there is nothing to fingerprint. ieCount receives the IEs walked.
+uint64_t probeFingerprint(const uint8_t *ies, size_t len, uint8_t &ieCount);
+// Links mac to the fingerprint's device. Returns true when that device is
+// tied to a watchlist target, i.e. this probe should be reported even if
+// mac itself is not listed. RX-callback safe.
+bool probeRecord(const uint8_t mac[6], uint64_t fp, uint8_t ieCount, int8_t rssi, bool macIsTarget);
+size_t getProbeDevices(ProbeDevice *out, size_t maxCount);
+String getProbeDevicesReport(size_t limit, bool multiOnly);
+String getProbeFpStatus();
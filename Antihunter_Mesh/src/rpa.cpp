@@ -0,0 +1,211 @@
+#include "rpa.h"
+#include <Preferences.h>
+#include <algorithm>
+#include "mbedtls/aes.h"
+
+extern Preferences prefs;
+
+static const char *IRK_KEY = "irks";
+static const uint32_t IRK_MAGIC = 0x314B5249; // "IRK1"
+// Direct-mapped; RPAs rotate every ~15 min so a few hundred are live
+static const size_t RPA_CACHE = 1024;
+static const uint64_t CACHE_VALID = 1ULL << 63;
+
+struct IrkRecord {
+    uint8_t irk[16];
+    char label[RPA_LABEL_MAX];
+};
+
+struct IrkImage {
+    uint32_t magic;
+    uint32_t count;
+    IrkRecord keys[RPA_MAX_IRKS];
+};
+
+static IrkRecord irks[RPA_MAX_IRKS];
+static mbedtls_aes_context irkCtx[RPA_MAX_IRKS];
+static size_t irkCount = 0;
+// Bits 0-47 address, 48-55 IRK index + 1 (0 = resolved to none), 63 valid
+static uint64_t cache[RPA_CACHE];
+static SemaphoreHandle_t rpaLock = nullptr;
+static uint32_t lookups = 0, cacheHits = 0, aesBlocks = 0, resolved = 0, busySkips = 0;
+
+static inline uint64_t macKey(const uint8_t *m) {
+    return ((uint64_t)m[0] << 40) | ((uint64_t)m[1] << 32) | ((uint64_t)m[2] << 24) |
+           ((uint64_t)m[3] << 16) | ((uint64_t)m[4] << 8) | m[5];
+}
+
+static inline size_t cacheIndex(uint64_t key) {
+    return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 54) & (RPA_CACHE - 1);
+}
+
+// ah(k, r) = e(k, 0^104 || r) mod 2^24, big-endian as in the Core spec
+static bool ahMatches(size_t i, const uint8_t mac[6]) {
+    uint8_t in[16] = {};
+    uint8_t out[16];
+    memcpy(in + 13, mac, 3);
+    mbedtls_aes_crypt_ecb(&irkCtx[i], MBEDTLS_AES_ENCRYPT, in, out);
+    aesBlocks++;
+    return out[13] == mac[3] && out[14] == mac[4] && out[15] == mac[5];
+}
+
+// Caller holds rpaLock
+static void installKeys(const IrkRecord *keys, size_t count) {
+    for (size_t i = 0; i < irkCount; i++) mbedtls_aes_free(&irkCtx[i]);
+    irkCount = 0;
+    for (size_t i = 0; i < count && i < RPA_MAX_IRKS; i++) {
+        irks[i] = keys[i];
+        mbedtls_aes_init(&irkCtx[i]);
+        mbedtls_aes_setkey_enc(&irkCtx[i], irks[i].irk, 128);
+        irkCount++;
+    }
+    // Outcomes for the old key set no longer hold
+    memset(cache, 0, sizeof(cache));
+}
+
+int rpaResolve(const uint8_t mac[6]) {
+    // Resolvable private addresses have 0b01 in the top two bits
+    if ((mac[0] & 0xC0) != 0x40 || !irkCount || !rpaLock) return -1;
+    if (xSemaphoreTake(rpaLock, 0) != pdTRUE) {
+        busySkips++;
+        return -1;
+    }
+    lookups++;
+    uint64_t key = macKey(mac);
+    uint64_t &line = cache[cacheIndex(key)];
+    int idx = -1;
+    if ((line & CACHE_VALID) && (line & 0xFFFFFFFFFFFFULL) == key) {
+        cacheHits++;
+        idx = (int)((line >> 48) & 0xFF) - 1;
+    } else {
+        for (size_t i = 0; i < irkCount; i++) {
+            if (ahMatches(i, mac)) {
+                idx = (int)i;
+                resolved++;
+                break;
+            }
+        }
+        line = CACHE_VALID | ((uint64_t)(uint8_t)(idx + 1) << 48) | key;
+    }
+    xSemaphoreGive(rpaLock);
+    return idx;
+}
+
+void irkLabel(int idx, char *out, size_t cap) {
+    if (!cap) return;
+    out[0] = '\0';
+    if (idx < 0 || !rpaLock || xSemaphoreTake(rpaLock, pdMS_TO_TICKS(50)) != pdTRUE) return;
+    if ((size_t)idx < irkCount) snprintf(out, cap, "%s", irks[idx].label);
+    xSemaphoreGive(rpaLock);
+}
+
+size_t getIrkCount() {
+    return irkCount;
+}
+
+static bool parseIrkLine(const char *p, const char *end, IrkRecord &rec) {
+    while (p < end && isspace((unsigned char)*p)) p++;
+    while (end > p && isspace((unsigned char)end[-1])) end--;
+    // The key is the last token; anything before it is the label
+    const char *key = end;
+    while (key > p && !isspace((unsigned char)key[-1])) key--;
+    memset(&rec, 0, sizeof(rec));
+    size_t n = 0;
+    int hi = -1;
+    for (const char *c = key; c < end; c++) {
+        if (*c == ':' || *c == '-') continue;
+        if (!isxdigit((unsigned char)*c) || n == sizeof(rec.irk)) return false;
+        int v = isdigit((unsigned char)*c) ? *c - '0' : toupper((unsigned char)*c) - 'A' + 10;
+        if (hi < 0) {
+            hi = v;
+        } else {
+            rec.irk[n++] = (uint8_t)(hi << 4 | v);
+            hi = -1;
+        }
+    }
+    if (n != sizeof(rec.irk) || hi >= 0) return false;
+    const char *labelEnd = key;
+    while (labelEnd > p && isspace((unsigned char)labelEnd[-1])) labelEnd--;
+    size_t labelLen = std::min((size_t)(labelEnd - p), RPA_LABEL_MAX - 1);
+    if (labelLen) memcpy(rec.label, p, labelLen);
+    else snprintf(rec.label, sizeof(rec.label), "irk-%02X%02X", rec.irk[0], rec.irk[1]);
+    return true;
+}
+
+bool setIrkTargets(const char *spec, size_t len, String &summary) {
+    IrkImage *img = (IrkImage *)calloc(1, sizeof(IrkImage));
+    if (!img) {
+        summary = "Out of memory";
+        return false;
+    }
+    img->magic = IRK_MAGIC;
+    uint32_t rejected = 0;
+    const char *end = spec + len;
+    for (const char *line = spec; line < end;) {
+        const char *eol = (const char *)memchr(line, '\n', (size_t)(end - line));
+        if (!eol) eol = end;
+        const char *p = line;
+        line = eol + 1;
+        while (p < eol && isspace((unsigned char)*p)) p++;
+        if (p == eol || *p == '#') continue;
+        if (img->count == RPA_MAX_IRKS || !parseIrkLine(p, eol, img->keys[img->count])) rejected++;
+        else img->count++;
+    }
+
+    if (!rpaLock || xSemaphoreTake(rpaLock, pdMS_TO_TICKS(2000)) != pdTRUE) {
+        free(img);
+        summary = "IRK store busy";
+        return false;
+    }
+    installKeys(img->keys, img->count);
+    xSemaphoreGive(rpaLock);
+
+    bool saved = true;
+    if (img->count) {
+        size_t bytes = offsetof(IrkImage, keys) + img->count * sizeof(IrkRecord);
+        saved = prefs.putBytes(IRK_KEY, img, bytes) == bytes;
+    } else {
+        prefs.remove(IRK_KEY);
+    }
+    summary = "IRKs: " + String((unsigned)img->count);
+    if (rejected) summary += ", " + String(rejected) + " lines rejected";
+    if (!saved) summary += ", not persisted";
+    free(img);
+    return true;
+}
+
+String getIrkTargets() {
+    String out;
+    if (!rpaLock || xSemaphoreTake(rpaLock, pdMS_TO_TICKS(500)) != pdTRUE) return out;
+    for (size_t i = 0; i < irkCount; i++) {
+        char hex[33];
+        for (int b = 0; b < 16; b++) snprintf(hex + 2 * b, 3, "%02X", irks[i].irk[b]);
+        out += String(irks[i].label) + " " + hex + "\n";
+    }
+    xSemaphoreGive(rpaLock);
+    return out;
+}
+
+void loadIrkTargets() {
+    if (!rpaLock) rpaLock = xSemaphoreCreateMutex();
+    size_t bytes = prefs.getBytesLength(IRK_KEY);
+    if (bytes < offsetof(IrkImage, keys) || bytes > sizeof(IrkImage)) return;
+    IrkImage *img = (IrkImage *)calloc(1, sizeof(IrkImage));
+    if (!img) return;
+    prefs.getBytes(IRK_KEY, img, bytes);
+    if (img->magic == IRK_MAGIC && img->count <= RPA_MAX_IRKS &&
+        bytes == offsetof(IrkImage, keys) + img->count * sizeof(IrkRecord)) {
+        xSemaphoreTake(rpaLock, portMAX_DELAY);
+        installKeys(img->keys, img->count);
+        xSemaphoreGive(rpaLock);
+        Serial.printf("[RPA] Loaded %u IRKs\n", (unsigned)irkCount);
+    }
+    free(img);
+}
+
+String getRpaStatus() {
+    if (!irkCount) return "RPA: no IRKs\n";
+    return "RPA: " + String((unsigned)irkCount) + " IRKs, " + String(resolved) + " resolved, cache " +
+           String(cacheHits) + "/" + String(lookups) + " hits, " + String(aesBlocks) + " AES blocks" +
+           (busySkips ? ", " + String(busySkips) + " skipped during updates" : String()) + "\n";
+}
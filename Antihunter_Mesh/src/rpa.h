@@ -0,0 +1,25 @@
+#pragma once
+#include <Arduino.h>
+
+// BLE resolvable private address targets. Devices that rotate their
+// address every few minutes are matched by their Identity Resolving Key:
+// an RPA's upper 24 bits are a random prand and the lower 24 bits are
+// ah(IRK, prand), the low 24 bits of AES-128 (hardware engine via mbedtls)
+// over the zero-padded prand. Each resolvable address is checked against
+// all IRKs once and the outcome cached, so repeat adverts cost one lookup.
+// Keys are persisted in NVS blob "irks".
+
+static const size_t RPA_MAX_IRKS = 16;
+static const size_t RPA_LABEL_MAX = 16;
+
+void loadIrkTargets();
+// One key per line: "[label] <32 hex digits>", most significant byte
+// first as printed in the Core spec and by most key dumps
+bool setIrkTargets(const char *spec, size_t len, String &summary);
+String getIrkTargets();
+size_t getIrkCount();
+// Index of the IRK that generated mac, or -1. Called from the advert
+// callback; never blocks on a concurrent key update.
+int rpaResolve(const uint8_t mac[6]);
+void irkLabel(int idx, char *out, size_t cap);
+String getRpaStatus();
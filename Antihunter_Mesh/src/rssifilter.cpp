@@ -0,0 +1,86 @@
+#include "rssifilter.h"
+#include <math.h>
+
+// Measurement noise: single-packet RSSI scatters by ~4 dB
+static const float MEAS_VAR = 16.0f;
+// Process noise (dB^2/s^3) far away and when the signal is strong
+static const float ACCEL_VAR_FAR = 0.5f;
+static const float ACCEL_VAR_NEAR = 6.0f;
+static const float NEAR_RSSI = -65.0f;
+static const float FAR_RSSI = -85.0f;
+// Innovations beyond 3 sigma are outliers
+static const float GATE_SIGMA2 = 9.0f;
+static const uint8_t MAX_MISSES = 3;
+// Rate decays towards zero across gaps longer than RATE_HOLD_S so a stale
+// trend does not persist once packets stop
+static const float RATE_HOLD_S = 1.0f;
+static const float RATE_TAU_S = 2.0f;
+static const float MAX_DT_S = 5.0f;
+static const float TREND_DB_S = 0.5f;
+
+void RssiFilter::reset() {
+    *this = RssiFilter();
+}
+
+bool RssiFilter::update(float z, uint32_t nowMs) {
+    if (!primed) {
+        level = z;
+        slope = 0;
+        p00 = MEAS_VAR;
+        p01 = 0;
+        p11 = 4.0f;
+        lastMs = nowMs;
+        primed = true;
+        return true;
+    }
+
+    float dt = (nowMs - lastMs) / 1000.0f;
+    if (dt > MAX_DT_S) dt = MAX_DT_S;
+
+    // Predict with a constant-rate model into locals; a rejected sample
+    // leaves the state and lastMs alone, so the next one predicts across
+    // the whole gap once rather than compounding it
+    float lv = level, sl = slope, q00 = p00, q01 = p01, q11 = p11;
+    if (dt > 0) {
+        float a = lv >= NEAR_RSSI ? 1.0f : lv <= FAR_RSSI ? 0.0f : (lv - FAR_RSSI) / (NEAR_RSSI - FAR_RSSI);
+        float q = ACCEL_VAR_FAR + a * (ACCEL_VAR_NEAR - ACCEL_VAR_FAR);
+        float decay = dt > RATE_HOLD_S ? expf(-(dt - RATE_HOLD_S) / RATE_TAU_S) : 1.0f;
+
+        lv += sl * dt;
+        sl *= decay;
+        q00 = p00 + dt * (2 * p01 + dt * p11) + q * dt * dt * dt / 3;
+        q01 = (p01 + dt * p11) * decay + q * dt * dt / 2;
+        q11 = p11 * decay * decay + q * dt;
+    }
+
+    float y = z - lv;
+    float s = q00 + MEAS_VAR;
+    if (y * y > GATE_SIGMA2 * s) {
+        rejectCount++;
+        if (++misses < MAX_MISSES) return false;
+        // Consistent "outliers" mean a real step; widen and accept
+        q00 += y * y;
+        s = q00 + MEAS_VAR;
+    }
+    misses = 0;
+
+    float k0 = q00 / s, k1 = q01 / s;
+    level = lv + k0 * y;
+    slope = sl + k1 * y;
+    p00 = (1 - k0) * q00;
+    p01 = (1 - k0) * q01;
+    p11 = q11 - k1 * q01;
+    lastMs = nowMs;
+    return true;
+}
+
+int RssiFilter::trend() const {
+    if (!primed) return 0;
+    if (slope > TREND_DB_S) return 1;
+    if (slope < -TREND_DB_S) return -1;
+    return 0;
+}
+
+float RssiFilter::distance(const PathLossModel &m) const {
+    return rssiToDistance(m, level);
+}
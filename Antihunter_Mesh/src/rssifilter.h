@@ -0,0 +1,35 @@
+#pragma once
+#include <stdint.h>
+#include "locate.h"
+
+// Per-packet RSSI smoothing for tracker mode. A two-state Kalman filter
+// (level in dBm, rate in dB/s) takes every received packet. Samples far
+// outside the predicted spread are rejected unless several arrive in a
+// row, which means the target really moved. The filter responds faster
+// when the signal is strong, i.e. while homing in on the device.
+// Plain C++ so it can be exercised on the host.
+
+class RssiFilter {
+public:
+    void reset();
+    // Returns false when the sample was rejected as an outlier
+    bool update(float rssi, uint32_t nowMs);
+
+    bool valid() const { return primed; }
+    float rssi() const { return level; }
+    float rate() const { return slope; }
+    // +1 getting closer, -1 moving away, 0 steady or unknown
+    int trend() const;
+    float distance(const PathLossModel &m = DEFAULT_PATH_LOSS) const;
+    uint32_t lastUpdate() const { return lastMs; }
+    uint32_t rejected() const { return rejectCount; }
+
+private:
+    float level = -90.0f;
+    float slope = 0;
+    float p00 = 0, p01 = 0, p11 = 0;
+    uint32_t lastMs = 0;
+    uint32_t rejectCount = 0;
+    uint8_t misses = 0;
+    bool primed = false;
+};
@@ -1,7 +1,18 @@
 #include "scanner.h"
 #include "hardware.h"
 #include "network.h"
+#include "chanplan.h"
+#include "rssifilter.h"
+#include "timesync.h"
+#include "geostore.h"
+#include "devhistory.h"
+#include "blematch.h"
+#include "rpa.h"
+#include "probefp.h"
+#include "deauthwatch.h"
+#include "apwatch.h"
 #include <algorithm> 
+#include <strings.h>
 #include <WiFi.h>
 #include <BLEDevice.h>
 #include <BLEUtils.h>
@@ -16,23 +27,15 @@ extern "C" {
 #include "esp_coexist.h"
 }
 
-// Target management
-struct Target {
-    uint8_t bytes[6];
-    uint8_t len;
-};
-static std::vector<Target> targets;
-
 // Tasks
 QueueHandle_t macQueue = nullptr;
-QueueHandle_t deauthQueue = nullptr;
 QueueHandle_t beaconQueue = nullptr;
 QueueHandle_t evilAPQueue = nullptr;
 extern uint32_t lastScanSecs;
 extern bool lastScanForever;
 
 // Blue Tools globals
-std::vector<DeauthHit> deauthLog;
+std::vector<DeauthEpisode> deauthLog;
 std::vector<BeaconHit> beaconLog;
 std::vector<EvilAPHit> evilAPLog;
 static std::map<String, uint32_t> beaconCounts;
@@ -42,15 +45,9 @@ volatile uint32_t deauthCount = 0;
 volatile uint32_t disassocCount = 0;
 volatile uint32_t totalBeaconsSeen = 0;
 volatile uint32_t suspiciousBeacons = 0;
-static bool deauthDetectionEnabled = false;
-static bool beaconFloodDetectionEnabled = false;
 
 // EvilAP
-static std::map<String, std::vector<String>> ssidToBssids;
-static std::map<String, EvilAPHit> knownNetworks;
-static std::map<String, uint32_t> probeResponses;
 volatile uint32_t evilAPCount = 0;
-static bool evilAPDetectionEnabled = false;
 const uint8_t EVIL_AP_FLAG_TWIN = 0x01;
 const uint8_t EVIL_AP_FLAG_STRONG_SIGNAL = 0x02;
 const uint8_t EVIL_AP_FLAG_KARMA = 0x04;
@@ -66,32 +63,110 @@ static const uint32_t MIN_BEACON_INTERVAL = 50;
 std::set<String> uniqueMacs;
 std::vector<Hit> hitsLog;
 static esp_timer_handle_t hopTimer = nullptr;
-static uint32_t lastScanStart = 0, lastScanEnd = 0;
 uint32_t lastScanSecs = 0;
 bool lastScanForever = false;
 
 // BLE Scanner
 BLEScan *pBLEScan = nullptr;
+static volatile bool bleScanBusy = false;   // a radioPollBLE window is running
 
 // Tracker state
 volatile bool trackerMode = false;
-uint8_t trackerMac[6] = {0};
-volatile int8_t trackerRssi = -127;
-volatile uint32_t trackerLastSeen = 0;
-volatile uint32_t trackerPackets = 0;
+
+// Latest reading per target. Callbacks publish rssi/lastSeen/packets and
+// the tracker task publishes the filter outputs, each as a whole struct
+// under trackerMux so readers never see a mix of old and new fields.
+struct TrackerSnapshot {
+    int8_t rssi;
+    int8_t filtered;
+    int8_t trend;
+    uint32_t lastSeen;
+    uint32_t packets;
+    float distance;
+};
+
+struct TrackedTarget {
+    uint8_t mac[6];
+    TrackerSnapshot snap;
+    RssiFilter filter;      // tracker task only
+};
+
+static TrackedTarget tracked[TRACKER_MAX_TARGETS];
+static size_t trackedCount = 0;
+static volatile int8_t trackerPrimary = -1;
+static portMUX_TYPE trackerMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Open-addressed MAC index for the callbacks; holds target index + 1 and
+// is twice the target capacity so probe chains stay short
+static const size_t TRACK_INDEX_SIZE = 32;
+static uint8_t trackIndex[TRACK_INDEX_SIZE];
+
+// Every packet from a target is also queued so bursts are not collapsed
+struct TrackerSample {
+    uint8_t target;
+    int8_t rssi;
+    uint32_t t;
+};
+static QueueHandle_t trackerQueue = nullptr;
+
+// trackerTask sleeps until one of these notification bits is set
+static const uint32_t TRACK_EVT_PACKET = 0x01;
+static const uint32_t TRACK_EVT_BEEP = 0x02;
+// Upper bound on a tracker sleep so a stop request is seen promptly
+static const int TRACKER_MAX_WAIT_MS = 250;
+// A target counts as present for buzzer selection this long after a packet
+static const uint32_t TRACKER_RECENT_MS = 2000;
+static TaskHandle_t trackerNotifyTask = nullptr;
+static esp_timer_handle_t beepTimer = nullptr;
 
 // Status variables
 volatile bool scanning = false;
 volatile int totalHits = 0;
 volatile uint32_t framesSeen = 0;
 volatile uint32_t bleFramesSeen = 0;
+volatile uint32_t framesRejected = 0;
+
+// What a WiFi session needs from the radio. hwMask programs the
+// promiscuous filter; the rest is a first-stage reject in the RX callback
+// so unwanted frames never reach the detectors.
+struct RxProfile {
+    const char *name;
+    uint32_t hwMask;         // WIFI_PROMIS_FILTER_MASK_*
+    uint16_t mgmtSubtypes;   // management subtypes passed on, bit per subtype
+    int8_t minRssi;
+    bool targetPrefilter;    // drop frames no address of which can be a target
+    uint16_t prefilterExempt;  // mgmt subtypes that skip the address test
+    bool watchlist;          // frames go on to target/tracker matching
+};
+
+static const uint16_t MGMT_ALL = 0xFFFF;
+static const uint16_t MGMT_PROBE_RESP = 1 << 5;
+static const uint16_t MGMT_PROBE_REQ = 1 << 4;
+static const uint16_t MGMT_BEACON = 1 << 8;
+static const uint16_t MGMT_DISASSOC = 1 << 10;
+static const uint16_t MGMT_DEAUTH = 1 << 12;
+static const int8_t RSSI_ANY = -128;
+
+// Probe requests skip the address test: their fingerprints link random
+// MACs to targets (probefp.h)
+static const RxProfile RX_LIST_SCAN = {"list", WIFI_PROMIS_FILTER_MASK_MGMT | WIFI_PROMIS_FILTER_MASK_DATA,
+                                       MGMT_ALL, RSSI_ANY, true, MGMT_PROBE_REQ, true};
+static const RxProfile RX_TRACKER = {"tracker", WIFI_PROMIS_FILTER_MASK_MGMT | WIFI_PROMIS_FILTER_MASK_DATA,
+                                     MGMT_ALL, RSSI_ANY, false, 0, true};
+// Subtypes are the union of the enabled detectors', see blueSubtypes()
+static const RxProfile RX_BLUE_TEAM = {"blueteam", WIFI_PROMIS_FILTER_MASK_MGMT, 0, RSSI_ANY, false, 0, false};
+
+// Merged profile of the attached subscribers; see radioAttach()
+static RxProfile rxActive = RX_TRACKER;
+static int8_t listScanMinRssi = RSSI_ANY;
+// Attached radio subscribers (RADIO_SUB_*); the callbacks route on these
+static volatile uint8_t radioWifiSubs = 0;
+static volatile uint8_t radioBleSubs = 0;
+static void radioUpdate(uint8_t sub, const RxProfile &profile);
 
 // External references
 extern Preferences prefs;
-extern volatile bool stopRequested;
-extern ScanMode currentScanMode;
 extern std::vector<uint8_t> CHANNELS;
-extern String lastResults;
 extern String macFmt6(const uint8_t *m);
 extern bool parseMac6(const String &in, uint8_t out[6]);
 extern bool isZeroOrBroadcast(const uint8_t *mac);
@@ -108,113 +183,115 @@ inline int clampi(int v, int lo, int hi) {
 }
 
 int getUniqueNetworkCount() {
-    return ssidToBssids.size();
+    return apSsidCount();
 }
 
-static bool parseMacLike(const String &ln, Target &out) {
-    String t;
-    for (size_t i = 0; i < ln.length(); ++i) {
-        char c = ln[i];
-        if (isxdigit((int)c)) t += (char)toupper(c);
-    }
-    if (t.length() == 12) {
-        for (int i = 0; i < 6; i++) {
-            out.bytes[i] = (uint8_t)strtoul(t.substring(i * 2, i * 2 + 2).c_str(), nullptr, 16);
-        }
-        out.len = 6;
-        return true;
-    }
-    if (t.length() == 6) {
-        for (int i = 0; i < 3; i++) {
-            out.bytes[i] = (uint8_t)strtoul(t.substring(i * 2, i * 2 + 2).c_str(), nullptr, 16);
-        }
-        out.len = 3;
-        return true;
-    }
-    return false;
+static TrackerSnapshot getTrackerSnapshot(size_t i) {
+    portENTER_CRITICAL(&trackerMux);
+    TrackerSnapshot snap = tracked[i].snap;
+    portEXIT_CRITICAL(&trackerMux);
+    return snap;
 }
 
-size_t getTargetCount() {
-    return targets.size();
+// Reports the target currently driving the buzzer, or the first target
+void getTrackerStatus(uint8_t mac[6], int8_t &rssi, uint32_t &lastSeen, uint32_t &packets) {
+    int p = trackerPrimary;
+    size_t i = (p >= 0 && (size_t)p < trackedCount) ? (size_t)p : 0;
+    TrackerSnapshot snap = getTrackerSnapshot(i);
+
+    memcpy(mac, tracked[i].mac, 6);
+    rssi = snap.filtered > -127 ? snap.filtered : snap.rssi;
+    lastSeen = snap.lastSeen;
+    packets = snap.packets;
 }
 
-String getTargetsList() {
-    String out;
-    for (auto &t : targets) {
-        if (t.len == 6) {
-            char b[18];
-            snprintf(b, sizeof(b), "%02X:%02X:%02X:%02X:%02X:%02X", 
-                     t.bytes[0], t.bytes[1], t.bytes[2], t.bytes[3], t.bytes[4], t.bytes[5]);
-            out += b;
-        } else {
-            char b[9];
-            snprintf(b, sizeof(b), "%02X:%02X:%02X", t.bytes[0], t.bytes[1], t.bytes[2]);
-            out += b;
-        }
-        out += "\n";
+size_t getTrackerTargets(TrackerStatus *out, size_t maxCount) {
+    size_t n = trackedCount < maxCount ? trackedCount : maxCount;
+    for (size_t i = 0; i < n; i++) {
+        TrackerSnapshot snap = getTrackerSnapshot(i);
+        memcpy(out[i].mac, tracked[i].mac, 6);
+        out[i].rssi = snap.filtered > -127 ? snap.filtered : snap.rssi;
+        out[i].trend = snap.trend;
+        out[i].lastSeen = snap.lastSeen;
+        out[i].packets = snap.packets;
+        out[i].distance = snap.distance;
+        out[i].primary = (int)i == trackerPrimary;
     }
-    return out;
+    return n;
+}
+
+static inline size_t trackHash(const uint8_t *mac) {
+    return (mac[5] ^ (mac[4] << 1) ^ (mac[3] << 2) ^ mac[2] ^ (mac[1] >> 1)) & (TRACK_INDEX_SIZE - 1);
 }
 
-void saveTargetsList(const String &txt) {
-    prefs.putString("maclist", txt);
-    targets.clear();
-    int start = 0;
-    while (start < txt.length()) {
-        int nl = txt.indexOf('\n', start);
-        if (nl < 0) nl = txt.length();
-        String line = txt.substring(start, nl);
-        line.trim();
-        if (line.length()) {
-            Target t;
-            if (parseMacLike(line, t)) {
-                targets.push_back(t);
+// Only called while no tracker runs, so the callbacks never see a
+// half-built index
+size_t setTrackerTargets(const uint8_t (*macs)[6], size_t count) {
+    trackedCount = 0;
+    trackerPrimary = -1;
+    memset(trackIndex, 0, sizeof(trackIndex));
+
+    for (size_t i = 0; i < count && trackedCount < TRACKER_MAX_TARGETS; i++) {
+        size_t h = trackHash(macs[i]);
+        bool dup = false;
+        while (trackIndex[h]) {
+            if (memcmp(tracked[trackIndex[h] - 1].mac, macs[i], 6) == 0) {
+                dup = true;
+                break;
             }
+            h = (h + 1) & (TRACK_INDEX_SIZE - 1);
         }
-        start = nl + 1;
-    }
-}
+        if (dup) continue;
 
-void getTrackerStatus(uint8_t mac[6], int8_t &rssi, uint32_t &lastSeen, uint32_t &packets) {
-    memcpy(mac, trackerMac, 6);
-    rssi = trackerRssi;
-    lastSeen = trackerLastSeen;
-    packets = trackerPackets;
+        TrackedTarget &t = tracked[trackedCount];
+        memcpy(t.mac, macs[i], 6);
+        t.snap = { -127, -127, 0, 0, 0, 0 };
+        t.filter.reset();
+        trackIndex[h] = (uint8_t)(++trackedCount);
+    }
+    return trackedCount;
 }
 
-void setTrackerMac(const uint8_t mac[6]) {
-    memcpy(trackerMac, mac, 6);
+static inline int trackerLookup(const uint8_t *mac) {
+    for (size_t h = trackHash(mac); trackIndex[h]; h = (h + 1) & (TRACK_INDEX_SIZE - 1)) {
+        const uint8_t *m = tracked[trackIndex[h] - 1].mac;
+        if (m[5] == mac[5] && memcmp(m, mac, 5) == 0) return trackIndex[h] - 1;
+    }
+    return -1;
 }
 
-static inline bool matchesMac(const uint8_t *mac) {
-    for (auto &t : targets) {
-        if (t.len == 6) {
-            bool eq = true;
-            for (int i = 0; i < 6; i++) {
-                if (mac[i] != t.bytes[i]) {
-                    eq = false;
-                    break;
-                }
-            }
-            if (eq) return true;
-        } else {
-            if (mac[0] == t.bytes[0] && mac[1] == t.bytes[1] && mac[2] == t.bytes[2]) {
-                return true;
-            }
-        }
+static inline void recordTrackerPacket(int target, int8_t rssi) {
+    uint32_t now = millis();
+    TrackerSnapshot &snap = tracked[target].snap;
+    portENTER_CRITICAL(&trackerMux);
+    snap.rssi = rssi;
+    snap.lastSeen = now;
+    snap.packets++;
+    portEXIT_CRITICAL(&trackerMux);
+
+    BaseType_t w = false;
+    if (trackerQueue) {
+        TrackerSample s = { (uint8_t)target, rssi, now };
+        xQueueSendFromISR(trackerQueue, &s, &w);
+    }
+    if (trackerNotifyTask) {
+        xTaskNotifyFromISR(trackerNotifyTask, TRACK_EVT_PACKET, eSetBits, &w);
     }
-    return false;
 }
 
-static inline bool isTrackerTarget(const uint8_t *mac) {
-    for (int i = 0; i < 6; i++) {
-        if (mac[i] != trackerMac[i]) return false;
-    }
-    return true;
+static void beepTimerCb(void *) {
+    if (trackerNotifyTask) xTaskNotify(trackerNotifyTask, TRACK_EVT_BEEP, eSetBits);
 }
 
 static void hopTimerCb(void *) {
     static size_t idx = 0;
+    uint8_t assigned[14];
+    size_t n = getAssignedChannels(assigned, sizeof(assigned));
+    if (n > 0) {
+        idx = (idx + 1) % n;
+        esp_wifi_set_channel(assigned[idx], WIFI_SECOND_CHAN_NONE);
+        return;
+    }
     if (CHANNELS.empty()) return;
     idx = (idx + 1) % CHANNELS.size();
     esp_wifi_set_channel(CHANNELS[idx], WIFI_SECOND_CHAN_NONE);
@@ -238,9 +315,10 @@ static int freqFromRSSI(int8_t rssi) {
 }
 
 // Detection Functions
+// Frames are folded into per-flow windows (deauthwatch.h); the engine
+// reports episodes, so a flood costs a table update per frame, not a queue
+// slot and a console line
 static void IRAM_ATTR detectDeauthFrame(const wifi_promiscuous_pkt_t *ppkt) {
-    if (!deauthDetectionEnabled) return;
-
     const uint8_t *p = ppkt->payload;
     if (ppkt->rx_ctrl.sig_len < 26) return;
 
@@ -249,33 +327,18 @@ static void IRAM_ATTR detectDeauthFrame(const wifi_promiscuous_pkt_t *ppkt) {
     uint8_t subtype = (fc >> 4) & 0xF;
 
     if (ftype == 0 && (subtype == 12 || subtype == 10)) {
-        DeauthHit hit;
-        memcpy(hit.destMac, p + 4, 6);
-        memcpy(hit.srcMac, p + 10, 6);
-        memcpy(hit.bssid, p + 16, 6);
-        hit.rssi = ppkt->rx_ctrl.rssi;
-        hit.channel = ppkt->rx_ctrl.channel;
-        hit.timestamp = millis();
-        hit.isDisassoc = (subtype == 10);
-        hit.reasonCode = (ppkt->rx_ctrl.sig_len >= 26) ? u16(p + 24) : 0;
-
-        if (hit.isDisassoc) {
+        bool isDisassoc = (subtype == 10);
+        if (isDisassoc) {
             disassocCount = disassocCount + 1;
         } else {
             deauthCount = deauthCount + 1;
         }
-
-        BaseType_t w = false;
-        if (deauthQueue) {
-            xQueueSendFromISR(deauthQueue, &hit, &w);
-            if (w) portYIELD_FROM_ISR();
-        }
+        deauthRecord(p + 10, p + 4, p + 16, u16(p + 24), isDisassoc, ppkt->rx_ctrl.rssi,
+                     ppkt->rx_ctrl.channel, millis());
     }
 }
 
 static void IRAM_ATTR detectBeaconFlood(const wifi_promiscuous_pkt_t *ppkt) {
-    if (!beaconFloodDetectionEnabled) return;
-
     const uint8_t *p = ppkt->payload;
     if (ppkt->rx_ctrl.sig_len < 36) return;
 
@@ -290,6 +353,7 @@ static void IRAM_ATTR detectBeaconFlood(const wifi_promiscuous_pkt_t *ppkt) {
         hit.rssi = ppkt->rx_ctrl.rssi;
         hit.channel = ppkt->rx_ctrl.channel;
         hit.timestamp = millis();
+        hit.tsUs = esp_timer_get_time();
         hit.beaconInterval = 0;
         hit.ssid = "";
         
@@ -358,8 +422,6 @@ static void IRAM_ATTR detectBeaconFlood(const wifi_promiscuous_pkt_t *ppkt) {
 }
 
 static void IRAM_ATTR detectEvilAP(const wifi_promiscuous_pkt_t *ppkt) {
-    if (!evilAPDetectionEnabled) return;
-
     const uint8_t *p = ppkt->payload;
     if (ppkt->rx_ctrl.sig_len < 36) return;
 
@@ -368,88 +430,38 @@ static void IRAM_ATTR detectEvilAP(const wifi_promiscuous_pkt_t *ppkt) {
     uint8_t subtype = (fc >> 4) & 0xF;
 
     if (ftype == 0 && (subtype == 8 || subtype == 5)) {
+        ApProfile ap;
+        // sig_len counts the 4-byte FCS, which must not be walked as an IE
+        if (!apParse(p + 24, ppkt->rx_ctrl.sig_len - 28, ap)) return;
+
         EvilAPHit hit;
         memcpy(hit.bssid, p + 16, 6);
         hit.rssi = ppkt->rx_ctrl.rssi;
         hit.channel = ppkt->rx_ctrl.channel;
         hit.timestamp = millis();
-        hit.isOpen = false;
-        hit.beaconInterval = 0;
+        hit.tsUs = esp_timer_get_time();
+        hit.isOpen = !ap.security;
+        hit.security = ap.security;
+        hit.ciphers = ap.ciphers;
+        hit.akms = ap.akms;
+        hit.beaconInterval = ap.beaconInterval;
         hit.detectionFlags = 0;
-        hit.ssid = "";
-        
-        if (subtype == 8 && ppkt->rx_ctrl.sig_len >= 38) {
-            hit.beaconInterval = u16(p + 32);
-            
-            const uint8_t *tags = p + 36;
-            uint32_t remaining = ppkt->rx_ctrl.sig_len - 36;
-            uint32_t offset = 0;
-            
-            while (offset + 1 < remaining) {
-                uint8_t tagType = tags[offset];
-                uint8_t tagLen = tags[offset + 1];
-                
-                if (offset + 2 + tagLen > remaining) break;
-                
-                if (tagType == 0 && tagLen > 0 && tagLen <= 32) {
-                    char ssid_str[33] = {0};
-                    memcpy(ssid_str, tags + offset + 2, tagLen);
-                    hit.ssid = String(ssid_str);
-                } else if (tagType == 48) {
-                    hit.isOpen = (tagLen == 0);
-                }
-                
-                offset += 2 + tagLen;
-            }
-            
-            if (hit.ssid.length() == 0) {
-                hit.isOpen = true;
-            }
-        }
-        
-        String bssidStr = macFmt6(hit.bssid);
-        String ssidKey = hit.ssid;
-        
+        if (ap.ssidLen) memcpy(hit.ssid, ap.ssid, ap.ssidLen);
+        hit.ssid[ap.ssidLen] = 0;
+
         if (hit.rssi > -40) {
             hit.detectionFlags |= EVIL_AP_FLAG_STRONG_SIGNAL;
         }
-        
-        if (hit.beaconInterval > 0 && hit.beaconInterval < 50) {
+
+        if (subtype == 8 && hit.beaconInterval > 0 && hit.beaconInterval < 50) {
             hit.detectionFlags |= EVIL_AP_FLAG_TIMING;
         }
-        
-        if (ssidKey.length() > 0) {
-            if (ssidToBssids[ssidKey].size() == 0) {
-                ssidToBssids[ssidKey].push_back(bssidStr);
-                knownNetworks[bssidStr] = hit;
-            } else {
-                bool foundBssid = false;
-                for (const String& existingBssid : ssidToBssids[ssidKey]) {
-                    if (existingBssid == bssidStr) {
-                        foundBssid = true;
-                        break;
-                    }
-                }
-                
-                if (!foundBssid) {
-                    ssidToBssids[ssidKey].push_back(bssidStr);
-                    hit.detectionFlags |= EVIL_AP_FLAG_TWIN;
-                    
-                    if (knownNetworks.find(ssidToBssids[ssidKey][0]) != knownNetworks.end() && 
-                        !knownNetworks[ssidToBssids[ssidKey][0]].isOpen && hit.isOpen) {
-                        hit.detectionFlags |= EVIL_AP_FLAG_OPEN_SPOOF;
-                    }
-                }
-            }
-        }
-        
-        if (subtype == 5) {
-            probeResponses[bssidStr]++;
-            if (probeResponses[bssidStr] > 10) {
-                hit.detectionFlags |= EVIL_AP_FLAG_KARMA;
-            }
-        }
-        
+
+        uint8_t verdict = apObserve(hit.bssid, ap, subtype == 5, hit.rssi, hit.channel, hit.timestamp);
+        if (verdict & AP_NEW_TWIN) hit.detectionFlags |= EVIL_AP_FLAG_TWIN;
+        if (verdict & AP_OPEN_SPOOF) hit.detectionFlags |= EVIL_AP_FLAG_OPEN_SPOOF;
+        if ((verdict & AP_KARMA) && subtype == 5) hit.detectionFlags |= EVIL_AP_FLAG_KARMA;
+
         if (hit.detectionFlags > 0) {
             evilAPCount = evilAPCount + 1;
             BaseType_t w = false;
@@ -462,6 +474,113 @@ static void IRAM_ATTR detectEvilAP(const wifi_promiscuous_pkt_t *ppkt) {
 }
 
 
+// Blue-team detectors share the sniffer pass. Each frame goes only to the
+// enabled detectors whose subtypes it carries, and each is charged the
+// cycles it spends so their cost can be compared in the field.
+struct BlueDetector {
+    const char *name;
+    uint8_t bit;             // BLUE_*
+    uint16_t mgmtSubtypes;
+    void (*detect)(const wifi_promiscuous_pkt_t *);
+    uint32_t calls;
+    uint64_t cycles;
+};
+
+static BlueDetector blueDetectors[] = {
+    {"deauth", BLUE_DEAUTH, MGMT_DEAUTH | MGMT_DISASSOC, detectDeauthFrame, 0, 0},
+    {"flood", BLUE_FLOOD, MGMT_BEACON, detectBeaconFlood, 0, 0},
+    {"evilap", BLUE_EVILAP, MGMT_BEACON | MGMT_PROBE_RESP, detectEvilAP, 0, 0},
+};
+static const size_t BLUE_DETECTOR_COUNT = sizeof(blueDetectors) / sizeof(blueDetectors[0]);
+
+// Detectors the next run starts with, and those the RX callback runs now
+static uint8_t blueRequested = BLUE_ALL;
+static volatile uint8_t blueMask = 0;
+static volatile bool blueRunning = false;
+static int64_t blueStartUs = 0, blueStopUs = 0;
+static QueueSetHandle_t blueSet = nullptr;
+
+static uint16_t blueSubtypes(uint8_t mask) {
+    uint16_t sub = 0;
+    for (size_t i = 0; i < BLUE_DETECTOR_COUNT; i++) {
+        if (mask & blueDetectors[i].bit) sub |= blueDetectors[i].mgmtSubtypes;
+    }
+    return sub;
+}
+
+static inline void IRAM_ATTR runDetectors(const wifi_promiscuous_pkt_t *ppkt) {
+    uint8_t mask = blueMask;
+    if (!mask) return;
+    uint16_t fc = u16(ppkt->payload);
+    if ((fc >> 2) & 0x3) return;
+    uint16_t subBit = 1u << ((fc >> 4) & 0xF);
+    for (size_t i = 0; i < BLUE_DETECTOR_COUNT; i++) {
+        BlueDetector &d = blueDetectors[i];
+        if (!(mask & d.bit) || !(d.mgmtSubtypes & subBit)) continue;
+        uint32_t c0 = ESP.getCycleCount();
+        d.detect(ppkt);
+        d.cycles += ESP.getCycleCount() - c0;
+        d.calls++;
+    }
+}
+
+void setBlueTeamDetectors(uint8_t mask) {
+    mask &= BLUE_ALL;
+    blueRequested = mask;
+    if (!blueRunning) return;
+    // Widen the filter before a detector starts, narrow it after one stops
+    RxProfile profile = RX_BLUE_TEAM;
+    profile.mgmtSubtypes = blueSubtypes(mask | blueMask);
+    radioUpdate(RADIO_SUB_DETECTORS, profile);
+    blueMask = mask;
+    profile.mgmtSubtypes = blueSubtypes(mask);
+    radioUpdate(RADIO_SUB_DETECTORS, profile);
+    Serial.printf("[BLUE] Detectors now 0x%02X\n", mask);
+}
+
+uint8_t getBlueTeamDetectors() {
+    return blueRunning ? blueMask : blueRequested;
+}
+
+uint8_t parseBlueTeamDetectors(const char *list) {
+    uint8_t mask = 0;
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%s", list);
+    char *save = nullptr;
+    for (char *tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(nullptr, ",", &save)) {
+        if (strcasecmp(tok, "all") == 0) mask |= BLUE_ALL;
+        for (size_t i = 0; i < BLUE_DETECTOR_COUNT; i++) {
+            if (strcasecmp(tok, blueDetectors[i].name) == 0) mask |= blueDetectors[i].bit;
+        }
+    }
+    return mask;
+}
+
+String getBlueTeamStatus() {
+    uint8_t mask = getBlueTeamDetectors();
+    int64_t elapsedUs = (blueRunning ? esp_timer_get_time() : blueStopUs) - blueStartUs;
+    double mhz = getCpuFrequencyMhz();
+    String s;
+    for (size_t i = 0; i < BLUE_DETECTOR_COUNT; i++) {
+        const BlueDetector &d = blueDetectors[i];
+        uint32_t calls = d.calls;
+        double cycles = (double)d.cycles;
+        s += "Detector " + String(d.name) + ": " + ((mask & d.bit) ? "on" : "off");
+        if (calls) {
+            s += ", " + String((unsigned)calls) + " frames, " + String(cycles / calls / mhz, 2) + "us avg";
+            if (elapsedUs > 0) s += ", " + String(100.0 * cycles / mhz / (double)elapsedUs, 3) + "% CPU";
+        }
+        s += "\n";
+    }
+    return s;
+}
+
+// " UTC:<time>" suffix for an event, empty until GPS time is available
+static String utcTag(int64_t tsUs) {
+    UtcStamp t = utcAt(tsUs);
+    return t.valid ? " UTC:" + formatUtc(t) : String();
+}
+
 // BLE Callback Class
 class MyBLEAdvertisedDeviceCallbacks : public BLEAdvertisedDeviceCallbacks {
     void onResult(BLEAdvertisedDevice advertisedDevice) {
@@ -471,21 +590,44 @@ class MyBLEAdvertisedDeviceCallbacks : public BLEAdvertisedDeviceCallbacks {
         String macStr = advertisedDevice.getAddress().toString();
         if (!parseMac6(macStr, mac)) return;
 
-        if (trackerMode) {
-            if (isTrackerTarget(mac)) {
-                trackerRssi = advertisedDevice.getRSSI();
-                trackerLastSeen = millis();
-                trackerPackets = trackerPackets + 1;
-            }
-        } else {
-            if (matchesMac(mac)) {
+#ifdef BLE_ADV_DUMP
+        // Capture format read by tools/blebench.cpp
+        Serial.printf("ADV %s %d ", macStr.c_str(), advertisedDevice.getRSSI());
+        for (size_t i = 0; i < advertisedDevice.getPayloadLength(); i++) {
+            Serial.printf("%02X", advertisedDevice.getPayload()[i]);
+        }
+        Serial.println();
+#endif
+
+        uint8_t subs = radioBleSubs;
+        if (subs & RADIO_SUB_TRACKER) {
+            int t = trackerLookup(mac);
+            if (t >= 0) recordTrackerPacket(t, advertisedDevice.getRSSI());
+        }
+        if (subs & RADIO_SUB_TARGETS) {
+            uint32_t adHits = bleAdvertMatch(advertisedDevice.getPayload(), advertisedDevice.getPayloadLength());
+            int irk = advertisedDevice.getAddressType() == BLE_ADDR_TYPE_RANDOM ? rpaResolve(mac) : -1;
+            if (adHits || irk >= 0 || targetsMatch(mac)) {
                 Hit h;
                 memcpy(h.mac, mac, 6);
                 h.rssi = advertisedDevice.getRSSI();
                 h.ch = 0;
                 h.name = advertisedDevice.getName().length() > 0 ? 
                          advertisedDevice.getName() : String("Unknown");
+                if (adHits) {
+                    // Payload matches carry the pattern label, e.g. "[FindMy] Unknown"
+                    char label[BLE_LABEL_MAX];
+                    blePatternLabel(adHits, label, sizeof(label));
+                    h.name = "[" + String(label) + "] " + h.name;
+                }
+                if (irk >= 0) {
+                    // Resolved RPA: the label names the device behind the rotating address
+                    char label[RPA_LABEL_MAX];
+                    irkLabel(irk, label, sizeof(label));
+                    h.name = "[IRK " + String(label) + "] " + h.name;
+                }
                 h.isBLE = true;
+                h.tsUs = esp_timer_get_time();
 
                 BaseType_t w = false;
                 if (macQueue) { 
@@ -498,16 +640,31 @@ class MyBLEAdvertisedDeviceCallbacks : public BLEAdvertisedDeviceCallbacks {
 };
 
 
+// First stage: RSSI, management subtype and the watchlist OUI bitmap.
+// Everything here is a few loads, well under the cost of the detectors.
+static inline bool IRAM_ATTR rxPrefilter(const wifi_promiscuous_pkt_t *ppkt) {
+    if (ppkt->rx_ctrl.sig_len < 24 || ppkt->rx_ctrl.rssi < rxActive.minRssi) return false;
+    const uint8_t *p = ppkt->payload;
+    uint16_t fc = u16(p);
+    uint8_t ftype = (fc >> 2) & 0x3;
+    uint16_t subBit = 1u << ((fc >> 4) & 0xF);
+    if (ftype == 0 && !(rxActive.mgmtSubtypes & subBit)) return false;
+    if (!rxActive.targetPrefilter || (ftype == 0 && (rxActive.prefilterExempt & subBit))) return true;
+    return targetsMayMatch(p + 4) || targetsMayMatch(p + 10) || targetsMayMatch(p + 16);
+}
+
 // Main WiFi Sniffer Callback
 static void IRAM_ATTR sniffer_cb(void *buf, wifi_promiscuous_pkt_type_t type) {
     const wifi_promiscuous_pkt_t *ppkt = (wifi_promiscuous_pkt_t *)buf;
-    
-    detectDeauthFrame(ppkt);
-    detectBeaconFlood(ppkt);
-    detectEvilAP(ppkt);
+    if (!ppkt) return;
     framesSeen = framesSeen + 1;
-    
-    if (!ppkt || ppkt->rx_ctrl.sig_len < 24) return;
+    if (!rxPrefilter(ppkt)) {
+        framesRejected = framesRejected + 1;
+        return;
+    }
+
+    runDetectors(ppkt);
+    if (!rxActive.watchlist) return;
 
     const uint8_t *p = ppkt->payload;
     uint16_t fc = u16(p);
@@ -570,25 +727,38 @@ static void IRAM_ATTR sniffer_cb(void *buf, wifi_promiscuous_pkt_type_t type) {
         return;
     }
 
-    if (trackerMode && currentScanMode != SCAN_BLE) {
-        if (c1 && isTrackerTarget(cand1)) {
-            trackerRssi = ppkt->rx_ctrl.rssi;
-            trackerLastSeen = millis();
-            trackerPackets = trackerPackets + 1;
-        }
-        if (c2 && isTrackerTarget(cand2)) {
-            trackerRssi = ppkt->rx_ctrl.rssi;
-            trackerLastSeen = millis();
-            trackerPackets = trackerPackets + 1;
+    uint8_t subs = radioWifiSubs;
+    if (subs & RADIO_SUB_TRACKER) {
+        int t = c1 ? trackerLookup(cand1) : -1;
+        if (t < 0 && c2) t = trackerLookup(cand2);
+        if (t >= 0) recordTrackerPacket(t, ppkt->rx_ctrl.rssi);
+    }
+    if (subs & RADIO_SUB_TARGETS) {
+        bool m1 = c1 && targetsMatch(cand1);
+        // Probe requests: link the (possibly random) sender to its IE
+        // fingerprint; a fingerprint tied to a target reports the new MAC
+        bool linked = false;
+        uint64_t fp = 0;
+        uint8_t subtype = (fc >> 4) & 0xF;
+        if (ftype == 0 && subtype == 4 && c1 && ppkt->rx_ctrl.sig_len > 28) {
+            uint8_t ies;
+            fp = probeFingerprint(p + 24, ppkt->rx_ctrl.sig_len - 28, ies);
+            linked = probeRecord(cand1, fp, ies, ppkt->rx_ctrl.rssi, m1) && !m1;
         }
-    } else if (!trackerMode) {
-        if (c1 && matchesMac(cand1)) {
+        if (m1 || linked) {
             Hit h;
             memcpy(h.mac, cand1, 6);
             h.rssi = ppkt->rx_ctrl.rssi;
             h.ch = ppkt->rx_ctrl.channel;
-            h.name = String("WiFi");
+            if (linked) {
+                char name[24];
+                snprintf(name, sizeof(name), "WiFi probe fp:%08X", (unsigned)(fp >> 32));
+                h.name = String(name);
+            } else {
+                h.name = String("WiFi");
+            }
             h.isBLE = false;
+            h.tsUs = esp_timer_get_time();
             
             BaseType_t w = false;
             if (macQueue) { 
@@ -596,13 +766,14 @@ static void IRAM_ATTR sniffer_cb(void *buf, wifi_promiscuous_pkt_type_t type) {
                 if (w) portYIELD_FROM_ISR();
             }
         }
-        if (c2 && matchesMac(cand2)) {
+        if (c2 && targetsMatch(cand2)) {
             Hit h;
             memcpy(h.mac, cand2, 6);
             h.rssi = ppkt->rx_ctrl.rssi;
             h.ch = ppkt->rx_ctrl.channel;
             h.name = String("WiFi");
             h.isBLE = false;
+            h.tsUs = esp_timer_get_time();
             
             BaseType_t w = false;
             if (macQueue) { 
@@ -614,7 +785,9 @@ static void IRAM_ATTR sniffer_cb(void *buf, wifi_promiscuous_pkt_type_t type) {
 }
 
 // Radio Control Functions
-static void radioStartWiFi() {
+static void radioStartWiFi(const RxProfile &profile) {
+    rxActive = profile;
+    framesRejected = 0;
     WiFi.mode(WIFI_MODE_STA);
     wifi_country_t ctry = {.schan = 1, .nchan = 13, .max_tx_power = 78, .policy = WIFI_COUNTRY_POLICY_MANUAL};
     memcpy(ctry.cc, COUNTRY, 2);  // Use COUNTRY instead of hardcoded "NO" - TODO
@@ -623,13 +796,19 @@ static void radioStartWiFi() {
     esp_wifi_start();
 
     wifi_promiscuous_filter_t filter = {};
-    filter.filter_mask = WIFI_PROMIS_FILTER_MASK_MGMT | WIFI_PROMIS_FILTER_MASK_DATA;
+    filter.filter_mask = profile.hwMask;
     esp_wifi_set_promiscuous_filter(&filter);
     esp_wifi_set_promiscuous_rx_cb(&sniffer_cb);
     esp_wifi_set_promiscuous(true);
 
     if (CHANNELS.empty()) CHANNELS = {1, 6, 11};
-    esp_wifi_set_channel(CHANNELS[0], WIFI_SECOND_CHAN_NONE);
+    channelPlanBegin(CHANNELS);
+    uint8_t assigned[14];
+    if (getAssignedChannels(assigned, sizeof(assigned)) > 0) {
+        esp_wifi_set_channel(assigned[0], WIFI_SECOND_CHAN_NONE);
+    } else {
+        esp_wifi_set_channel(CHANNELS[0], WIFI_SECOND_CHAN_NONE);
+    }
     
     const esp_timer_create_args_t targs = {
         .callback = &hopTimerCb, 
@@ -658,52 +837,252 @@ static void radioStopWiFi() {
         hopTimer = nullptr;
     }
     esp_wifi_stop();
+    channelPlanEnd();
 }
 
 static void radioStopBLE() {
     if (pBLEScan) {
+        // Ends a window another session may be blocked in, see radioPollBLE
         pBLEScan->stop();
+        for (int i = 0; bleScanBusy && i < 150; i++) vTaskDelay(pdMS_TO_TICKS(10));
         BLEDevice::deinit(false);
         pBLEScan = nullptr;
     }
 }
 
-static void radioStartSTA() {
-    esp_coex_preference_set(ESP_COEX_PREFER_BALANCE);
-    if (currentScanMode == SCAN_WIFI || currentScanMode == SCAN_BOTH) {
-        radioStartWiFi();
+// Radio session arbiter. List scan, tracker and the blue-team detectors
+// attach with the radios and RX profile they need. The first attach takes
+// the AP down and starts the sniffer; later ones join it without a restart,
+// on the channel plan already running, and the last detach brings the AP
+// back. The WiFi profile in force is the union of the attached ones. The
+// first WiFi attach joins the mesh channel plan and the last one leaves it.
+static const char *RADIO_SUB_NAMES[RADIO_SUB_COUNT] = {"targets", "tracker", "detectors"};
+static SemaphoreHandle_t radioLock = nullptr;
+static RxProfile radioProfiles[RADIO_SUB_COUNT];
+static uint32_t nextBLEScan = 0;
+static volatile uint8_t radioStops = 0;
+static portMUX_TYPE radioMux = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t resultsLock = nullptr;
+static String radioResults[RADIO_SUB_COUNT];
+
+static inline size_t subIndex(uint8_t sub) {
+    return (size_t)__builtin_ctz(sub);
+}
+
+static RxProfile mergeProfiles(uint8_t subs) {
+    RxProfile m = {"idle", 0, 0, 0, true, 0, false};
+    bool first = true;
+    for (size_t i = 0; i < RADIO_SUB_COUNT; i++) {
+        if (!(subs & (1u << i))) continue;
+        const RxProfile &p = radioProfiles[i];
+        m.name = first ? p.name : "shared";
+        first = false;
+        m.hwMask |= p.hwMask;
+        m.mgmtSubtypes |= p.mgmtSubtypes;
+        if (p.minRssi < m.minRssi) m.minRssi = p.minRssi;
+        // Any subscriber that needs frames regardless of address wins
+        m.targetPrefilter = m.targetPrefilter && p.targetPrefilter;
+        m.prefilterExempt |= p.prefilterExempt;
+        m.watchlist = m.watchlist || p.watchlist;
     }
-    if (currentScanMode == SCAN_BLE || currentScanMode == SCAN_BOTH) {
-        radioStartBLE();
+    return m;
+}
+
+// Caller holds radioLock. The callback reads rxActive field by field, so a
+// frame racing this may see a mix of old and new; that costs only it.
+static void applyProfile() {
+    RxProfile m = mergeProfiles(radioWifiSubs);
+    if (m.hwMask != rxActive.hwMask) {
+        wifi_promiscuous_filter_t filter = {};
+        filter.filter_mask = m.hwMask;
+        esp_wifi_set_promiscuous_filter(&filter);
     }
+    rxActive = m;
 }
 
-static void radioStopSTA() {
-    radioStopWiFi();
-    radioStopBLE();
+static void radioAttach(uint8_t sub, const RxProfile &profile, bool wifi, bool ble) {
+    xSemaphoreTake(radioLock, portMAX_DELAY);
+    if (!radioWifiSubs && !radioBleSubs) {
+        stopAPAndServer();
+        esp_coex_preference_set(ESP_COEX_PREFER_BALANCE);
+        framesSeen = 0;
+        bleFramesSeen = 0;
+        scanning = true;
+    }
+    radioProfiles[subIndex(sub)] = profile;
+    if (wifi) {
+        bool running = radioWifiSubs != 0;
+        radioWifiSubs |= sub;
+        if (running) applyProfile();
+        else radioStartWiFi(mergeProfiles(radioWifiSubs));
+    }
+    if (ble) {
+        if (!radioBleSubs) {
+            radioStartBLE();
+            nextBLEScan = millis();
+        }
+        radioBleSubs |= sub;
+    }
+    Serial.printf("[RADIO] %s attached, wifi=0x%02X ble=0x%02X\n", RADIO_SUB_NAMES[subIndex(sub)],
+                  radioWifiSubs, radioBleSubs);
+    xSemaphoreGive(radioLock);
+}
+
+static void radioDetach(uint8_t sub) {
+    xSemaphoreTake(radioLock, portMAX_DELAY);
+    if (radioWifiSubs & sub) {
+        radioWifiSubs &= ~sub;
+        if (radioWifiSubs) applyProfile();
+        else radioStopWiFi();
+    }
+    if (radioBleSubs & sub) {
+        radioBleSubs &= ~sub;
+        if (!radioBleSubs) radioStopBLE();
+    }
+    Serial.printf("[RADIO] %s detached, wifi=0x%02X ble=0x%02X\n", RADIO_SUB_NAMES[subIndex(sub)],
+                  radioWifiSubs, radioBleSubs);
+    if (!radioWifiSubs && !radioBleSubs) {
+        scanning = false;
+        startAPAndServer();
+    }
+    xSemaphoreGive(radioLock);
+}
+
+// Replaces an attached subscriber's profile in place
+static void radioUpdate(uint8_t sub, const RxProfile &profile) {
+    xSemaphoreTake(radioLock, portMAX_DELAY);
+    radioProfiles[subIndex(sub)] = profile;
+    if (radioWifiSubs & sub) applyProfile();
+    xSemaphoreGive(radioLock);
+}
+
+// BLE scans run in 1 s windows. Whichever BLE subscriber gets here first
+// once one is due runs it; the others carry on with their own work. The
+// window blocks, so it runs outside radioLock and attach/update calls are
+// not held up behind it.
+static void radioPollBLE() {
+    if (!radioBleSubs || (int32_t)(millis() - nextBLEScan) < 0) return;
+    if (xSemaphoreTake(radioLock, 0) != pdTRUE) return;
+    BLEScan *scan = nullptr;
+    if (radioBleSubs && pBLEScan && !bleScanBusy && (int32_t)(millis() - nextBLEScan) >= 0) {
+        scan = pBLEScan;
+        bleScanBusy = true;
+        nextBLEScan = millis() + 1100;
+    }
+    xSemaphoreGive(radioLock);
+    if (!scan) return;
+    scan->start(1, false);
+    bleScanBusy = false;
+}
+
+// Milliseconds until radioPollBLE has work, capped at limit
+static int32_t radioBLEDueIn(int32_t limit) {
+    if (!radioBleSubs) return limit;
+    int32_t due = (int32_t)(nextBLEScan - millis());
+    return due < limit ? due : limit;
+}
+
+uint8_t radioSubscribers() {
+    return radioWifiSubs | radioBleSubs;
+}
+
+void radioRequestStop(uint8_t subs) {
+    portENTER_CRITICAL(&radioMux);
+    radioStops |= subs;
+    portEXIT_CRITICAL(&radioMux);
+}
+
+void radioClearStop(uint8_t sub) {
+    portENTER_CRITICAL(&radioMux);
+    radioStops &= ~sub;
+    portEXIT_CRITICAL(&radioMux);
+}
+
+bool radioStopRequested(uint8_t sub) {
+    return radioStops & sub;
+}
+
+uint8_t parseRadioSessions(const char *s) {
+    static const char *const names[RADIO_SUB_COUNT] = {"scan", "track", "detect"};
+    uint8_t subs = 0;
+    while (s && *s) {
+        const char *end = strchr(s, ',');
+        size_t len = end ? (size_t)(end - s) : strlen(s);
+        if (len == 3 && !strncasecmp(s, "all", 3)) subs |= RADIO_SUB_ALL;
+        for (size_t i = 0; i < RADIO_SUB_COUNT; i++) {
+            if (len == strlen(names[i]) && !strncasecmp(s, names[i], len)) subs |= 1u << i;
+        }
+        s = end ? end + 1 : nullptr;
+    }
+    return subs;
+}
+
+static void radioSetResults(uint8_t sub, const String &results) {
+    xSemaphoreTake(resultsLock, portMAX_DELAY);
+    radioResults[subIndex(sub)] = results;
+    xSemaphoreGive(resultsLock);
+}
+
+String getSessionResults(uint8_t subs) {
+    String out;
+    xSemaphoreTake(resultsLock, portMAX_DELAY);
+    for (size_t i = 0; i < RADIO_SUB_COUNT; i++) {
+        if (!(subs & (1u << i)) || !radioResults[i].length()) continue;
+        if (out.length()) out += "\n";
+        out += radioResults[i];
+    }
+    xSemaphoreGive(resultsLock);
+    return out;
+}
+
+String getRadioStatus() {
+    uint8_t wifi = radioWifiSubs, ble = radioBleSubs;
+    if (!(wifi | ble)) return "Radio: idle\n";
+    String s = "Radio:";
+    for (size_t i = 0; i < RADIO_SUB_COUNT; i++) {
+        uint8_t bit = 1u << i;
+        if (!((wifi | ble) & bit)) continue;
+        s += String(" ") + RADIO_SUB_NAMES[i] + "(" + ((wifi & bit) && (ble & bit) ? "WiFi+BLE" : (wifi & bit) ? "WiFi" : "BLE") + ")";
+    }
+    return s + "\n";
+}
+
+void setScanMinRssi(int dbm) {
+    listScanMinRssi = (int8_t)clampi(dbm, RSSI_ANY, 0);
+}
+
+String getRxFilterStatus() {
+    String s = "RX filter: " + String(rxActive.name) + ((rxActive.hwMask & WIFI_PROMIS_FILTER_MASK_DATA) ? " mgmt+data" : " mgmt");
+    if (rxActive.minRssi > RSSI_ANY) s += " >=" + String((int)rxActive.minRssi) + "dBm";
+    uint32_t seen = framesSeen;
+    s += ", rejected " + String((unsigned)framesRejected) + "/" + String((unsigned)seen) + "\n";
+    return s;
 }
 
 void initializeScanner() {
+    if (!radioLock) radioLock = xSemaphoreCreateMutex();
+    if (!resultsLock) resultsLock = xSemaphoreCreateMutex();
     Serial.println("Loading targets...");
-    String txt = prefs.getString("maclist", "");
-    saveTargetsList(txt);
-    Serial.printf("Loaded %d targets\n", targets.size());
+    loadTargets();
+    loadIrkTargets();
 }
 
 // Task Functions
 void listScanTask(void *pv) {
-    int secs = (int)(intptr_t)pv;
+    ScanStart *start = (ScanStart *)pv;
+    int secs = start->secs;
+    ScanMode mode = start->mode;
+    delete start;
     bool forever = (secs <= 0);
-    String modeStr = (currentScanMode == SCAN_WIFI) ? "WiFi" : 
-                     (currentScanMode == SCAN_BLE) ? "BLE" : "WiFi+BLE";
+    bool useWifi = (mode == SCAN_WIFI || mode == SCAN_BOTH);
+    bool useBle = (mode == SCAN_BLE || mode == SCAN_BOTH);
+    String modeStr = (mode == SCAN_WIFI) ? "WiFi" : 
+                     (mode == SCAN_BLE) ? "BLE" : "WiFi+BLE";
     
     Serial.printf("[SCAN] List scan %s (%s)...\n", 
                   forever ? "(forever)" : String(String("for ") + secs + " seconds").c_str(), 
                   modeStr.c_str());
 
-    stopAPAndServer();
-
-    stopRequested = false;
     if (macQueue) {
         vQueueDelete(macQueue);
         macQueue = nullptr;
@@ -712,28 +1091,26 @@ void listScanTask(void *pv) {
 
     uniqueMacs.clear();
     hitsLog.clear();
+    historyBeginSession();
     totalHits = 0;
-    framesSeen = 0;
-    bleFramesSeen = 0;
-    scanning = true;
-    lastScanStart = millis();
+    uint32_t started = millis();
     lastScanSecs = secs;
     lastScanForever = forever;
 
-    radioStartSTA();
+    RxProfile profile = RX_LIST_SCAN;
+    profile.minRssi = listScanMinRssi;
+    radioAttach(RADIO_SUB_TARGETS, profile, useWifi, useBle);
     Serial.printf("[SCAN] Mode: %s\n", modeStr.c_str());
-    if (currentScanMode == SCAN_WIFI || currentScanMode == SCAN_BOTH) {
+    if (useWifi) {
         Serial.printf("[SCAN] WiFi channel hop list: ");
         for (auto c : CHANNELS) Serial.printf("%d ", c);
         Serial.println();
     }
 
     uint32_t nextStatus = millis() + 1000;
-    uint32_t nextBLEScan = millis();
     Hit h;
 
-    while ((forever && !stopRequested) || 
-           (!forever && (int)(millis() - lastScanStart) < secs * 1000 && !stopRequested)) {
+    while (!radioStopRequested(RADIO_SUB_TARGETS) && (forever || (int)(millis() - started) < secs * 1000)) {
         
         if ((int32_t)(millis() - nextStatus) >= 0) {
             Serial.printf("Status: Tracking %d devices... WiFi frames=%u BLE frames=%u\n",
@@ -741,480 +1118,520 @@ void listScanTask(void *pv) {
             nextStatus += 1000;
         }
 
-        if ((currentScanMode == SCAN_BLE || currentScanMode == SCAN_BOTH) && pBLEScan) {
-            if ((int32_t)(millis() - nextBLEScan) >= 0) {
-                pBLEScan->start(1, false);
-                nextBLEScan = millis() + 1100;
-            }
-        }
+        radioPollBLE();
 
         if (xQueueReceive(macQueue, &h, pdMS_TO_TICKS(50)) == pdTRUE)
         {
             totalHits = totalHits + 1;
             hitsLog.push_back(h);
-            uniqueMacs.insert(macFmt6(h.mac));
+            bool firstSighting = uniqueMacs.insert(macFmt6(h.mac)).second;
 
             String logEntry = String(h.isBLE ? "BLE" : "WiFi") + " " + macFmt6(h.mac) +
                               " RSSI=" + String(h.rssi) + "dBm";
-            if (gpsValid) {
-                logEntry += " GPS=" + String(gpsLat, 6) + "," + String(gpsLon, 6);
+            GpsFix fix = getGpsFix();
+            if (fix.valid) {
+                logEntry += " GPS=" + String(fix.lat, 6) + "," + String(fix.lon, 6);
+            }
+            DeviceHistory hist;
+            if (historyRecord(h, hist) && hist.sessions > 1) {
+                logEntry += " recurring sessions=" + String(hist.sessions);
             }
 
-            Serial.printf("[HIT] %s ch=%u name=%s\n", logEntry.c_str(),
-                          (unsigned)h.ch, h.name.c_str());
-            logToSD(logEntry);
+            UtcStamp at = utcAt(h.tsUs);
+            Serial.printf("[HIT] %s ch=%u name=%s%s%s\n", logEntry.c_str(),
+                          (unsigned)h.ch, h.name.c_str(), at.valid ? " utc=" : "",
+                          at.valid ? formatUtc(at).c_str() : "");
+            logToSD(logEntry, h.tsUs);
+            geoStoreRecord(h, fix);
 
             beepPattern(getBeepsPerHit(), getGapMs());
-            sendMeshNotification(h);
+            sendMeshNotification(h, firstSighting);
         }
     }
 
-    radioStopSTA();
-    scanning = false;
-    lastScanEnd = millis();
+    radioDetach(RADIO_SUB_TARGETS);
+    geoStoreFlush();
+    historyFlush();
 
     // Build results
-    lastResults = String("List scan — Mode: ") + modeStr + " Duration: " + (forever ? "∞" : String(secs)) + "s\n";
-    lastResults += "WiFi Frames seen: " + String((unsigned)framesSeen) + "\n";
-    lastResults += "BLE Frames seen: " + String((unsigned)bleFramesSeen) + "\n";
-    lastResults += "Total hits: " + String(totalHits) + "\n";
-    lastResults += "Unique devices: " + String((int)uniqueMacs.size()) + "\n\n";
+    String results = String("List scan — Mode: ") + modeStr + " Duration: " + (forever ? "∞" : String(secs)) + "s\n";
+    results += "WiFi Frames seen: " + String((unsigned)framesSeen) + "\n";
+    results += "BLE Frames seen: " + String((unsigned)bleFramesSeen) + "\n";
+    results += "Total hits: " + String(totalHits) + "\n";
+    results += "Unique devices: " + String((int)uniqueMacs.size()) + "\n\n";
     
     int show = hitsLog.size();
     if (show > 500) show = 500;
     for (int i = 0; i < show; i++) {
         const auto &e = hitsLog[i];
-        lastResults += String(e.isBLE ? "BLE " : "WiFi") + " " + macFmt6(e.mac) + "  RSSI=" + String((int)e.rssi) + "dBm";
-        if (!e.isBLE) lastResults += "  ch=" + String((int)e.ch);
-        if (e.name.length() > 0 && e.name != "WiFi") lastResults += "  name=" + e.name;
-        lastResults += "\n";
+        results += String(e.isBLE ? "BLE " : "WiFi") + " " + macFmt6(e.mac) + "  RSSI=" + String((int)e.rssi) + "dBm";
+        if (!e.isBLE) results += "  ch=" + String((int)e.ch);
+        if (e.name.length() > 0 && e.name != "WiFi") results += "  name=" + e.name;
+        results += "\n";
     }
     if ((int)hitsLog.size() > show) {
-        lastResults += "... (" + String((int)hitsLog.size() - show) + " more)\n";
+        results += "... (" + String((int)hitsLog.size() - show) + " more)\n";
     }
+    radioSetResults(RADIO_SUB_TARGETS, results);
 
-    startAPAndServer();
     extern TaskHandle_t workerTaskHandle;
     workerTaskHandle = nullptr;
     vTaskDelete(nullptr);
 }
 
+// The buzzer follows the earliest-listed target heard within
+// TRACKER_RECENT_MS; list order is the operator's priority order
+static int pickPrimaryTarget(uint32_t now) {
+    for (size_t i = 0; i < trackedCount; i++) {
+        const RssiFilter &f = tracked[i].filter;
+        if (f.valid() && now - f.lastUpdate() < TRACKER_RECENT_MS) return (int)i;
+    }
+    return -1;
+}
+
 void trackerTask(void *pv) {
-    int secs = (int)(intptr_t)pv;
+    ScanStart *start = (ScanStart *)pv;
+    int secs = start->secs;
+    ScanMode mode = start->mode;
+    delete start;
     bool forever = (secs <= 0);
-    String modeStr = (currentScanMode == SCAN_WIFI) ? "WiFi" : 
-                     (currentScanMode == SCAN_BLE) ? "BLE" : "WiFi+BLE";
+    bool useWifi = (mode == SCAN_WIFI || mode == SCAN_BOTH);
+    bool useBle = (mode == SCAN_BLE || mode == SCAN_BOTH);
+    String modeStr = (mode == SCAN_WIFI) ? "WiFi" : 
+                     (mode == SCAN_BLE) ? "BLE" : "WiFi+BLE";
     
-    Serial.printf("[TRACK] Tracker %s (%s)... target=%s\n",
+    Serial.printf("[TRACK] Tracker %s (%s)... %u target(s), buzzer priority in list order\n",
                   forever ? "(forever)" : String(String("for ") + secs + " s").c_str(),
-                  modeStr.c_str(), macFmt6(trackerMac).c_str());
+                  modeStr.c_str(), (unsigned)trackedCount);
+    for (size_t i = 0; i < trackedCount; i++) {
+        Serial.printf("[TRACK]   %u: %s\n", (unsigned)(i + 1), macFmt6(tracked[i].mac).c_str());
+    }
 
-    stopAPAndServer();
+    if (trackerQueue) {
+        vQueueDelete(trackerQueue);
+        trackerQueue = nullptr;
+    }
+    trackerQueue = xQueueCreate(64, sizeof(TrackerSample));
+
+    portENTER_CRITICAL(&trackerMux);
+    for (size_t i = 0; i < trackedCount; i++) tracked[i].snap = { -90, -127, 0, 0, 0, 0 };
+    portEXIT_CRITICAL(&trackerMux);
+    for (size_t i = 0; i < trackedCount; i++) tracked[i].filter.reset();
+    trackerPrimary = -1;
+
+    if (!beepTimer) {
+        const esp_timer_create_args_t bargs = {
+            .callback = &beepTimerCb,
+            .arg = nullptr,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "beep"
+        };
+        esp_timer_create(&bargs, &beepTimer);
+    }
 
+    trackerNotifyTask = xTaskGetCurrentTaskHandle();
     trackerMode = true;
-    trackerPackets = 0;
-    trackerRssi = -90;
-    trackerLastSeen = 0;
-    framesSeen = 0;
-    bleFramesSeen = 0;
-    scanning = true;
-    lastScanStart = millis();
+    uint32_t started = millis();
     lastScanSecs = secs;
     lastScanForever = forever;
-    stopRequested = false;
 
-    radioStartSTA();
+    radioAttach(RADIO_SUB_TRACKER, RX_TRACKER, useWifi, useBle);
     Serial.printf("[TRACK] Mode: %s\n", modeStr.c_str());
-    if (currentScanMode == SCAN_WIFI || currentScanMode == SCAN_BOTH) {
+    if (useWifi) {
         Serial.printf("[TRACK] WiFi channel hop list: ");
         for (auto c : CHANNELS) Serial.printf("%d ", c);
         Serial.println();
     }
 
     uint32_t nextStatus = millis() + 1000;
-    uint32_t nextBeep = millis() + 400;
-    uint32_t nextBLEScan = millis();
-    float ema = -90.0f;
+    esp_timer_start_once(beepTimer, 400 * 1000);
 
-    while ((forever && !stopRequested) || 
-           (!forever && (int)(millis() - lastScanStart) < secs * 1000 && !stopRequested)) {
-        
-        if ((int32_t)(millis() - nextStatus) >= 0) {
-            uint32_t ago = trackerLastSeen ? (millis() - trackerLastSeen) : 0;
-            Serial.printf("Status: WiFi frames=%u BLE frames=%u target_rssi=%ddBm seen_ago=%ums packets=%u\n",
-                          (unsigned)framesSeen, (unsigned)bleFramesSeen, (int)trackerRssi, (unsigned)ago, (unsigned)trackerPackets);
-            nextStatus += 1000;
-        }
+    while (!radioStopRequested(RADIO_SUB_TRACKER) && (forever || (int)(millis() - started) < secs * 1000)) {
 
-        if ((currentScanMode == SCAN_BLE || currentScanMode == SCAN_BOTH) && pBLEScan) {
-            if ((int32_t)(millis() - nextBLEScan) >= 0) {
-                pBLEScan->start(1, false);
-                nextBLEScan = millis() + 1100;
+        // Sleep until a packet or beep is due, or the next housekeeping deadline
+        uint32_t now = millis();
+        int32_t wait = radioBLEDueIn((int32_t)(nextStatus - now));
+        if (!forever) {
+            int32_t left = secs * 1000 - (int32_t)(now - started);
+            if (left < wait) wait = left;
+        }
+        wait = clampi(wait, 1, TRACKER_MAX_WAIT_MS);
+
+        uint32_t events = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &events, pdMS_TO_TICKS(wait));
+
+        if (events & TRACK_EVT_PACKET) {
+            uint32_t touched = 0;
+            TrackerSample sample;
+            while (xQueueReceive(trackerQueue, &sample, 0) == pdTRUE) {
+                if (sample.target >= trackedCount) continue;
+                tracked[sample.target].filter.update(sample.rssi, sample.t);
+                touched |= 1u << sample.target;
+            }
+            for (size_t i = 0; i < trackedCount; i++) {
+                const RssiFilter &f = tracked[i].filter;
+                if (!(touched & (1u << i)) || !f.valid()) continue;
+                int8_t filtered = (int8_t)clampi((int)lroundf(f.rssi()), -127, 0);
+                int8_t trend = (int8_t)f.trend();
+                float dist = f.distance();
+                portENTER_CRITICAL(&trackerMux);
+                tracked[i].snap.filtered = filtered;
+                tracked[i].snap.trend = trend;
+                tracked[i].snap.distance = dist;
+                portEXIT_CRITICAL(&trackerMux);
             }
         }
 
-        uint32_t now = millis();
-        bool gotRecent = trackerLastSeen && (now - trackerLastSeen) < 2000;
-
-        if (gotRecent) {
-            ema = 0.75f * ema + 0.25f * (float)trackerRssi;
-        } else {
-            ema = 0.995f * ema - 0.05f;
+        now = millis();
+        int primary = pickPrimaryTarget(now);
+        if (primary != trackerPrimary) {
+            if (primary >= 0) {
+                Serial.printf("[TRACK] Buzzer following %s\n", macFmt6(tracked[primary].mac).c_str());
+            }
+            trackerPrimary = (int8_t)primary;
         }
 
-        int period = gotRecent ? periodFromRSSI((int8_t)ema) : 1400;
-        int freq = gotRecent ? freqFromRSSI((int8_t)ema) : 2200;
-        int dur = gotRecent ? 60 : 40;
+        if (events & TRACK_EVT_BEEP) {
+            bool gotRecent = primary >= 0;
+            int8_t level = gotRecent ? (int8_t)clampi((int)lroundf(tracked[primary].filter.rssi()), -127, 0) : -127;
+
+            int period = gotRecent ? periodFromRSSI(level) : 1400;
+            int freq = gotRecent ? freqFromRSSI(level) : 2200;
+            int dur = gotRecent ? 60 : 40;
 
-        if ((int32_t)(now - nextBeep) >= 0) {
             beepOnce((uint32_t)freq, (uint32_t)dur);
-            nextBeep = now + period;
+            esp_timer_start_once(beepTimer, (uint64_t)(period - dur) * 1000);
         }
 
+        if ((int32_t)(now - nextStatus) >= 0) {
+            Serial.printf("Status: WiFi frames=%u BLE frames=%u\n", (unsigned)framesSeen, (unsigned)bleFramesSeen);
+            for (size_t i = 0; i < trackedCount; i++) {
+                TrackerSnapshot snap = getTrackerSnapshot(i);
+                if (!snap.packets) continue;
+                const RssiFilter &f = tracked[i].filter;
+                int trend = f.trend();
+                Serial.printf("  %s%s target_rssi=%ddBm filtered=%.1fdBm %s ~%.1fm seen_ago=%ums packets=%u\n",
+                              (int)i == primary ? "*" : " ", macFmt6(tracked[i].mac).c_str(), (int)snap.rssi, f.rssi(),
+                              trend > 0 ? "closer" : trend < 0 ? "farther" : "steady", f.distance(),
+                              (unsigned)(now - snap.lastSeen), (unsigned)snap.packets);
+            }
+            nextStatus += 1000;
+        }
+
+        radioPollBLE();
+
         if (trackerMode) {
             sendTrackerMeshUpdate();
         }
-
-        vTaskDelay(pdMS_TO_TICKS(10));
     }
 
-    radioStopSTA();
-    scanning = false;
+    esp_timer_stop(beepTimer);
+    trackerNotifyTask = nullptr;
+    radioDetach(RADIO_SUB_TRACKER);
     trackerMode = false;
-    lastScanEnd = millis();
 
-    lastResults = String("Tracker — Mode: ") + modeStr + " Duration: " + (forever ? "∞" : String(secs)) + "s\n";
-    lastResults += "WiFi Frames seen: " + String((unsigned)framesSeen) + "\n";
-    lastResults += "BLE Frames seen: " + String((unsigned)bleFramesSeen) + "\n";
-    lastResults += "Target: " + macFmt6(trackerMac) + "\n";
-    lastResults += "Packets from target: " + String((unsigned)trackerPackets) + "\n";
-    lastResults += "Last RSSI: " + String((int)trackerRssi) + "dBm\n";
+    String results = String("Tracker — Mode: ") + modeStr + " Duration: " + (forever ? "∞" : String(secs)) + "s\n";
+    results += "WiFi Frames seen: " + String((unsigned)framesSeen) + "\n";
+    results += "BLE Frames seen: " + String((unsigned)bleFramesSeen) + "\n";
+    for (size_t i = 0; i < trackedCount; i++) {
+        TrackerSnapshot snap = getTrackerSnapshot(i);
+        const RssiFilter &f = tracked[i].filter;
+        results += "Target: " + macFmt6(tracked[i].mac) + "  packets=" + String((unsigned)snap.packets);
+        if (snap.packets) results += "  last RSSI=" + String((int)snap.rssi) + "dBm";
+        if (f.valid()) {
+            results += "  filtered=" + String(f.rssi(), 1) + "dBm (~" + String(f.distance(), 1) + "m, " +
+                           String((unsigned)f.rejected()) + " outliers rejected)";
+        }
+        results += "\n";
+    }
+    radioSetResults(RADIO_SUB_TRACKER, results);
 
-    startAPAndServer();
-    extern TaskHandle_t workerTaskHandle;
-    workerTaskHandle = nullptr;
+    extern TaskHandle_t trackerTaskHandle;
+    trackerTaskHandle = nullptr;
     vTaskDelete(nullptr);
 }
 
-void deauthDetectionTask(void *pv) {
-    int secs = (int)(intptr_t)pv;
-    bool forever = (secs <= 0);
-    
-    Serial.printf("[BLUE] Deauth detection %s...\n", 
-                  forever ? "(forever)" : String(String("for ") + secs + " seconds").c_str());
-
-    stopAPAndServer();
-
-    stopRequested = false;
-    if (!deauthQueue) {
-        deauthQueue = xQueueCreate(256, sizeof(DeauthHit));
+// Blue-team consumers: one per detector, fed from the shared queue set
+static void consumeDeauth(const DeauthEpisode &ep, uint32_t &lastAlert) {
+    if (ep.active) {
+        Serial.printf("[ATTACK] %s%s\n", deauthEpisodeLine(ep).c_str(), utcTag(ep.tsUs).c_str());
+        if (millis() - lastAlert > 3000) {
+            beepPattern(4, 80);
+            lastAlert = millis();
+        }
+        return;
     }
 
-    deauthLog.clear();
-    deauthCount = 0;
-    disassocCount = 0;
-    framesSeen = 0;
-    scanning = true;
-    deauthDetectionEnabled = true;
-    uint32_t scanStart = millis();
+    Serial.printf("[ATTACK] END %s\n", deauthEpisodeLine(ep).c_str());
+    deauthLog.push_back(ep);
+    if (deauthLog.size() > 200) {
+        deauthLog.erase(deauthLog.begin(), deauthLog.begin() + 100);
+    }
+}
 
-    radioStartWiFi();
-    Serial.println("[BLUE] WiFi monitoring started for deauth/disassoc detection");
+static void consumeBeacon(const BeaconHit &hit, uint32_t &lastAlert) {
+    beaconLog.push_back(hit);
 
-    DeauthHit hit;
-    uint32_t lastAlert = 0;
-    uint32_t nextStatus = millis() + 1000;
+    String macStr = macFmt6(hit.srcMac);
+    uint32_t count = beaconCounts[macStr];
 
-    while ((forever && !stopRequested) || 
-           (!forever && (int)(millis() - scanStart) < secs * 1000 && !stopRequested)) {
-        
-        if ((int32_t)(millis() - nextStatus) >= 0) {
-            Serial.printf("[BLUE] Monitoring... deauth=%u disassoc=%u frames=%u\n",
-                          (unsigned)deauthCount, (unsigned)disassocCount, (unsigned)framesSeen);
-            nextStatus += 1000;
-        }
+    Serial.printf("[FLOOD] BEACON %s SSID:'%s' Count:%u RSSI:%ddBm CH:%u Interval:%u%s\n",
+                  macStr.c_str(), hit.ssid.c_str(), count,
+                  hit.rssi, hit.channel, hit.beaconInterval, utcTag(hit.tsUs).c_str());
 
-        if (xQueueReceive(deauthQueue, &hit, pdMS_TO_TICKS(100)) == pdTRUE) {
-            deauthLog.push_back(hit);
-            
-            Serial.printf("[ATTACK] %s %s->%s BSSID:%s RSSI:%ddBm CH:%u Reason:%u\n",
-                          hit.isDisassoc ? "DISASSOC" : "DEAUTH",
-                          macFmt6(hit.srcMac).c_str(), macFmt6(hit.destMac).c_str(), 
-                          macFmt6(hit.bssid).c_str(), hit.rssi, hit.channel, hit.reasonCode);
-            
-            if (millis() - lastAlert > 3000) {
-                beepPattern(4, 80);
-                lastAlert = millis();
-            }
-            
-            if (deauthLog.size() > 500) {
-                deauthLog.erase(deauthLog.begin(), deauthLog.begin() + 250);
-            }
-        }
+    if (millis() - lastAlert > 5000) {
+        beepPattern(3, 100);
+        lastAlert = millis();
     }
 
-    radioStopWiFi();
-    scanning = false;
-    deauthDetectionEnabled = false;
-
-    lastResults = String("Blue Team Detection — Duration: ") + (forever ? "∞" : String(secs)) + "s\n";
-    lastResults += "WiFi Frames seen: " + String((unsigned)framesSeen) + "\n";
-    lastResults += "Deauth frames detected: " + String((unsigned)deauthCount) + "\n";
-    lastResults += "Disassoc frames detected: " + String((unsigned)disassocCount) + "\n\n";
-    
-    int show = min((int)deauthLog.size(), 100);
-    for (int i = 0; i < show; i++) {
-        const auto &e = deauthLog[i];
-        lastResults += String(e.isDisassoc ? "DISASSOC" : "DEAUTH") + " ";
-        lastResults += macFmt6(e.srcMac) + " -> " + macFmt6(e.destMac);
-        lastResults += " BSSID:" + macFmt6(e.bssid);
-        lastResults += " RSSI:" + String(e.rssi) + "dBm";
-        lastResults += " CH:" + String(e.channel);
-        lastResults += " Reason:" + String(e.reasonCode) + "\n";
+    if (beaconLog.size() > 200) {
+        beaconLog.erase(beaconLog.begin(), beaconLog.begin() + 100);
     }
-    if ((int)deauthLog.size() > show) {
-        lastResults += "... (" + String((int)deauthLog.size() - show) + " more)\n";
-    }
-
-    Serial.println("[BLUE] Deauth detection stopped, restoring AP...");
-    startAPAndServer();
-    
-    extern TaskHandle_t blueTeamTaskHandle;
-    blueTeamTaskHandle = nullptr;
-    vTaskDelete(nullptr);
 }
 
-void beaconFloodTask(void *pv) {
-    int secs = (int)(intptr_t)pv;
-    bool forever = (secs <= 0);
-    
-    Serial.printf("[BLUE] Beacon flood detection %s...\n", 
-                  forever ? "(forever)" : String(String("for ") + secs + " seconds").c_str());
+static void consumeEvilAP(const EvilAPHit &hit, uint32_t &lastAlert) {
+    evilAPLog.push_back(hit);
 
-    stopAPAndServer();
+    String flags = "";
+    if (hit.detectionFlags & EVIL_AP_FLAG_TWIN) flags += "TWIN ";
+    if (hit.detectionFlags & EVIL_AP_FLAG_STRONG_SIGNAL) flags += "STRONG ";
+    if (hit.detectionFlags & EVIL_AP_FLAG_KARMA) flags += "KARMA ";
+    if (hit.detectionFlags & EVIL_AP_FLAG_OPEN_SPOOF) flags += "OPEN_SPOOF ";
+    if (hit.detectionFlags & EVIL_AP_FLAG_TIMING) flags += "TIMING ";
 
-    stopRequested = false;
-    if (!beaconQueue) {
-        beaconQueue = xQueueCreate(256, sizeof(BeaconHit));
-    }
-
-    beaconLog.clear();
-    beaconCounts.clear();
-    beaconLastSeen.clear();
-    beaconTimings.clear();
-    totalBeaconsSeen = 0;
-    suspiciousBeacons = 0;
-    framesSeen = 0;
-    scanning = true;
-    beaconFloodDetectionEnabled = true;
-    uint32_t scanStart = millis();
+    Serial.printf("[EVIL_AP] %s '%s' RSSI:%ddBm CH:%u SEC:%s FLAGS:%s%s\n",
+                  macFmt6(hit.bssid).c_str(), hit.ssid, hit.rssi, hit.channel,
+                  apSecurityLabel(hit.security, hit.ciphers, hit.akms).c_str(), flags.c_str(),
+                  utcTag(hit.tsUs).c_str());
 
-    radioStartWiFi();
-    Serial.println("[BLUE] WiFi monitoring started for beacon flood detection");
+    if (millis() - lastAlert > 4000) {
+        beepPattern(5, 60);
+        lastAlert = millis();
+    }
 
-    BeaconHit hit;
-    uint32_t lastAlert = 0;
-    uint32_t nextStatus = millis() + 1000;
-    uint32_t lastCleanup = millis();
+    if (evilAPLog.size() > 300) {
+        evilAPLog.erase(evilAPLog.begin(), evilAPLog.begin() + 150);
+    }
+}
 
-    while ((forever && !stopRequested) || 
-           (!forever && (int)(millis() - scanStart) < secs * 1000 && !stopRequested)) {
-        
-        if ((int32_t)(millis() - nextStatus) >= 0) {
-            Serial.printf("[BLUE] Monitoring... beacons=%u suspicious=%u sources=%u\n",
-                          (unsigned)totalBeaconsSeen, (unsigned)suspiciousBeacons, 
-                          (unsigned)beaconCounts.size());
-            nextStatus += 1000;
-        }
+static void appendDeauthResults(String &out) {
+    out += "Deauth frames detected: " + String((unsigned)deauthCount) + "\n";
+    out += "Disassoc frames detected: " + String((unsigned)disassocCount) + "\n";
 
-        // Cleanup old timing data every 30 seconds
-        if (millis() - lastCleanup > 30000) {
-            uint32_t now = millis();
-            for (auto& pair : beaconTimings) {
-                auto& timings = pair.second;
-                timings.erase(
-                    std::remove_if(timings.begin(), timings.end(),
-                        [now](uint32_t t) { return now - t > BEACON_TIMING_WINDOW * 3; }),
-                    timings.end()
-                );
-            }
-            lastCleanup = now;
-        }
+    // ~3.5 KB; on the heap rather than the caller's stack
+    std::vector<DeauthEpisode> open(DEAUTH_SETS * DEAUTH_WAYS);
+    size_t n = getDeauthEpisodes(open.data(), open.size());
+    out += "Attack episodes: " + String((unsigned)(deauthLog.size() + n)) + "\n\n";
+    for (size_t i = 0; i < n; i++) {
+        out += "ACTIVE " + deauthEpisodeLine(open[i]) + utcTag(open[i].tsUs) + "\n";
+    }
 
-        if (xQueueReceive(beaconQueue, &hit, pdMS_TO_TICKS(100)) == pdTRUE) {
-            beaconLog.push_back(hit);
-            
-            String macStr = macFmt6(hit.srcMac);
-            uint32_t count = beaconCounts[macStr];
-            
-            Serial.printf("[FLOOD] BEACON %s SSID:'%s' Count:%u RSSI:%ddBm CH:%u Interval:%u\n",
-                          macStr.c_str(), hit.ssid.c_str(), count,
-                          hit.rssi, hit.channel, hit.beaconInterval);
-            
-            if (millis() - lastAlert > 5000) {
-                beepPattern(3, 100);
-                lastAlert = millis();
-            }
-            
-            if (beaconLog.size() > 200) {
-                beaconLog.erase(beaconLog.begin(), beaconLog.begin() + 100);
-            }
-        }
+    int show = min((int)deauthLog.size(), 100);
+    for (int i = (int)deauthLog.size() - show; i < (int)deauthLog.size(); i++) {
+        out += deauthEpisodeLine(deauthLog[i]) + utcTag(deauthLog[i].tsUs) + "\n";
+    }
+    if ((int)deauthLog.size() > show) {
+        out += "... (" + String((int)deauthLog.size() - show) + " earlier)\n";
     }
+    out += "\n";
+}
 
-    radioStopWiFi();
-    scanning = false;
-    beaconFloodDetectionEnabled = false;
+static void appendBeaconResults(String &out) {
+    out += "Total beacons: " + String((unsigned)totalBeaconsSeen) + "\n";
+    out += "Suspicious beacons: " + String((unsigned)suspiciousBeacons) + "\n";
+    out += "Unique sources: " + String((unsigned)beaconCounts.size()) + "\n\n";
 
-    lastResults = String("Beacon Flood Detection — Duration: ") + (forever ? "∞" : String(secs)) + "s\n";
-    lastResults += "WiFi Frames seen: " + String((unsigned)framesSeen) + "\n";
-    lastResults += "Total beacons: " + String((unsigned)totalBeaconsSeen) + "\n";
-    lastResults += "Suspicious beacons: " + String((unsigned)suspiciousBeacons) + "\n";
-    lastResults += "Unique sources: " + String((unsigned)beaconCounts.size()) + "\n\n";
-    
-    lastResults += "Top Beacon Sources:\n";
+    out += "Top Beacon Sources:\n";
     std::vector<std::pair<String, uint32_t>> sortedCounts(beaconCounts.begin(), beaconCounts.end());
-    std::sort(sortedCounts.begin(), sortedCounts.end(), 
+    std::sort(sortedCounts.begin(), sortedCounts.end(),
         [](const auto& a, const auto& b) { return a.second > b.second; });
-    
+
     int show = min((int)sortedCounts.size(), 10);
     for (int i = 0; i < show; i++) {
-        lastResults += sortedCounts[i].first + ": " + String(sortedCounts[i].second) + " beacons\n";
+        out += sortedCounts[i].first + ": " + String(sortedCounts[i].second) + " beacons\n";
     }
-    lastResults += "\n";
-    
+    out += "\n";
+
     show = min((int)beaconLog.size(), 50);
-    lastResults += "Recent Suspicious Beacons:\n";
+    out += "Recent Suspicious Beacons:\n";
     for (int i = max(0, (int)beaconLog.size() - show); i < beaconLog.size(); i++) {
         const auto &e = beaconLog[i];
-        lastResults += macFmt6(e.srcMac) + " '" + e.ssid + "' ";
-        lastResults += "RSSI:" + String(e.rssi) + "dBm ";
-        lastResults += "CH:" + String(e.channel) + " ";
-        lastResults += "Int:" + String(e.beaconInterval) + "\n";
+        out += macFmt6(e.srcMac) + " '" + e.ssid + "' ";
+        out += "RSSI:" + String(e.rssi) + "dBm ";
+        out += "CH:" + String(e.channel) + " ";
+        out += "Int:" + String(e.beaconInterval);
+        out += utcTag(e.tsUs) + "\n";
     }
+    out += "\n";
+}
 
-    Serial.println("[BLUE] Beacon flood detection stopped, restoring AP...");
-    startAPAndServer();
-    
-    extern TaskHandle_t blueTeamTaskHandle;
-    blueTeamTaskHandle = nullptr;
-    vTaskDelete(nullptr);
+static void appendEvilAPResults(String &out) {
+    out += "Evil APs detected: " + String((unsigned)evilAPCount) + "\n";
+    out += "Unique networks: " + String((unsigned)apSsidCount()) + "\n\n";
+
+    out += "Network Analysis:\n";
+    static ApSsidInfo shared[32];
+    size_t n = getApSharedSsids(shared, sizeof(shared) / sizeof(shared[0]));
+    for (size_t i = 0; i < n; i++) {
+        out += "SSID '" + String(shared[i].ssid) + "': " + String(shared[i].bssidCount) + " BSSIDs " +
+               apSecurityLabel(shared[i].security, shared[i].ciphers, shared[i].akms);
+        if (shared[i].divergent) out += " (" + String(shared[i].divergent) + " divergent)";
+        for (size_t j = 0; j < shared[i].held; j++) out += " " + macFmt6(shared[i].bssids[j]);
+        out += "\n";
+    }
+    out += "\n";
+
+    int show = min((int)evilAPLog.size(), 50);
+    out += "Recent Evil APs:\n";
+    for (int i = max(0, (int)evilAPLog.size() - show); i < evilAPLog.size(); i++) {
+        const auto &e = evilAPLog[i];
+        out += macFmt6(e.bssid) + " '" + e.ssid + "' ";
+        out += "RSSI:" + String(e.rssi) + "dBm ";
+        out += "CH:" + String(e.channel) + " ";
+        out += "SEC:" + apSecurityLabel(e.security, e.ciphers, e.akms) + " ";
+        if (e.detectionFlags & EVIL_AP_FLAG_TWIN) out += "[TWIN] ";
+        if (e.detectionFlags & EVIL_AP_FLAG_STRONG_SIGNAL) out += "[STRONG] ";
+        if (e.detectionFlags & EVIL_AP_FLAG_KARMA) out += "[KARMA] ";
+        if (e.detectionFlags & EVIL_AP_FLAG_OPEN_SPOOF) out += "[OPEN_SPOOF] ";
+        if (e.detectionFlags & EVIL_AP_FLAG_TIMING) out += "[TIMING] ";
+        out += utcTag(e.tsUs) + "\n";
+    }
+    out += "\n";
 }
 
-void evilAPDetectionTask(void *pv) {
+static String detectorNames(uint8_t mask) {
+    String s;
+    for (size_t i = 0; i < BLUE_DETECTOR_COUNT; i++) {
+        if (!(mask & blueDetectors[i].bit)) continue;
+        if (s.length()) s += ",";
+        s += blueDetectors[i].name;
+    }
+    return s.length() ? s : String("none");
+}
+
+void blueTeamTask(void *pv) {
     int secs = (int)(intptr_t)pv;
     bool forever = (secs <= 0);
-    
-    Serial.printf("[BLUE] Evil AP detection %s...\n", 
-                  forever ? "(forever)" : String(String("for ") + secs + " seconds").c_str());
+    uint8_t mask = blueRequested;
 
-    stopAPAndServer();
+    Serial.printf("[BLUE] Detection [%s] %s...\n", detectorNames(mask).c_str(),
+                  forever ? "(forever)" : String(String("for ") + secs + " seconds").c_str());
 
-    stopRequested = false;
-    if (!evilAPQueue) {
+    // Created once; a queue can only join a set while empty
+    if (!blueSet) {
+        beaconQueue = xQueueCreate(256, sizeof(BeaconHit));
         evilAPQueue = xQueueCreate(256, sizeof(EvilAPHit));
+        blueSet = xQueueCreateSet(256 * 2);
+        xQueueAddToSet(beaconQueue, blueSet);
+        xQueueAddToSet(evilAPQueue, blueSet);
     }
 
+    DeauthEpisode episodes[8];
+    BeaconHit bHit;
+    EvilAPHit eHit;
+    // Events left over from an earlier run
+    for (QueueSetMemberHandle_t q; (q = xQueueSelectFromSet(blueSet, 0)) != nullptr;) {
+        if (q == beaconQueue) xQueueReceive(beaconQueue, &bHit, 0);
+        else if (q == evilAPQueue) xQueueReceive(evilAPQueue, &eHit, 0);
+    }
+
+    deauthLog.clear();
+    deauthReset();
+    deauthCount = 0;
+    disassocCount = 0;
+    beaconLog.clear();
+    beaconCounts.clear();
+    beaconLastSeen.clear();
+    beaconTimings.clear();
+    totalBeaconsSeen = 0;
+    suspiciousBeacons = 0;
     evilAPLog.clear();
-    ssidToBssids.clear();
-    knownNetworks.clear();
-    probeResponses.clear();
+    apReset();
     evilAPCount = 0;
-    framesSeen = 0;
-    scanning = true;
-    evilAPDetectionEnabled = true;
+    for (size_t i = 0; i < BLUE_DETECTOR_COUNT; i++) {
+        blueDetectors[i].calls = 0;
+        blueDetectors[i].cycles = 0;
+    }
     uint32_t scanStart = millis();
 
-    radioStartWiFi();
-    Serial.println("[BLUE] WiFi monitoring started for Evil AP detection");
+    RxProfile profile = RX_BLUE_TEAM;
+    profile.mgmtSubtypes = blueSubtypes(mask);
+    blueMask = mask;
+    blueStartUs = esp_timer_get_time();
+    blueRunning = true;
+    radioAttach(RADIO_SUB_DETECTORS, profile, true, false);
+    Serial.println("[BLUE] WiFi monitoring started");
 
-    EvilAPHit hit;
-    uint32_t lastAlert = 0;
+    uint8_t ran = mask;
+    uint32_t lastDeauthAlert = 0, lastFloodAlert = 0, lastEvilAlert = 0;
     uint32_t nextStatus = millis() + 1000;
-    uint32_t lastCleanup = millis();
+    uint32_t lastBeaconCleanup = millis();
+
+    while (!radioStopRequested(RADIO_SUB_DETECTORS) && (forever || (int)(millis() - scanStart) < secs * 1000)) {
+        uint8_t active = blueMask;
+        ran |= active;
 
-    while ((forever && !stopRequested) || 
-           (!forever && (int)(millis() - scanStart) < secs * 1000 && !stopRequested)) {
-        
         if ((int32_t)(millis() - nextStatus) >= 0) {
-            Serial.printf("[BLUE] Monitoring... evil_aps=%u networks=%u frames=%u\n",
-                          (unsigned)evilAPCount, (unsigned)ssidToBssids.size(), (unsigned)framesSeen);
+            String status = "[BLUE] Monitoring... frames=" + String((unsigned)framesSeen);
+            if (active & BLUE_DEAUTH) {
+                status += " deauth=" + String((unsigned)deauthCount) + " disassoc=" + String((unsigned)disassocCount);
+            }
+            if (active & BLUE_FLOOD) {
+                status += " beacons=" + String((unsigned)totalBeaconsSeen) + " suspicious=" +
+                          String((unsigned)suspiciousBeacons) + " sources=" + String((unsigned)beaconCounts.size());
+            }
+            if (active & BLUE_EVILAP) {
+                status += " evil_aps=" + String((unsigned)evilAPCount) + " networks=" + String((unsigned)apSsidCount());
+            }
+            Serial.println(status);
             nextStatus += 1000;
         }
 
-        if (millis() - lastCleanup > 60000) {
+        // Cleanup old timing data every 30 seconds
+        if ((active & BLUE_FLOOD) && millis() - lastBeaconCleanup > 30000) {
             uint32_t now = millis();
-            for (auto it = knownNetworks.begin(); it != knownNetworks.end();) {
-                if (now - it->second.timestamp > 300000) {
-                    it = knownNetworks.erase(it);
-                } else {
-                    ++it;
-                }
+            for (auto& pair : beaconTimings) {
+                auto& timings = pair.second;
+                timings.erase(
+                    std::remove_if(timings.begin(), timings.end(),
+                        [now](uint32_t t) { return now - t > BEACON_TIMING_WINDOW * 3; }),
+                    timings.end()
+                );
             }
-            lastCleanup = now;
+            lastBeaconCleanup = now;
         }
 
-        if (xQueueReceive(evilAPQueue, &hit, pdMS_TO_TICKS(100)) == pdTRUE) {
-            evilAPLog.push_back(hit);
-            
-            String flags = "";
-            if (hit.detectionFlags & EVIL_AP_FLAG_TWIN) flags += "TWIN ";
-            if (hit.detectionFlags & EVIL_AP_FLAG_STRONG_SIGNAL) flags += "STRONG ";
-            if (hit.detectionFlags & EVIL_AP_FLAG_KARMA) flags += "KARMA ";
-            if (hit.detectionFlags & EVIL_AP_FLAG_OPEN_SPOOF) flags += "OPEN_SPOOF ";
-            if (hit.detectionFlags & EVIL_AP_FLAG_TIMING) flags += "TIMING ";
-            
-            Serial.printf("[EVIL_AP] %s '%s' RSSI:%ddBm CH:%u FLAGS:%s\n",
-                          macFmt6(hit.bssid).c_str(), hit.ssid.c_str(),
-                          hit.rssi, hit.channel, flags.c_str());
-            
-            if (millis() - lastAlert > 4000) {
-                beepPattern(5, 60);
-                lastAlert = millis();
-            }
-            
-            if (evilAPLog.size() > 300) {
-                evilAPLog.erase(evilAPLog.begin(), evilAPLog.begin() + 150);
-            }
+        if (active & BLUE_DEAUTH) {
+            size_t n = deauthPoll(millis(), episodes, sizeof(episodes) / sizeof(episodes[0]));
+            for (size_t i = 0; i < n; i++) consumeDeauth(episodes[i], lastDeauthAlert);
         }
-    }
 
-    radioStopWiFi();
-    scanning = false;
-    evilAPDetectionEnabled = false;
-
-    lastResults = String("Evil AP Detection — Duration: ") + (forever ? "∞" : String(secs)) + "s\n";
-    lastResults += "WiFi Frames seen: " + String((unsigned)framesSeen) + "\n";
-    lastResults += "Evil APs detected: " + String((unsigned)evilAPCount) + "\n";
-    lastResults += "Unique networks: " + String((unsigned)ssidToBssids.size()) + "\n\n";
-    
-    lastResults += "Network Analysis:\n";
-    for (const auto& pair : ssidToBssids) {
-        if (pair.second.size() > 1) {
-            lastResults += "SSID '" + pair.first + "': " + String(pair.second.size()) + " BSSIDs\n";
+        QueueSetMemberHandle_t q = xQueueSelectFromSet(blueSet, pdMS_TO_TICKS(100));
+        if (q == beaconQueue && xQueueReceive(beaconQueue, &bHit, 0) == pdTRUE) {
+            consumeBeacon(bHit, lastFloodAlert);
+        } else if (q == evilAPQueue && xQueueReceive(evilAPQueue, &eHit, 0) == pdTRUE) {
+            consumeEvilAP(eHit, lastEvilAlert);
         }
     }
-    lastResults += "\n";
-    
-    int show = min((int)evilAPLog.size(), 50);
-    lastResults += "Recent Evil APs:\n";
-    for (int i = max(0, (int)evilAPLog.size() - show); i < evilAPLog.size(); i++) {
-        const auto &e = evilAPLog[i];
-        lastResults += macFmt6(e.bssid) + " '" + e.ssid + "' ";
-        lastResults += "RSSI:" + String(e.rssi) + "dBm ";
-        lastResults += "CH:" + String(e.channel) + " ";
-        if (e.detectionFlags & EVIL_AP_FLAG_TWIN) lastResults += "[TWIN] ";
-        if (e.detectionFlags & EVIL_AP_FLAG_STRONG_SIGNAL) lastResults += "[STRONG] ";
-        if (e.detectionFlags & EVIL_AP_FLAG_KARMA) lastResults += "[KARMA] ";
-        if (e.detectionFlags & EVIL_AP_FLAG_OPEN_SPOOF) lastResults += "[OPEN_SPOOF] ";
-        if (e.detectionFlags & EVIL_AP_FLAG_TIMING) lastResults += "[TIMING] ";
-        lastResults += "\n";
-    }
 
-    Serial.println("[BLUE] Evil AP detection stopped, restoring AP...");
-    startAPAndServer();
+    radioDetach(RADIO_SUB_DETECTORS);
+    blueMask = 0;
+    blueRunning = false;
+    blueStopUs = esp_timer_get_time();
+
+    // Detectors toggled during the run report too
+    String results = String("Blue Team Detection — Duration: ") + (forever ? "∞" : String(secs)) + "s\n";
+    results += "Detectors: " + detectorNames(ran) + "\n";
+    results += "WiFi Frames seen: " + String((unsigned)framesSeen) + "\n";
+    results += getBlueTeamStatus() + "\n";
+    if (ran & BLUE_DEAUTH) appendDeauthResults(results);
+    if (ran & BLUE_FLOOD) appendBeaconResults(results);
+    if (ran & BLUE_EVILAP) appendEvilAPResults(results);
+    radioSetResults(RADIO_SUB_DETECTORS, results);
+
+    Serial.println("[BLUE] Detection stopped");
     
     extern TaskHandle_t blueTeamTaskHandle;
     blueTeamTaskHandle = nullptr;
     vTaskDelete(nullptr);
-}
\ No newline at end of file
+}
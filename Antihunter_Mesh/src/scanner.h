@@ -8,6 +8,8 @@
 #include <BLEAdvertisedDevice.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "targets.h"
+#include "deauthwatch.h"
 
 // Forward declarations
 struct Hit {
@@ -16,17 +18,7 @@ struct Hit {
     uint8_t ch;
     String name;
     bool isBLE;
-};
-
-struct DeauthHit {
-    uint8_t srcMac[6];
-    uint8_t destMac[6];
-    uint8_t bssid[6];
-    int8_t rssi;
-    uint8_t channel;
-    uint16_t reasonCode;
-    uint32_t timestamp;
-    bool isDisassoc;
+    int64_t tsUs;        // esp_timer time at capture, see timesync.h
 };
 
 struct BeaconHit {
@@ -35,6 +27,7 @@ struct BeaconHit {
     int8_t rssi;
     uint8_t channel;
     uint32_t timestamp;
+    int64_t tsUs;
     String ssid;
     uint16_t beaconInterval;
 };
@@ -42,38 +35,86 @@ struct BeaconHit {
 
 struct EvilAPHit {
     uint8_t bssid[6];
-    String ssid;
+    char ssid[33];
     int8_t rssi;
     uint8_t channel;
     uint32_t timestamp;
+    int64_t tsUs;
     bool isOpen;
+    uint8_t security;    // AP_SEC_* bits, see apwatch.h
+    uint16_t ciphers;
+    uint32_t akms;
     uint16_t beaconInterval;
     uint8_t detectionFlags;
 };
 
+static const size_t TRACKER_MAX_TARGETS = 16;
+
+struct TrackerStatus {
+    uint8_t mac[6];
+    int8_t rssi;         // filtered once packets arrive
+    int8_t trend;        // +1 closer, -1 farther, 0 steady
+    uint32_t lastSeen;
+    uint32_t packets;
+    float distance;
+    bool primary;        // currently driving the buzzer
+};
+
+// Radio session subscribers. Each task attaches to the shared sniffer
+// with what it needs instead of owning the radio; see getRadioStatus().
+static const uint8_t RADIO_SUB_TARGETS = 0x01;    // list scan watchlist hits
+static const uint8_t RADIO_SUB_TRACKER = 0x02;
+static const uint8_t RADIO_SUB_DETECTORS = 0x04;  // blue-team engine
+static const size_t RADIO_SUB_COUNT = 3;
+static const uint8_t RADIO_SUB_ALL = 0x07;
 
 // Function declarations
 void initializeScanner();
 void listScanTask(void *pv);
 void trackerTask(void *pv);
-void deauthDetectionTask(void *pv);
-void beaconFloodTask(void *pv);
-void evilAPDetectionTask(void *pv);
+// Blue-team detectors, any combination of which share one sniffer pass
+static const uint8_t BLUE_DEAUTH = 0x01;
+static const uint8_t BLUE_FLOOD = 0x02;
+static const uint8_t BLUE_EVILAP = 0x04;
+static const uint8_t BLUE_ALL = BLUE_DEAUTH | BLUE_FLOOD | BLUE_EVILAP;
+void blueTeamTask(void *pv);
+// Detectors the next blueTeamTask starts with; a running one switches
+// immediately without restarting the radio
+void setBlueTeamDetectors(uint8_t mask);
+uint8_t getBlueTeamDetectors();
+// "deauth,flood,evilap" or "all" to a BLUE_* mask; 0 if nothing matched
+uint8_t parseBlueTeamDetectors(const char *list);
+// Per-detector frames handled, mean cost and CPU share
+String getBlueTeamStatus();
 
-void saveTargetsList(const String &txt);
-void setTrackerMac(const uint8_t mac[6]);
+size_t setTrackerTargets(const uint8_t (*macs)[6], size_t count);
+// RSSI floor for list scans started after this; -128 disables it
+void setScanMinRssi(int dbm);
+String getRxFilterStatus();
+// RADIO_SUB_* bits attached now; 0 when the AP is up
+uint8_t radioSubscribers();
+String getRadioStatus();
+// Stops and results are per session. A stop ends only the sessions it
+// names, and a session starting clears only its own pending stop.
+void radioRequestStop(uint8_t subs);
+void radioClearStop(uint8_t sub);
+bool radioStopRequested(uint8_t sub);
+// "scan", "track", "detect" or "all", comma separated; 0 if unknown
+uint8_t parseRadioSessions(const char *s);
+// Report of the latest finished run of each session in subs
+String getSessionResults(uint8_t subs);
 
 void getTrackerStatus(uint8_t mac[6], int8_t &rssi, uint32_t &lastSeen, uint32_t &packets);
+size_t getTrackerTargets(TrackerStatus *out, size_t maxCount);
 int getUniqueNetworkCount();
-String getTargetsList();
 String getDiagnostics();
-size_t getTargetCount();
 
 // Global state exports
 extern volatile bool scanning;
 extern volatile int totalHits;
 extern volatile uint32_t framesSeen;
 extern volatile uint32_t bleFramesSeen;
+extern volatile uint32_t framesRejected;
 extern volatile bool trackerMode;
 extern volatile uint32_t deauthCount;
 extern volatile uint32_t disassocCount;
@@ -93,18 +134,14 @@ extern const uint8_t EVIL_AP_FLAG_TIMING;
 // Collections exports
 extern std::set<String> uniqueMacs;
 extern std::vector<Hit> hitsLog;
-extern std::vector<DeauthHit> deauthLog;
+// Finished attack episodes, oldest first
+extern std::vector<DeauthEpisode> deauthLog;
 extern std::vector<BeaconHit> beaconLog;
 
-// Tracker state exports
-extern uint8_t trackerMac[6];
-extern volatile int8_t trackerRssi;
-extern volatile uint32_t trackerLastSeen;
-extern volatile uint32_t trackerPackets;
+// Scan state exports
 extern uint32_t lastScanSecs;
 extern bool lastScanForever;
 
 // Queue handles 
 extern QueueHandle_t macQueue;
-extern QueueHandle_t deauthQueue;
 extern QueueHandle_t beaconQueue;
\ No newline at end of file
@@ -0,0 +1,701 @@
+#include "targets.h"
+#include "hardware.h"
+#include "blematch.h"
+#include <Preferences.h>
+#include <SD.h>
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+extern Preferences prefs;
+
+static const char *TARGETS_PATH = "/targets.bin";
+static const char *TARGETS_TMP = "/targets.tmp";
+static const char *TARGETS_KEY = "targets";
+static const char *LEGACY_KEY = "maclist";
+static const char *BLE_PATTERNS_KEY = "blepatterns";
+static const uint32_t TARGETS_MAGIC = 0x47544841; // "AHTG"
+static const uint16_t TARGETS_VERSION = 1;
+// Keep the NVS copy well inside the default 20 KB partition
+static const size_t NVS_MAX_ENTRIES = 700;
+static const size_t IO_CHUNK = 64;
+// Each distinct mask costs one hash probe per frame, so this bounds the
+// hot path no matter how many patterns are loaded
+static const size_t MAX_MASK_GROUPS = 24;
+
+static const uint64_t MAC_BITS = 0xFFFFFFFFFFFFULL;
+// Locally administered bit (0x02 of the first octet) in a 48-bit key
+static const uint64_t LA_BIT = 1ULL << 41;
+static const uint64_t EMPTY_SLOT = ~0ULL;
+
+struct TargetsHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entrySize;
+    uint32_t count;
+    uint32_t crc;
+    // Bumped on every save and written to both copies, so after a save
+    // that reached only one of them the load can tell which is newer
+    uint32_t generation;
+};
+
+// Generation of the list in RAM; the next save writes generation + 1
+static uint32_t targetsGeneration = 0;
+
+static_assert(sizeof(TargetsHeader) == 20, "TargetsHeader is an on-card format");
+static_assert(sizeof(TargetEntry) == 12, "TargetEntry is an on-card format");
+
+// value is always pre-masked. Sorting by mask first keeps each mask group
+// contiguous, which is what the compiler and the merge rely on.
+struct TargetPattern {
+    uint64_t mask;
+    uint64_t value;
+    bool operator<(const TargetPattern &o) const {
+        return mask != o.mask ? mask < o.mask : value < o.value;
+    }
+    bool operator==(const TargetPattern &o) const {
+        return mask == o.mask && value == o.value;
+    }
+};
+
+// One open-addressed table per distinct mask, sized to at most half full
+struct MaskGroup {
+    uint64_t mask;
+    uint8_t bits;
+    std::vector<uint64_t> slots;
+};
+
+static std::vector<TargetPattern> patterns;
+static std::vector<MaskGroup> groups;
+// RX prefilter: one bit per hashed OUI that some pattern can match. Set
+// when a pattern does not pin the OUI, in which case every frame passes.
+static const size_t OUI_FILTER_BITS = 4096;
+static uint8_t ouiFilter[OUI_FILTER_BITS / 8];
+static bool ouiFilterOpen = false;
+// Readers are the capture callbacks; a save swaps both under this
+static portMUX_TYPE targetMux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t crc32Update(uint32_t crc, const uint8_t *data, size_t len) {
+    static const uint32_t nibble[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc = nibble[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+        crc = nibble[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+    }
+    return ~crc;
+}
+
+static inline uint64_t macKey(const uint8_t *m) {
+    return ((uint64_t)m[0] << 40) | ((uint64_t)m[1] << 32) | ((uint64_t)m[2] << 24) |
+           ((uint64_t)m[3] << 16) | ((uint64_t)m[4] << 8) | m[5];
+}
+
+static inline uint64_t prefixMask(unsigned bits) {
+    return bits ? (~0ULL << (48 - bits)) & MAC_BITS : 0;
+}
+
+static inline size_t slotFor(uint64_t key, uint8_t bits) {
+    return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+}
+
+static TargetEntry entryAt(size_t i) {
+    TargetEntry e;
+    const TargetPattern &p = patterns[i];
+    for (int b = 0; b < 6; b++) {
+        e.bytes[b] = (uint8_t)(p.value >> (40 - 8 * b));
+        e.mask[b] = (uint8_t)(p.mask >> (40 - 8 * b));
+    }
+    return e;
+}
+
+bool targetsMatch(const uint8_t *mac) {
+    uint64_t k = macKey(mac);
+    bool hit = false;
+    portENTER_CRITICAL(&targetMux);
+    for (const MaskGroup &g : groups) {
+        uint64_t key = k & g.mask;
+        size_t wrap = g.slots.size() - 1;
+        for (size_t i = slotFor(key, g.bits); g.slots[i] != EMPTY_SLOT; i = (i + 1) & wrap) {
+            if (g.slots[i] == key) {
+                hit = true;
+                break;
+            }
+        }
+        if (hit) break;
+    }
+    portEXIT_CRITICAL(&targetMux);
+    return hit;
+}
+
+size_t getTargetCount() {
+    return patterns.size();
+}
+
+static void addPattern(uint64_t value, uint64_t mask, std::vector<TargetPattern> &out) {
+    if (mask) out.push_back({mask, value & mask});
+}
+
+static void addImageEntry(const uint8_t *raw, std::vector<TargetPattern> &out) {
+    TargetEntry e;
+    memcpy(&e, raw, sizeof(e));
+    addPattern(macKey(e.bytes), macKey(e.mask), out);
+}
+
+// Images are written sorted; anything else (a hand-made file) is fixed up
+static void normalize(std::vector<TargetPattern> &v) {
+    if (!std::is_sorted(v.begin(), v.end())) std::sort(v.begin(), v.end());
+    v.erase(std::unique(v.begin(), v.end()), v.end());
+}
+
+static size_t countMasks(const std::vector<TargetPattern> &v) {
+    size_t n = 0;
+    for (size_t i = 0; i < v.size(); i++) {
+        if (!i || v[i].mask != v[i - 1].mask) n++;
+    }
+    return n;
+}
+
+static void compileGroups(const std::vector<TargetPattern> &v, std::vector<MaskGroup> &out) {
+    out.clear();
+    out.reserve(countMasks(v));
+    for (size_t i = 0; i < v.size();) {
+        size_t j = i;
+        while (j < v.size() && v[j].mask == v[i].mask) j++;
+        MaskGroup g;
+        g.mask = v[i].mask;
+        g.bits = 3;
+        while (((size_t)1 << g.bits) < 2 * (j - i)) g.bits++;
+        g.slots.assign((size_t)1 << g.bits, EMPTY_SLOT);
+        size_t wrap = g.slots.size() - 1;
+        for (size_t k = i; k < j; k++) {
+            size_t s = slotFor(v[k].value, g.bits);
+            while (g.slots[s] != EMPTY_SLOT) s = (s + 1) & wrap;
+            g.slots[s] = v[k].value;
+        }
+        out.push_back(std::move(g));
+        i = j;
+    }
+    // Widest masks (full MACs) first: they are the common case
+    std::sort(out.begin(), out.end(), [](const MaskGroup &a, const MaskGroup &b) {
+        return __builtin_popcountll(a.mask) > __builtin_popcountll(b.mask);
+    });
+}
+
+static inline uint32_t ouiBit(uint32_t oui) {
+    return (oui ^ (oui >> 12)) & (OUI_FILTER_BITS - 1);
+}
+
+static bool buildOuiFilter(const std::vector<TargetPattern> &v, uint8_t *bits) {
+    static const uint32_t OUI_ALL = 0xFFFFFF;
+    static const uint32_t OUI_LA = 0x020000;
+    memset(bits, 0, OUI_FILTER_BITS / 8);
+    for (const TargetPattern &p : v) {
+        uint32_t m = (uint32_t)(p.mask >> 24) & OUI_ALL;
+        uint32_t oui = (uint32_t)(p.value >> 24);
+        if (m != OUI_ALL && m != (OUI_ALL & ~OUI_LA)) return true;
+        bits[ouiBit(oui) / 8] |= 1 << (ouiBit(oui) % 8);
+        if (m != OUI_ALL) bits[ouiBit(oui | OUI_LA) / 8] |= 1 << (ouiBit(oui | OUI_LA) % 8);
+    }
+    return false;
+}
+
+bool IRAM_ATTR targetsMayMatch(const uint8_t *mac) {
+    uint32_t b = ouiBit(((uint32_t)mac[0] << 16) | ((uint32_t)mac[1] << 8) | mac[2]);
+    portENTER_CRITICAL(&targetMux);
+    bool pass = ouiFilterOpen || (ouiFilter[b / 8] >> (b % 8)) & 1;
+    portEXIT_CRITICAL(&targetMux);
+    return pass;
+}
+
+static void installTargets(std::vector<TargetPattern> &v) {
+    normalize(v);
+    std::vector<MaskGroup> compiled;
+    compileGroups(v, compiled);
+    uint8_t bits[OUI_FILTER_BITS / 8];
+    bool open = buildOuiFilter(v, bits);
+    portENTER_CRITICAL(&targetMux);
+    patterns.swap(v);
+    groups.swap(compiled);
+    memcpy(ouiFilter, bits, sizeof(bits));
+    ouiFilterOpen = open;
+    portEXIT_CRITICAL(&targetMux);
+}
+
+static TargetsHeader imageHeader() {
+    TargetsHeader h = {TARGETS_MAGIC, TARGETS_VERSION, sizeof(TargetEntry), (uint32_t)getTargetCount(), 0,
+                       targetsGeneration + 1};
+    TargetEntry buf[IO_CHUNK];
+    for (size_t i = 0; i < h.count; i += IO_CHUNK) {
+        size_t n = std::min(IO_CHUNK, h.count - i);
+        for (size_t j = 0; j < n; j++) buf[j] = entryAt(i + j);
+        h.crc = crc32Update(h.crc, (const uint8_t *)buf, n * sizeof(TargetEntry));
+    }
+    return h;
+}
+
+static bool writeSdImage(const TargetsHeader &h) {
+    File f = SD.open(TARGETS_TMP, FILE_WRITE);
+    if (!f) return false;
+    bool ok = f.write((const uint8_t *)&h, sizeof(h)) == sizeof(h);
+    TargetEntry buf[IO_CHUNK];
+    for (size_t i = 0; ok && i < h.count; i += IO_CHUNK) {
+        size_t n = std::min(IO_CHUNK, h.count - i);
+        for (size_t j = 0; j < n; j++) buf[j] = entryAt(i + j);
+        ok = f.write((const uint8_t *)buf, n * sizeof(TargetEntry)) == n * sizeof(TargetEntry);
+    }
+    f.close();
+    if (!ok) {
+        SD.remove(TARGETS_TMP);
+        return false;
+    }
+    SD.remove(TARGETS_PATH);
+    return SD.rename(TARGETS_TMP, TARGETS_PATH);
+}
+
+static bool writeNvsImage(const TargetsHeader &h) {
+    if (h.count > NVS_MAX_ENTRIES) {
+        prefs.remove(TARGETS_KEY);
+        return false;
+    }
+    size_t bytes = sizeof(h) + h.count * sizeof(TargetEntry);
+    uint8_t *blob = (uint8_t *)malloc(bytes);
+    if (!blob) return false;
+    memcpy(blob, &h, sizeof(h));
+    TargetEntry *e = (TargetEntry *)(blob + sizeof(h));
+    for (size_t i = 0; i < h.count; i++) e[i] = entryAt(i);
+    bool ok = prefs.putBytes(TARGETS_KEY, blob, bytes) == bytes;
+    free(blob);
+    return ok;
+}
+
+static void persistTargets() {
+    TargetsHeader h = imageHeader();
+    targetsGeneration = h.generation;
+    bool sd = sdAvailable && writeSdImage(h);
+    bool nvs = writeNvsImage(h);
+    if (!sd && !nvs) {
+        Serial.printf("[TARGETS] %u entries could not be persisted (NVS holds at most %u without SD)\n",
+                      (unsigned)h.count, (unsigned)NVS_MAX_ENTRIES);
+    }
+}
+
+// An image of total size bytes must hold exactly the entries it declares
+static bool validHeader(const TargetsHeader &h, size_t bytes) {
+    return h.magic == TARGETS_MAGIC && h.version == TARGETS_VERSION && h.entrySize == sizeof(TargetEntry) &&
+           bytes == sizeof(h) + (size_t)h.count * sizeof(TargetEntry);
+}
+
+static bool loadSdImage(std::vector<TargetPattern> &out, TargetsHeader &h) {
+    File f = SD.open(TARGETS_PATH, FILE_READ);
+    if (!f) return false;
+    if (f.read((uint8_t *)&h, sizeof(h)) != sizeof(h) || !validHeader(h, f.size())) {
+        f.close();
+        return false;
+    }
+    out.reserve(h.count);
+    uint32_t crc = 0;
+    uint8_t buf[IO_CHUNK * sizeof(TargetEntry)];
+    for (size_t i = 0; i < h.count; i += IO_CHUNK) {
+        size_t n = std::min(IO_CHUNK, h.count - i);
+        if (f.read(buf, n * sizeof(TargetEntry)) != n * sizeof(TargetEntry)) break;
+        crc = crc32Update(crc, buf, n * sizeof(TargetEntry));
+        for (size_t j = 0; j < n; j++) addImageEntry(buf + j * sizeof(TargetEntry), out);
+    }
+    f.close();
+    if (crc != h.crc) {
+        Serial.println("[TARGETS] /targets.bin failed CRC check");
+        out.clear();
+        return false;
+    }
+    return true;
+}
+
+static bool loadNvsImage(std::vector<TargetPattern> &out, TargetsHeader &h) {
+    size_t bytes = prefs.getBytesLength(TARGETS_KEY);
+    if (bytes < sizeof(TargetsHeader)) return false;
+    uint8_t *blob = (uint8_t *)malloc(bytes);
+    if (!blob) return false;
+    prefs.getBytes(TARGETS_KEY, blob, bytes);
+    memcpy(&h, blob, sizeof(h));
+    const uint8_t *body = blob + sizeof(h);
+    bool ok = validHeader(h, bytes) && crc32Update(0, body, h.count * sizeof(TargetEntry)) == h.crc;
+    if (ok) {
+        for (size_t i = 0; i < h.count; i++) addImageEntry(body + i * sizeof(TargetEntry), out);
+    }
+    free(blob);
+    return ok;
+}
+
+// Chunk-tolerant tokenizer: entries end at newline, comma or semicolon and
+// separators inside an entry (":", "-", ".") are skipped, so an entry may
+// straddle any number of upload chunks. Besides full MACs and OUIs it
+// takes "/N" bit prefixes (MA-M /28, MA-S /36), bare 7- and 9-digit MA-M
+// and MA-S blocks, "*" (octet) and "?" (nibble) wildcards, and a "~"
+// anywhere in the entry to ignore the locally administered bit.
+struct TargetParser {
+    uint8_t nib[12];
+    uint16_t wild;
+    uint8_t n;
+    uint8_t prefixBits;
+    bool hasPrefix;
+    bool la;
+    bool overflow;
+    uint32_t accepted;
+    uint32_t rejected;
+};
+
+static bool parserPattern(const TargetParser &p, uint64_t &value, uint64_t &mask) {
+    if (p.overflow) return false;
+    if (p.hasPrefix) {
+        // A prefix and wildcards together would need a free-form mask
+        if (p.wild || p.prefixBits < 1 || p.prefixBits > 48 || p.n * 4 < p.prefixBits) return false;
+        mask = prefixMask(p.prefixBits);
+    } else {
+        if (p.n != 12 && p.n != 9 && p.n != 7 && p.n != 6) return false;
+        mask = prefixMask(p.n * 4);
+        for (uint8_t i = 0; i < p.n; i++) {
+            if (p.wild & (1u << i)) mask &= ~(0xFULL << (44 - 4 * i));
+        }
+    }
+    value = 0;
+    for (uint8_t i = 0; i < p.n; i++) value |= (uint64_t)p.nib[i] << (44 - 4 * i);
+    if (p.la) mask &= ~LA_BIT;
+    // An all-wildcard entry would match every frame
+    return mask != 0;
+}
+
+static void parserEndEntry(TargetParser &p, std::vector<TargetPattern> &out) {
+    uint64_t value, mask;
+    if (parserPattern(p, value, mask)) {
+        addPattern(value, mask, out);
+        p.accepted++;
+    } else if (p.n || p.hasPrefix || p.la || p.overflow) {
+        p.rejected++;
+    }
+    p.n = 0;
+    p.wild = 0;
+    p.prefixBits = 0;
+    p.hasPrefix = false;
+    p.la = false;
+    p.overflow = false;
+}
+
+static void parserFeed(TargetParser &p, const uint8_t *data, size_t len, std::vector<TargetPattern> &out) {
+    for (size_t i = 0; i < len; i++) {
+        char c = (char)data[i];
+        if (c == '\n' || c == ',' || c == ';') {
+            parserEndEntry(p, out);
+        } else if (p.hasPrefix) {
+            if (isdigit((unsigned char)c)) {
+                p.prefixBits = (uint8_t)std::min(p.prefixBits * 10 + (c - '0'), 255);
+            } else if (c == '/' || isxdigit((unsigned char)c) || c == '*' || c == '?') {
+                p.overflow = true;
+            } else if (c == '~') {
+                p.la = true;
+            }
+        } else if (c == '/') {
+            p.hasPrefix = true;
+        } else if (c == '~') {
+            p.la = true;
+        } else if (isxdigit((unsigned char)c) || c == '*' || c == '?') {
+            // "*" stands for a whole octet, "?" for one nibble
+            uint8_t width = c == '*' ? 2 : 1;
+            if (p.n + width > sizeof(p.nib)) {
+                p.overflow = true;
+            } else if (c == '*' || c == '?') {
+                for (uint8_t k = 0; k < width; k++) {
+                    p.wild |= 1u << p.n;
+                    p.nib[p.n++] = 0;
+                }
+            } else {
+                p.nib[p.n++] = (uint8_t)(isdigit((unsigned char)c) ? c - '0' : (toupper(c) - 'A' + 10));
+            }
+        }
+    }
+}
+
+static SemaphoreHandle_t targetWriteLock = nullptr;
+
+static void mergePatterns(TargetUpdateMode mode, const std::vector<TargetPattern> &cur,
+                          std::vector<TargetPattern> &staged) {
+    normalize(staged);
+    if (mode == TARGETS_REPLACE) return;
+    std::vector<TargetPattern> out;
+    if (mode == TARGETS_ADD) {
+        out.reserve(cur.size() + staged.size());
+        std::set_union(cur.begin(), cur.end(), staged.begin(), staged.end(), std::back_inserter(out));
+    } else {
+        out.reserve(cur.size());
+        std::set_difference(cur.begin(), cur.end(), staged.begin(), staged.end(), std::back_inserter(out));
+    }
+    staged.swap(out);
+}
+
+// Merges staged patterns into the live index, recompiles the mask tables
+// and persists the result. The live list only changes here, so reading it
+// without targetMux is safe while targetWriteLock is held.
+static bool applyStaged(TargetUpdateMode mode, std::vector<TargetPattern> &staged,
+                        const TargetParser &p, String &summary) {
+    if (!targetWriteLock || xSemaphoreTake(targetWriteLock, pdMS_TO_TICKS(2000)) != pdTRUE) {
+        summary = "Target store busy";
+        return false;
+    }
+    size_t before = getTargetCount();
+    mergePatterns(mode, patterns, staged);
+    size_t masks = countMasks(staged);
+    if (masks > MAX_MASK_GROUPS) {
+        xSemaphoreGive(targetWriteLock);
+        summary = "Too many distinct masks (" + String((unsigned)masks) + ", max " +
+                  String((unsigned)MAX_MASK_GROUPS) + "); list unchanged";
+        return false;
+    }
+    installTargets(staged);
+    persistTargets();
+    size_t after = getTargetCount();
+    xSemaphoreGive(targetWriteLock);
+
+    summary = "Targets: " + String((unsigned)after);
+    if (mode == TARGETS_ADD) summary += " (added " + String((unsigned)(after - before)) + ")";
+    else if (mode == TARGETS_REMOVE) summary += " (removed " + String((unsigned)(before - after)) + ")";
+    if (p.rejected) summary += ", " + String(p.rejected) + " invalid entries skipped";
+    return true;
+}
+
+bool applyTargetText(TargetUpdateMode mode, const char *text, size_t len, String &summary) {
+    std::vector<TargetPattern> staged;
+    TargetParser p = {};
+    parserFeed(p, (const uint8_t *)text, len, staged);
+    parserEndEntry(p, staged);
+    return applyStaged(mode, staged, p, summary);
+}
+
+void saveTargetsList(const String &txt) {
+    String summary;
+    applyTargetText(TARGETS_REPLACE, txt.c_str(), txt.length(), summary);
+}
+
+// One upload at a time; a session nobody has fed for this long is
+// assumed abandoned (client went away) and may be taken over
+static const uint32_t UPLOAD_STALE_MS = 30000;
+// Reserve at most this many patterns up front from the size hint
+static const size_t UPLOAD_RESERVE_MAX = 32768;
+
+static bool uploadActive = false;
+static uint32_t uploadSession = 0;
+static uint32_t uploadTouched = 0;
+static TargetUpdateMode uploadMode = TARGETS_REPLACE;
+static TargetParser uploadParser;
+static std::vector<TargetPattern> staged;
+
+uint32_t targetUploadBegin(TargetUpdateMode mode, size_t sizeHint) {
+    if (uploadActive && millis() - uploadTouched < UPLOAD_STALE_MS) return 0;
+    std::vector<TargetPattern>().swap(staged);
+    // A full MAC line is at least 13 bytes
+    staged.reserve(std::min(sizeHint / 13 + 1, UPLOAD_RESERVE_MAX));
+    uploadParser = {};
+    uploadMode = mode;
+    uploadActive = true;
+    uploadTouched = millis();
+    if (++uploadSession == 0) uploadSession = 1;
+    return uploadSession;
+}
+
+void targetUploadFeed(uint32_t session, const uint8_t *data, size_t len) {
+    if (!uploadActive || session != uploadSession) return;
+    parserFeed(uploadParser, data, len, staged);
+    uploadTouched = millis();
+}
+
+bool targetUploadFinish(uint32_t session, String &summary) {
+    if (!uploadActive) {
+        summary = "No upload in progress";
+        return false;
+    }
+    if (session != uploadSession) {
+        summary = "Upload was taken over by another client";
+        return false;
+    }
+    parserEndEntry(uploadParser, staged);
+    bool ok = applyStaged(uploadMode, staged, uploadParser, summary);
+    targetUploadAbort();
+    return ok;
+}
+
+void targetUploadAbort() {
+    uploadActive = false;
+    std::vector<TargetPattern>().swap(staged);
+}
+
+static BleMatchTable bleTable;
+// Compile target; only touched with targetWriteLock held
+static BleMatchTable bleStaging;
+static portMUX_TYPE bleMux = portMUX_INITIALIZER_UNLOCKED;
+
+uint32_t bleAdvertMatch(const uint8_t *adv, size_t len) {
+    portENTER_CRITICAL(&bleMux);
+    uint32_t hits = bleMatch(bleTable, adv, len);
+    portEXIT_CRITICAL(&bleMux);
+    return hits;
+}
+
+void blePatternLabel(uint32_t hits, char *out, size_t cap) {
+    if (!cap) return;
+    out[0] = '\0';
+    if (!hits) return;
+    portENTER_CRITICAL(&bleMux);
+    unsigned i = __builtin_ctz(hits);
+    if (i < bleTable.patternCount) snprintf(out, cap, "%s", bleTable.labels[i]);
+    portEXIT_CRITICAL(&bleMux);
+}
+
+static void installBlePatterns() {
+    portENTER_CRITICAL(&bleMux);
+    bleTable = bleStaging;
+    portEXIT_CRITICAL(&bleMux);
+}
+
+static const size_t BLE_FORMAT_MAX = BLE_MAX_RULES * 96;
+
+static String formatBleTable(const BleMatchTable &t) {
+    char *buf = (char *)malloc(BLE_FORMAT_MAX);
+    if (!buf) return String();
+    bleFormat(t, buf, BLE_FORMAT_MAX);
+    String out(buf);
+    free(buf);
+    return out;
+}
+
+bool setBlePatterns(const char *spec, size_t len, String &summary) {
+    if (!targetWriteLock || xSemaphoreTake(targetWriteLock, pdMS_TO_TICKS(2000)) != pdTRUE) {
+        summary = "Target store busy";
+        return false;
+    }
+    uint32_t rejected = 0;
+    size_t rules = bleCompile(bleStaging, spec, len, &rejected);
+    installBlePatterns();
+    bool saved = true;
+    if (rules) {
+        String compiled = formatBleTable(bleStaging);
+        saved = prefs.putString(BLE_PATTERNS_KEY, compiled) == compiled.length();
+    } else {
+        prefs.remove(BLE_PATTERNS_KEY);
+    }
+    summary = "BLE patterns: " + String((unsigned)bleStaging.patternCount) + " (" + String((unsigned)rules) + " rules)";
+    xSemaphoreGive(targetWriteLock);
+    if (rejected) summary += ", " + String(rejected) + " lines rejected";
+    if (!saved) summary += ", not persisted";
+    return true;
+}
+
+String getBlePatterns() {
+    // Copied out so the format runs without the spinlock held
+    BleMatchTable *copy = (BleMatchTable *)malloc(sizeof(BleMatchTable));
+    if (!copy) return String();
+    portENTER_CRITICAL(&bleMux);
+    *copy = bleTable;
+    portEXIT_CRITICAL(&bleMux);
+    String out = formatBleTable(*copy);
+    free(copy);
+    return out;
+}
+
+void loadTargets() {
+    if (!targetWriteLock) targetWriteLock = xSemaphoreCreateMutex();
+    std::vector<TargetPattern> loaded, nvsLoaded;
+    const char *source = nullptr;
+    bool legacy = false;
+
+    // Both copies are written on every save, but either write can fail on
+    // its own; the higher generation is the list that was saved last
+    TargetsHeader sdHdr, nvsHdr;
+    bool sd = sdAvailable && loadSdImage(loaded, sdHdr);
+    bool nvs = loadNvsImage(nvsLoaded, nvsHdr);
+    if (nvs && (!sd || nvsHdr.generation > sdHdr.generation)) {
+        loaded.swap(nvsLoaded);
+        targetsGeneration = nvsHdr.generation;
+        source = "NVS";
+    } else if (sd) {
+        targetsGeneration = sdHdr.generation;
+        source = "SD";
+    } else if (prefs.isKey(LEGACY_KEY)) {
+        String txt = prefs.getString(LEGACY_KEY, "");
+        TargetParser p = {};
+        parserFeed(p, (const uint8_t *)txt.c_str(), txt.length(), loaded);
+        parserEndEntry(p, loaded);
+        source = "legacy list";
+        legacy = true;
+    }
+
+    installTargets(loaded);
+    String ble = prefs.getString(BLE_PATTERNS_KEY, "");
+    bleCompile(bleStaging, ble.c_str(), ble.length(), nullptr);
+    installBlePatterns();
+    if (legacy) {
+        persistTargets();
+        prefs.remove(LEGACY_KEY);
+        Serial.printf("[TARGETS] Migrated maclist to binary store v%u\n", (unsigned)TARGETS_VERSION);
+    }
+    Serial.printf("[TARGETS] Loaded %u patterns in %u mask groups from %s\n", (unsigned)patterns.size(),
+                  (unsigned)groups.size(), source ? source : "nowhere (empty list)");
+    if (bleTable.ruleCount) {
+        Serial.printf("[TARGETS] %u BLE payload patterns (%u rules)\n", (unsigned)bleTable.patternCount,
+                      (unsigned)bleTable.ruleCount);
+    }
+}
+
+// Writes a pattern in a form parserFeed reads back to the same mask. A
+// cleared LA bit inside an otherwise significant nibble becomes "~".
+static int formatPattern(const TargetPattern &p, char *out, size_t len) {
+    static const char HEX[] = "0123456789ABCDEF";
+    bool la = !(p.mask & LA_BIT) && (p.mask & (0xDULL << 40));
+    uint64_t m = la ? p.mask | LA_BIT : p.mask;
+    unsigned lead = m ? __builtin_clzll(~(m << 16)) : 0;
+    bool prefix = m == prefixMask(lead);
+    unsigned nibs = prefix ? (lead + 3) / 4 : 12;
+    size_t o = 0;
+    if (la) out[o++] = '~';
+    for (unsigned i = 0; i < nibs; i++) {
+        if (i && !(i & 1)) out[o++] = ':';
+        // Wildcard form; a partial nibble (hand-made image) prints as set
+        unsigned shift = 44 - 4 * i;
+        if (!prefix && !(i & 1) && !((m >> (shift - 4)) & 0xFF)) {
+            out[o++] = '*';
+            i++;
+        } else {
+            out[o++] = (!prefix && !((m >> shift) & 0xF)) ? '?' : HEX[(p.value >> shift) & 0xF];
+        }
+    }
+    out[o] = '\0';
+    int n = (int)o;
+    if (prefix && lead != 48 && lead != 24) n += snprintf(out + o, len - o, "/%u", lead);
+    n += snprintf(out + n, len - n, "\n");
+    return n;
+}
+
+// Fills buf with whole lines starting at entry *cursor; 0 once done.
+// Entries are copied out under the lock and formatted outside it.
+size_t exportTargets(uint8_t *buf, size_t maxLen, size_t &cursor) {
+    static const size_t LINE_MAX = 24;
+    static const size_t EXPORT_BATCH = 32;
+    size_t used = 0;
+    TargetPattern batch[EXPORT_BATCH];
+    char line[LINE_MAX + 1];
+    while (maxLen - used >= LINE_MAX) {
+        size_t want = std::min(EXPORT_BATCH, (maxLen - used) / LINE_MAX);
+        size_t n = 0;
+        portENTER_CRITICAL(&targetMux);
+        size_t total = patterns.size();
+        for (; n < want && cursor + n < total; n++) batch[n] = patterns[cursor + n];
+        portEXIT_CRITICAL(&targetMux);
+        if (!n) break;
+        for (size_t i = 0; i < n; i++) {
+            int len = formatPattern(batch[i], line, sizeof(line));
+            memcpy(buf + used, line, len);
+            used += len;
+        }
+        cursor += n;
+    }
+    return used;
+}
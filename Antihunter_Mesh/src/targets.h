@@ -0,0 +1,59 @@
+#pragma once
+#include <Arduino.h>
+
+// Watchlist of masked MAC patterns: full MACs, OUIs, MA-M/MA-S blocks and
+// other bit prefixes, wildcard nibbles, optionally ignoring the locally
+// administered bit. Patterns are compiled into one hash table per distinct
+// mask, so a lookup costs one probe per mask regardless of how many
+// patterns are loaded. Persisted as a versioned binary image (/targets.bin
+// on SD, NVS blob "targets" when it fits); the copy with the higher save
+// generation wins on boot. The old "maclist" string is migrated on boot.
+
+// On-card/NVS entry; bytes are pre-masked
+struct TargetEntry {
+    uint8_t bytes[6];
+    uint8_t mask[6];
+};
+
+enum TargetUpdateMode : uint8_t {
+    TARGETS_REPLACE,
+    TARGETS_ADD,
+    TARGETS_REMOVE
+};
+
+void loadTargets();
+bool targetsMatch(const uint8_t *mac);
+// Cheap first-stage test on the OUI alone: false means targetsMatch is
+// certainly false. Always true while a pattern leaves the OUI open.
+bool targetsMayMatch(const uint8_t *mac);
+size_t getTargetCount();
+
+// Entries are separated by newline, comma or semicolon, e.g.
+// AA:BB:CC:DD:EE:FF, DC:A6:32, 70:B3:D5:12:3/36, AA:BB:*:*:?0:01 or
+// ~AA:BB:CC:DD:EE:FF. Parsed entries are staged as patterns, merged into
+// the index in one pass and persisted once; summary describes the result or the failure.
+bool applyTargetText(TargetUpdateMode mode, const char *text, size_t len, String &summary);
+void saveTargetsList(const String &txt);
+
+// Streaming form of applyTargetText for HTTP uploads: the body is fed in
+// whatever chunks arrive and never held whole. One upload at a time:
+// begin returns the session id (0 when another upload holds it), and feed
+// and finish only act for that session, so a stale uploader whose session
+// was taken over cannot feed or commit the new one.
+uint32_t targetUploadBegin(TargetUpdateMode mode, size_t sizeHint);
+void targetUploadFeed(uint32_t session, const uint8_t *data, size_t len);
+bool targetUploadFinish(uint32_t session, String &summary);
+void targetUploadAbort();
+
+// Chunked export: fills buf with whole lines from entry cursor onwards,
+// returns 0 when the list is exhausted
+size_t exportTargets(uint8_t *buf, size_t maxLen, size_t &cursor);
+
+// BLE advert payload patterns (blematch.h), the address-independent half
+// of the watchlist. Persisted as the compiled spec in NVS "blepatterns".
+bool setBlePatterns(const char *spec, size_t len, String &summary);
+String getBlePatterns();
+// Safe in the advert callback: no allocation, returns the pattern bits
+uint32_t bleAdvertMatch(const uint8_t *adv, size_t len);
+// Label of the lowest pattern in hits
+void blePatternLabel(uint32_t hits, char *out, size_t cap);
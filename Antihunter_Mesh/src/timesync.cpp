@@ -0,0 +1,240 @@
+#include "timesync.h"
+#include <esp_timer.h>
+
+// Tags arrive after the epoch they describe, so the largest utc - mono
+// offset in the window (the least delayed tag) is the best estimate.
+// 64 tags span 10-20 s at the usual 3-6 sentences per second.
+static const int SYNC_WINDOW = 64;
+// Receiver output latency is unknown without PPS; common modules start
+// the first sentence of an epoch within this long. The estimate is
+// centred in that range.
+static const int64_t NMEA_LATENCY_US = 100000;
+static const int64_t PPS_FLOOR_US = 1000;
+// An NMEA estimate must land this close to the PPS second it labels
+static const int64_t PPS_MATCH_US = 300000;
+// A step this large means the receiver changed its time; start over
+static const int64_t RESYNC_STEP_US = 2000000;
+// Rate is measured over at least this much monotonic time; NMEA needs a
+// long baseline because its per-tag jitter is milliseconds
+static const int64_t PPS_BASELINE_US = 60000000LL;
+static const int64_t NMEA_BASELINE_US = 600000000LL;
+static const float DRIFT_GAIN = 0.25f;
+static const float MAX_DRIFT_PPM = 200.0f;
+// Error growth between syncs before and after the rate is known
+static const float DRIFT_UNKNOWN_PPM = 50.0f;
+static const float DRIFT_RESIDUAL_PPM = 10.0f;
+
+struct SyncAnchor {
+    bool valid;
+    bool pps;
+    bool driftKnown;
+    float driftPpm;
+    int64_t mono;
+    int64_t utcUs;
+    int64_t uncUs;
+};
+
+static SyncAnchor anchor = {};
+static portMUX_TYPE syncMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Only touched from the GPS task
+static int64_t winMono[SYNC_WINDOW];
+static int64_t winOffset[SYNC_WINDOW];
+static int winCount = 0;
+static int winHead = 0;
+static bool baseSet = false;
+static bool basePps = false;
+static int64_t baseMono = 0;
+static int64_t baseOffset = 0;
+
+#ifdef GPS_PPS_PIN
+static volatile int64_t ppsEdgeUs = 0;
+
+static void IRAM_ATTR onPpsEdge() {
+    ppsEdgeUs = esp_timer_get_time();
+}
+#endif
+
+void initTimeSync() {
+#ifdef GPS_PPS_PIN
+    pinMode(GPS_PPS_PIN, INPUT);
+    attachInterrupt(digitalPinToInterrupt(GPS_PPS_PIN), onPpsEdge, RISING);
+    Serial.printf("[TIME] PPS input on pin %d\n", GPS_PPS_PIN);
+#endif
+}
+
+static SyncAnchor readAnchor() {
+    portENTER_CRITICAL(&syncMux);
+    SyncAnchor a = anchor;
+    portEXIT_CRITICAL(&syncMux);
+    return a;
+}
+
+void timeSyncNmea(int64_t monoUs, uint32_t utcSec, uint16_t utcMs) {
+    int64_t tagUs = (int64_t)utcSec * 1000000LL + (int64_t)utcMs * 1000;
+    int64_t offset = tagUs - monoUs;
+    SyncAnchor a = readAnchor();
+
+    if (a.valid) {
+        int64_t dt = monoUs - a.mono;
+        int64_t predicted = a.utcUs - a.mono + (int64_t)(dt * (double)a.driftPpm * 1e-6);
+        int64_t step = offset - predicted;
+        if (step > RESYNC_STEP_US || step < -RESYNC_STEP_US) {
+            Serial.printf("[TIME] GPS time stepped %lld ms, resyncing\n", (long long)(step / 1000));
+            winCount = 0;
+            winHead = 0;
+            baseSet = false;
+            a = {};
+        }
+    }
+
+    winMono[winHead] = monoUs;
+    winOffset[winHead] = offset;
+    winHead = (winHead + 1) % SYNC_WINDOW;
+    if (winCount < SYNC_WINDOW) winCount++;
+
+    // Age every sample to now with the current rate before comparing
+    int64_t best = INT64_MIN, worst = INT64_MAX;
+    for (int i = 0; i < winCount; i++) {
+        int64_t aged = winOffset[i] + (int64_t)((monoUs - winMono[i]) * (double)a.driftPpm * 1e-6);
+        if (aged > best) best = aged;
+        if (aged < worst) worst = aged;
+    }
+
+    int64_t refMono = monoUs;
+    int64_t refOffset = best + NMEA_LATENCY_US / 2;
+    // Half the latency range plus half the spread of the window: the best
+    // tag can itself be late by up to the spread, so this is not divided down
+    int64_t unc = NMEA_LATENCY_US / 2 + (best - worst) / 2;
+    bool pps = false;
+
+#ifdef GPS_PPS_PIN
+    // The PPS edge marks the exact start of the second the next sentences
+    // describe; NMEA only has to pick the right second
+    int64_t edge = ppsEdgeUs;
+    if (edge && monoUs - edge > 0 && monoUs - edge < 1000000) {
+        int64_t secUs = (int64_t)utcSec * 1000000LL;
+        int64_t err = edge + refOffset - secUs;
+        if (err > -PPS_MATCH_US && err < PPS_MATCH_US) {
+            refMono = edge;
+            refOffset = secUs - edge;
+            unc = PPS_FLOOR_US;
+            pps = true;
+        }
+    }
+#endif
+
+    float drift = a.driftPpm;
+    bool driftKnown = a.driftKnown;
+    // NMEA and PPS offsets differ by the receiver latency, never mix them.
+    // An NMEA rate baseline waits for a full window so it starts from a
+    // low-latency tag.
+    if (!pps && winCount < SYNC_WINDOW) {
+        baseSet = false;
+    } else if (!baseSet || basePps != pps) {
+        baseMono = refMono;
+        baseOffset = refOffset;
+        basePps = pps;
+        baseSet = true;
+    } else if (refMono - baseMono >= (pps ? PPS_BASELINE_US : NMEA_BASELINE_US)) {
+        float sample = (float)((double)(refOffset - baseOffset) / (double)(refMono - baseMono) * 1e6);
+        if (sample > MAX_DRIFT_PPM) sample = MAX_DRIFT_PPM;
+        if (sample < -MAX_DRIFT_PPM) sample = -MAX_DRIFT_PPM;
+        drift = driftKnown ? drift + DRIFT_GAIN * (sample - drift) : sample;
+        driftKnown = true;
+        baseMono = refMono;
+        baseOffset = refOffset;
+    }
+
+    SyncAnchor next;
+    next.valid = true;
+    next.pps = pps;
+    next.driftKnown = driftKnown;
+    next.driftPpm = drift;
+    next.mono = refMono;
+    next.utcUs = refMono + refOffset;
+    next.uncUs = unc;
+
+    if (!a.valid) {
+        Serial.printf("[TIME] UTC locked to GPS (%s)\n", pps ? "PPS" : "NMEA");
+    }
+
+    portENTER_CRITICAL(&syncMux);
+    anchor = next;
+    portEXIT_CRITICAL(&syncMux);
+}
+
+UtcStamp utcAt(int64_t monoUs) {
+    UtcStamp t = {};
+    SyncAnchor a = readAnchor();
+    if (!a.valid) return t;
+
+    int64_t dt = monoUs - a.mono;
+    int64_t utcUs = a.utcUs + dt + (int64_t)(dt * (double)a.driftPpm * 1e-6);
+    if (utcUs <= 0) return t;
+
+    float residual = a.driftKnown ? DRIFT_RESIDUAL_PPM : DRIFT_UNKNOWN_PPM;
+    int64_t grow = (int64_t)((dt < 0 ? -dt : dt) * (double)residual * 1e-6);
+    int64_t unc = a.uncUs + grow;
+
+    t.valid = true;
+    t.sec = (uint32_t)(utcUs / 1000000LL);
+    t.usec = (uint32_t)(utcUs % 1000000LL);
+    t.uncUs = unc > UINT32_MAX ? UINT32_MAX : (uint32_t)unc;
+    return t;
+}
+
+UtcStamp utcNow() {
+    return utcAt(esp_timer_get_time());
+}
+
+// Days since 1970-01-01 for a proleptic Gregorian date
+static int32_t daysFromCivil(int y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = (unsigned)(y - era * 400);
+    unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int)doe - 719468;
+}
+
+static void civilFromDays(int32_t z, int &y, unsigned &m, unsigned &d) {
+    z += 719468;
+    int era = (z >= 0 ? z : z - 146096) / 146097;
+    unsigned doe = (unsigned)(z - era * 146097);
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    d = doy - (153 * mp + 2) / 5 + 1;
+    m = mp < 10 ? mp + 3 : mp - 9;
+    y = (int)yoe + era * 400 + (m <= 2);
+}
+
+uint32_t utcFromCivil(int year, unsigned month, unsigned day, unsigned hour, unsigned minute, unsigned second) {
+    return (uint32_t)daysFromCivil(year, month, day) * 86400UL + hour * 3600UL + minute * 60UL + second;
+}
+
+String formatUtc(const UtcStamp &t) {
+    if (!t.valid) return "unsynced";
+    int y;
+    unsigned mo, d;
+    civilFromDays((int32_t)(t.sec / 86400), y, mo, d);
+    uint32_t s = t.sec % 86400;
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%04d-%02u-%02uT%02u:%02u:%02u.%03uZ+/-%ums",
+             y, mo, d, (unsigned)(s / 3600), (unsigned)(s / 60 % 60), (unsigned)(s % 60),
+             (unsigned)(t.usec / 1000), (unsigned)((t.uncUs + 999) / 1000));
+    return String(buf);
+}
+
+String getTimeSyncStatus() {
+    SyncAnchor a = readAnchor();
+    if (!a.valid) return "UTC: not synced (waiting for GPS time)\n";
+    int64_t age = esp_timer_get_time() - a.mono;
+    String s = "UTC: " + formatUtc(utcNow());
+    s += " source=" + String(a.pps ? "PPS" : "NMEA");
+    s += " lastSync=" + String((unsigned long)(age / 1000000LL)) + "s ago";
+    if (a.driftKnown) s += " drift=" + String(a.driftPpm, 1) + "ppm";
+    s += "\n";
+    return s;
+}
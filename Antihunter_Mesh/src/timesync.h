@@ -0,0 +1,24 @@
+#pragma once
+#include <Arduino.h>
+
+// GPS-disciplined UTC. The monotonic esp_timer clock is anchored to GPS
+// time using the arrival of each NMEA time tag, or the PPS edge when
+// GPS_PPS_PIN is wired. The earliest-arriving tag in a sliding window sets
+// the offset, and a slow rate estimate corrects crystal drift between
+// syncs. Events keep their esp_timer capture time and are converted on
+// output, so a later sync never changes an already-stamped event.
+
+struct UtcStamp {
+    bool valid;
+    uint32_t sec;        // Unix seconds
+    uint32_t usec;
+    uint32_t uncUs;      // +/- bound on the error
+};
+
+void initTimeSync();
+void timeSyncNmea(int64_t monoUs, uint32_t utcSec, uint16_t utcMs);
+UtcStamp utcAt(int64_t monoUs);
+UtcStamp utcNow();
+uint32_t utcFromCivil(int year, unsigned month, unsigned day, unsigned hour, unsigned minute, unsigned second);
+String formatUtc(const UtcStamp &t);
+String getTimeSyncStatus();
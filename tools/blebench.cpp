@@ -0,0 +1,133 @@
+// Host benchmark for the BLE advertisement matcher.
+//
+// Replays recorded adverts through the same decision table the firmware
+// uses and prints per-pattern hit counts and the cost per advert. Build
+// on Linux with:
+//   g++ -std=c++17 -O2 -IAntihunter_Mesh/src -o blebench
+//       tools/blebench.cpp Antihunter_Mesh/src/blematch.cpp
+// Record adverts by building the firmware with -D BLE_ADV_DUMP=1 and
+// saving the serial log; lines look like
+//   ADV AA:BB:CC:DD:EE:FF -67 02011A1AFF4C001219...
+// Lines that are bare hex payloads are accepted too, anything else is
+// skipped. tools/ble_synthetic.log is a small generated log in that
+// format, not a radio recording, mixing tracker and everyday adverts.
+// Usage:
+//   ./blebench tools/ble_synthetic.log     (tracker presets)
+//   ./blebench -p patterns.txt capture.log
+//   ./blebench -n 200 capture.log          (passes over the capture)
+
+#include "blematch.h"
+#include <chrono>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+struct Advert {
+    std::string mac;
+    std::vector<uint8_t> payload;
+};
+
+static bool hexToBytes(const char *s, size_t len, std::vector<uint8_t> &out) {
+    if (len < 4 || (len & 1)) return false;
+    out.clear();
+    for (size_t i = 0; i < len; i += 2) {
+        if (!isxdigit((unsigned char)s[i]) || !isxdigit((unsigned char)s[i + 1])) return false;
+        char b[3] = {s[i], s[i + 1], 0};
+        out.push_back((uint8_t)strtoul(b, nullptr, 16));
+    }
+    return true;
+}
+
+static bool parseLine(char *line, Advert &a) {
+    size_t len = strcspn(line, "\r\n");
+    line[len] = '\0';
+    const char *adv = strstr(line, "ADV ");
+    if (!adv) {
+        a.mac.clear();
+        return hexToBytes(line, len, a.payload);
+    }
+    const char *last = strrchr(adv, ' ');
+    char mac[18] = {};
+    sscanf(adv + 4, "%17s", mac);
+    a.mac = mac;
+    return last && hexToBytes(last + 1, strlen(last + 1), a.payload);
+}
+
+static std::string readFile(const char *path) {
+    std::string s;
+    FILE *f = fopen(path, "rb");
+    if (!f) return s;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) s.append(buf, n);
+    fclose(f);
+    return s;
+}
+
+int main(int argc, char **argv) {
+    const char *specPath = nullptr;
+    const char *capPath = nullptr;
+    long passes = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-p") && i + 1 < argc) specPath = argv[++i];
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc) passes = atol(argv[++i]);
+        else capPath = argv[i];
+    }
+    if (!capPath) {
+        fprintf(stderr, "usage: %s [-p patterns.txt] [-n passes] capture.log\n", argv[0]);
+        return 2;
+    }
+
+    std::string spec = specPath ? readFile(specPath) : std::string(BLE_TRACKER_PRESETS);
+    static BleMatchTable table;
+    uint32_t rejected = 0;
+    size_t rules = bleCompile(table, spec.data(), spec.size(), &rejected);
+    printf("%zu rules, %u patterns, %u lines rejected, table %zu bytes\n", rules,
+           (unsigned)table.patternCount, (unsigned)rejected, sizeof(table));
+
+    FILE *f = fopen(capPath, "r");
+    if (!f) {
+        perror(capPath);
+        return 1;
+    }
+    std::vector<Advert> adverts;
+    char line[1024];
+    Advert a;
+    while (fgets(line, sizeof(line), f)) {
+        if (parseLine(line, a)) adverts.push_back(a);
+    }
+    fclose(f);
+    if (adverts.empty()) {
+        printf("no adverts in %s\n", capPath);
+        return 1;
+    }
+
+    uint32_t counts[BLE_MAX_PATTERNS] = {};
+    size_t matched = 0;
+    for (const Advert &ad : adverts) {
+        uint32_t hits = bleMatch(table, ad.payload.data(), ad.payload.size());
+        if (hits) matched++;
+        for (size_t p = 0; p < table.patternCount; p++) {
+            if (hits & (1u << p)) counts[p]++;
+        }
+    }
+    printf("%zu adverts, %zu matched\n", adverts.size(), matched);
+    for (size_t p = 0; p < table.patternCount; p++) {
+        printf("  %-15s %u\n", table.labels[p], (unsigned)counts[p]);
+    }
+
+    // Enough passes for about two million matches unless told otherwise
+    if (passes <= 0) passes = (long)(2000000 / adverts.size()) + 1;
+    volatile uint32_t sink = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (long n = 0; n < passes; n++) {
+        for (const Advert &ad : adverts) sink = sink + bleMatch(table, ad.payload.data(), ad.payload.size());
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / ((double)passes * adverts.size());
+    printf("%.1f ns per advert over %ld passes\n", ns, passes);
+    return 0;
+}
@@ -0,0 +1,125 @@
+// Host check for RSSI trilateration on synthetic data.
+//
+// Scatters nodes and a target at random, draws RSSI from the path-loss
+// model with log-normal shadowing, and counts how often the reported 95%
+// error ellipse contains the true position. Exits non-zero when coverage
+// falls outside the band below, or when the ellipse is out of proportion
+// to the actual error (median semi-major axis over median error). Build on
+// Linux with:
+//   g++ -std=c++17 -O2 -IAntihunter_Mesh/src -o locatecheck
+//       tools/locatecheck.cpp Antihunter_Mesh/src/locate.cpp
+// Usage:
+//   ./locatecheck                  (2000 trials, 5 nodes, 4 dB shadowing)
+//   ./locatecheck -s 1             (near-linear: coverage held to 90-98.5%)
+//   ./locatecheck -t 5000 -n 8 -s 6 -r 42
+// The near-linear band holds from five nodes; with three or four the
+// ellipse under-covers even at 1 dB, and locateTarget marks three-node
+// fixes rough.
+
+#include "locate.h"
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+static const double EARTH_RADIUS_M = 6371000.0;
+static const double LAT0 = 59.91, LON0 = 10.75;
+static const double AREA_M = 300.0;
+// Accepted coverage for a nominal 95% ellipse. The ellipse is linearised,
+// so it is held to the nominal band only in the near-linear regime; under
+// heavier shadowing the error grows tails the linearisation cannot see and
+// only a floor is enforced
+static const double LINEAR_SHADOW_DB = 1.0;
+static const double COVERAGE_MIN = 0.90;
+static const double COVERAGE_MIN_SHADOWED = 0.70;
+static const double COVERAGE_MAX = 0.985;
+// For a circular Gaussian error the 95% radius is about 2.1 times the
+// median error; allow for elongated ellipses but not for runaway ones
+static const double SIZE_RATIO_MIN = 1.2;
+static const double SIZE_RATIO_MAX = 5.0;
+
+static double median(std::vector<double> &v) {
+    if (v.empty()) return 0;
+    std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+    return v[v.size() / 2];
+}
+
+int main(int argc, char **argv) {
+    int trials = 2000, nodes = 5;
+    double shadow = 4.0;
+    unsigned seed = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:n:s:r:")) != -1) {
+        switch (opt) {
+        case 't': trials = atoi(optarg); break;
+        case 'n': nodes = atoi(optarg); break;
+        case 's': shadow = atof(optarg); break;
+        case 'r': seed = (unsigned)atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-t trials] [-n nodes] [-s shadow_db] [-r seed]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (nodes < 3 || nodes > (int)LOCATE_MAX_SAMPLES) {
+        fprintf(stderr, "nodes must be 3..%u\n", (unsigned)LOCATE_MAX_SAMPLES);
+        return 2;
+    }
+
+    PathLossModel m = DEFAULT_PATH_LOSS;
+    m.shadowDb = (float)shadow;
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> pos(0, AREA_M);
+    std::normal_distribution<double> noise(0, shadow);
+    double ky = EARTH_RADIUS_M * M_PI / 180.0;
+    double kx = ky * cos(LAT0 * M_PI / 180.0);
+
+    int solved = 0, inside = 0;
+    double errSum = 0, majorSum = 0;
+    std::vector<double> errs, majors;
+    for (int t = 0; t < trials; t++) {
+        double tx = pos(rng), ty = pos(rng);
+        LocateSample s[LOCATE_MAX_SAMPLES];
+        for (int i = 0; i < nodes; i++) {
+            double x = pos(rng), y = pos(rng);
+            double d = hypot(x - tx, y - ty);
+            if (d < 1) d = 1;
+            s[i].lat = LAT0 + y / ky;
+            s[i].lon = LON0 + x / kx;
+            s[i].rssi = (float)(m.rssi1m - 10.0 * m.exponent * log10(d) + noise(rng));
+            s[i].offsetDb = 0;
+        }
+        LocateResult r;
+        if (!locateTarget(s, nodes, m, r)) continue;
+        solved++;
+
+        // Error in the ellipse frame; bearing is clockwise from north
+        double ex = (r.lon - LON0) * kx - tx, ey = (r.lat - LAT0) * ky - ty;
+        double b = r.bearing * M_PI / 180.0;
+        double along = ex * sin(b) + ey * cos(b);
+        double across = ex * cos(b) - ey * sin(b);
+        double a2 = (double)r.semiMajor * r.semiMajor, b2 = (double)r.semiMinor * r.semiMinor;
+        if (b2 > 0 && along * along / a2 + across * across / b2 <= 1.0) inside++;
+        errSum += hypot(ex, ey);
+        majorSum += r.semiMajor;
+        errs.push_back(hypot(ex, ey));
+        majors.push_back(r.semiMajor);
+    }
+
+    double coverage = solved ? (double)inside / solved : 0;
+    printf("trials=%d nodes=%d shadow=%.1fdB solved=%d coverage=%.1f%% mean_err=%.1fm mean_major=%.1fm\n", trials,
+           nodes, shadow, solved, coverage * 100, solved ? errSum / solved : 0, solved ? majorSum / solved : 0);
+    double medErr = median(errs), medMajor = median(majors);
+    double ratio = medErr > 0 ? medMajor / medErr : 0;
+    printf("median_err=%.1fm median_major=%.1fm ratio=%.2f\n", medErr, medMajor, ratio);
+    double covMin = shadow <= LINEAR_SHADOW_DB ? COVERAGE_MIN : COVERAGE_MIN_SHADOWED;
+    bool covOk = coverage >= covMin && coverage <= COVERAGE_MAX;
+    bool sizeOk = ratio >= SIZE_RATIO_MIN && ratio <= SIZE_RATIO_MAX;
+    printf("%s: 95%% ellipse coverage %s [%.1f%%, %.1f%%]\n", covOk ? "PASS" : "FAIL", covOk ? "within" : "outside",
+           covMin * 100, COVERAGE_MAX * 100);
+    printf("%s: ellipse size ratio %s [%.1f, %.1f]\n", sizeOk ? "PASS" : "FAIL", sizeOk ? "within" : "outside",
+           SIZE_RATIO_MIN, SIZE_RATIO_MAX);
+    return covOk && sizeOk ? 0 : 1;
+}
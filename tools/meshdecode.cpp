@@ -0,0 +1,175 @@
+// Host decoder for Antihunter_Mesh binary frames.
+//
+// Reads a raw byte stream (serial capture or a tty) and prints one line per
+// record, or with -f merges sightings from all nodes into one table. Build
+// on Linux with:
+//   g++ -std=c++17 -O2 -IAntihunter_Mesh/src -o meshdecode
+//       tools/meshdecode.cpp Antihunter_Mesh/src/meshproto.cpp
+//       Antihunter_Mesh/src/fusion.cpp Antihunter_Mesh/src/locate.cpp
+// Usage:
+//   ./meshdecode /dev/ttyUSB0      (configure the port first, e.g. stty raw 115200)
+//   ./meshdecode < capture.bin
+//   ./meshdecode -f /dev/ttyUSB0   (fused table, reprinted every 5 s)
+
+#include "meshproto.h"
+#include "fusion.h"
+#include "locate.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static FusionTable fusion;
+
+static void printMac(const uint8_t *m) {
+    printf("%02X:%02X:%02X:%02X:%02X:%02X", m[0], m[1], m[2], m[3], m[4], m[5]);
+}
+
+static void printFrame(const uint8_t *payload, size_t len) {
+    MeshFrameReader rd;
+    if (!rd.open(payload, len)) {
+        printf("bad frame header (%zu bytes)\n", len);
+        return;
+    }
+
+    const MeshHeader &h = rd.header();
+    printf("node=%08X seq=%u", (unsigned)h.nodeId, (unsigned)h.seq);
+    if (h.flags & MESH_FLAG_UTC) {
+        time_t t = (time_t)h.time;
+        char buf[24];
+        strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+        printf(" utc=%s", buf);
+    } else {
+        printf(" t=%us", (unsigned)h.time);
+    }
+    if (h.flags & MESH_FLAG_FIX) printf(" fix=%.7f,%.7f", h.latE7 / 1e7, h.lonE7 / 1e7);
+    printf(" records=%u\n", rd.count());
+
+    for (unsigned i = 0; i < rd.count(); i++) {
+        if (h.type == MESH_MSG_SIGHTINGS) {
+            MeshSighting s;
+            if (!rd.nextSighting(s)) break;
+            printf("  %s %s ", s.isNew ? "NEW " : "SEEN", s.isBLE ? "BLE " : "WiFi");
+            printMac(s.mac);
+            printf(" RSSI:%d", s.rssi);
+            if (!s.isBLE) printf(" ch=%u", (unsigned)s.ch);
+            printf(" x%u age=%us", (unsigned)s.count, (unsigned)s.age);
+            if (s.name[0]) printf(" name=%s", s.name);
+            printf("\n");
+        } else if (h.type == MESH_MSG_TRACKER) {
+            MeshTrackerReport t;
+            if (!rd.nextTracker(t)) break;
+            printf("  TRACK ");
+            printMac(t.mac);
+            printf(" RSSI:%d pkts=%u lastSeen=%us\n", t.rssi, (unsigned)t.packets, (unsigned)t.lastSeenAge);
+        } else if (h.type == MESH_MSG_HELLO) {
+            uint16_t mask;
+            if (!rd.nextHello(mask)) break;
+            if (mask) printf("  HELLO chanmask=%04X\n", (unsigned)mask);
+            else printf("  BYE\n");
+        } else if (h.type == MESH_MSG_COMMAND) {
+            uint32_t target;
+            char text[256];
+            if (!rd.nextCommand(target, text, sizeof(text))) break;
+            if (target) printf("  CMD to %08X: %s\n", (unsigned)target, text);
+            else printf("  CMD to all: %s\n", text);
+        } else {
+            printf("  type %u not decoded\n", (unsigned)h.type);
+            break;
+        }
+    }
+}
+
+static void fuseFrame(const uint8_t *payload, size_t len, uint32_t now) {
+    MeshFrameReader rd;
+    if (!rd.open(payload, len)) return;
+
+    const MeshHeader &h = rd.header();
+    if (h.type != MESH_MSG_SIGHTINGS && h.type != MESH_MSG_TRACKER) return;
+    fusion.noteNode(h.nodeId, now, h.flags & MESH_FLAG_FIX, h.latE7, h.lonE7);
+    for (unsigned i = 0; i < rd.count(); i++) {
+        if (h.type == MESH_MSG_SIGHTINGS) {
+            MeshSighting s;
+            if (!rd.nextSighting(s)) break;
+            fusion.ingest(h.nodeId, now - s.age, s.mac, s.rssi, s.count, s.isBLE, s.ch, s.name);
+        } else {
+            MeshTrackerReport t;
+            if (!rd.nextTracker(t)) break;
+            fusion.ingest(h.nodeId, now - t.lastSeenAge, t.mac, t.rssi, 1, false, 0, nullptr);
+        }
+    }
+}
+
+static void printFused(uint32_t now) {
+    fusion.expire(now);
+    printf("--- %zu targets from %zu nodes (merged %u, evicted %u)\n", fusion.size(), fusion.nodeCount(),
+           (unsigned)fusion.merged(), (unsigned)fusion.evicted());
+    for (size_t i = 0; i < fusion.capacity(); i++) {
+        const FusionEntry &e = fusion.entry(i);
+        if (!e.used) continue;
+        printf("%s ", e.isBLE ? "BLE " : "WiFi");
+        printMac(e.mac);
+        if (e.name[0]) printf(" %s", e.name);
+        printf(" total=%u last=%us\n", (unsigned)e.total, (unsigned)(now - e.lastSeen));
+        for (uint8_t s = 0; s < e.reports; s++) {
+            const FusionReport &r = e.slot[s];
+            const FusionNode &n = fusion.node(r.node);
+            printf("    %08X RSSI:%d max:%d x%u %us ago", (unsigned)n.nodeId, r.rssi, r.rssiMax,
+                   (unsigned)r.count, (unsigned)(now - r.lastSeen));
+            if (n.hasFix) printf(" @%.6f,%.6f", n.latE7 / 1e7, n.lonE7 / 1e7);
+            printf("\n");
+        }
+
+        LocateSample samples[FUSION_SLOTS];
+        size_t used = 0;
+        for (uint8_t s = 0; s < e.reports; s++) {
+            const FusionNode &n = fusion.node(e.slot[s].node);
+            if (!n.hasFix) continue;
+            samples[used++] = { n.latE7 / 1e7, n.lonE7 / 1e7, (float)e.slot[s].rssi, 0 };
+        }
+        LocateResult est;
+        if (locateTarget(samples, used, DEFAULT_PATH_LOSS, est)) {
+            printf("    est %.6f,%.6f +/- %.0fx%.0fm @%.0f deg rms=%.1fm%s\n", est.lat, est.lon,
+                   est.semiMajor, est.semiMinor, est.bearing, est.rmsResidual, est.rough ? " rough" : "");
+        }
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    FILE *in = stdin;
+    bool fuse = false;
+    int arg = 1;
+    if (arg < argc && strcmp(argv[arg], "-f") == 0) {
+        fuse = true;
+        arg++;
+    }
+    if (arg < argc) {
+        in = fopen(argv[arg], "rb");
+        if (!in) {
+            perror(argv[arg]);
+            return 1;
+        }
+    }
+
+    MeshFrameParser parser;
+    uint32_t lastPrint = (uint32_t)time(nullptr);
+    int c;
+    while ((c = fgetc(in)) != EOF) {
+        if (!parser.push((uint8_t)c)) continue;
+        if (!fuse) {
+            printFrame(parser.payload(), parser.payloadLen());
+            fflush(stdout);
+            continue;
+        }
+        uint32_t now = (uint32_t)time(nullptr);
+        fuseFrame(parser.payload(), parser.payloadLen(), now);
+        if (now - lastPrint >= 5) {
+            printFused(now);
+            lastPrint = now;
+        }
+    }
+    if (fuse) printFused((uint32_t)time(nullptr));
+
+    if (parser.crcErrors()) fprintf(stderr, "%u frames failed CRC\n", (unsigned)parser.crcErrors());
+    return 0;
+}
@@ -0,0 +1,65 @@
+// Signs Antihunter_Mesh commands for sending over the mesh.
+//
+// Prints the AH:CMD line with its " #<seq>.<tag>" suffix for the shared
+// command key set on each node's web UI. Build on Linux with:
+//   g++ -std=c++17 -O2 -IAntihunter_Mesh/src -o meshsign
+//       tools/meshsign.cpp Antihunter_Mesh/src/meshauth.cpp
+// Usage:
+//   ./meshsign -k secret ALL SCAN 60 wifi
+//   ./meshsign -k secret -s 1042 1A2B3C4D STOP track
+// seq defaults to the current Unix time, which keeps growing between
+// invocations; nodes refuse a seq they have already passed.
+
+#include "meshauth.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <string>
+#include <time.h>
+#include <unistd.h>
+
+int main(int argc, char **argv) {
+    const char *key = getenv("AH_MESH_KEY");
+    uint32_t seq = (uint32_t)time(nullptr);
+    int opt;
+    while ((opt = getopt(argc, argv, "+k:s:")) != -1) {
+        switch (opt) {
+        case 'k': key = optarg; break;
+        case 's': seq = (uint32_t)strtoul(optarg, nullptr, 10); break;
+        default:
+            fprintf(stderr, "usage: %s [-k key] [-s seq] <node|ALL> <command...>\n", argv[0]);
+            return 2;
+        }
+    }
+    if (!key || !*key || strlen(key) > MESH_AUTH_MAX_KEY) {
+        fprintf(stderr, "need a command key of 1-%u bytes (-k or AH_MESH_KEY)\n", (unsigned)MESH_AUTH_MAX_KEY);
+        return 2;
+    }
+    if (argc - optind < 2) {
+        fprintf(stderr, "usage: %s [-k key] [-s seq] <node|ALL> <command...>\n", argv[0]);
+        return 2;
+    }
+
+    uint32_t target = 0;
+    const char *node = argv[optind++];
+    if (strcasecmp(node, "ALL") != 0) {
+        char *end = nullptr;
+        target = (uint32_t)strtoul(node, &end, 16);
+        if (end == node || *end || !target) {
+            fprintf(stderr, "node must be ALL or an 8-digit hex node id\n");
+            return 2;
+        }
+    }
+    std::string cmd;
+    for (int i = optind; i < argc; i++) {
+        if (!cmd.empty()) cmd += ' ';
+        cmd += argv[i];
+    }
+
+    char tag[MESH_AUTH_TAG_HEX + 1];
+    meshAuthTag((const uint8_t *)key, strlen(key), target, seq, cmd.c_str(), tag);
+    if (target) printf("AH:CMD %08lX %s #%lu.%s\n", (unsigned long)target, cmd.c_str(), (unsigned long)seq, tag);
+    else printf("AH:CMD ALL %s #%lu.%s\n", cmd.c_str(), (unsigned long)seq, tag);
+    return 0;
+}